@@ -14,7 +14,8 @@
 #include "types.h"
 #include "write.h"
 
-#define C(nm, nargs) {.code=nm, .name=#nm, .arity=nargs}
+#define C(nm, nargs) {.code=nm, .name=#nm, .arity=nargs, .label=0}
+#define CL(nm, nargs, pos) {.code=nm, .name=#nm, .arity=nargs, .label=pos}
 #define arg1(x) pair_cadr(x)
 #define arg2(x) pair_caddr(x)
 #define arg3(x) pair_cadddr(x)
@@ -23,16 +24,16 @@
 extern int symbol_name_comparator(char *, char *);
 
 struct code_t opcodes[] = {
-  C(ARGS, 1),
-  C(ARGSD, 1),
+  C(ARGS, 2),
+  C(ARGSD, 2),
   C(CALL, 1),
   C(CALLJ, 1),
   C(CONST, 1),
-  C(FJUMP, 1),
-  C(FN, 1),
+  CL(FJUMP, 1, 1),
+  C(FN, 2),
   C(GSET, 1),
   C(GVAR, 1),
-  C(JUMP, 1),
+  CL(JUMP, 1, 1),
   C(LSET, 2),
   C(LVAR, 2),
   C(MC, 1),
@@ -43,8 +44,8 @@ struct code_t opcodes[] = {
   C(PRIM2, 0),
   C(PRIM3, 0),
   C(RETURN, 0),
-  C(SAVE, 1),
-  C(TJUMP, 1),
+  CL(SAVE, 1, 1),
+  CL(TJUMP, 1, 1),
   C(IADD, 0),
   C(ISUB, 0),
   C(IMUL, 0),
@@ -52,6 +53,95 @@ struct code_t opcodes[] = {
   C(CAR, 0),
   C(CDR, 0),
   C(EQ, 0),
+  C(RARGS, 2),
+  C(RARGSD, 2),
+  C(RCALLJ, 1),
+  C(RRET, 1),
+  C(RMOV, 2),
+  C(RPUSH, 1),
+  C(RPOP, 1),
+  C(RGVAR, 2),
+  C(RGSET, 2),
+  C(RLVAR, 3),
+  C(RLSET, 3),
+  CL(RFJUMP, 2, 2),
+  CL(RTJUMP, 2, 2),
+  C(RPRIM0, 2),
+  C(RPRIM1, 3),
+  C(RPRIM2, 4),
+  C(RPRIM3, 5),
+  C(RADD, 3),
+  C(RSUB, 3),
+  C(RMUL, 3),
+  C(RDIV, 3),
+  C(RCAR, 2),
+  C(RCDR, 2),
+  C(REQ, 3),
+  CL(CATCH, 1, 1),
+  C(UNCATCH, 0),
+  C(THROW, 0),
+  C(LBOX, 1),
+  C(BVAR, 2),
+  C(BSET, 2),
+  C(SARGS, 2),
+  C(SARGSD, 2),
+  C(SCALLJ, 1),
+  C(SVAR, 1),
+  C(SSET, 1),
+  C(SBOX, 1),
+  C(SBVAR, 1),
+  C(SBSET, 1),
+  C(NADD, 0),
+  C(NSUB, 0),
+  C(NMUL, 0),
+  C(NDIV, 0),
+  C(NLT, 0),
+  C(NEQ, 0),
+  C(NGT, 0),
+  C(RNADD, 3),
+  C(RNSUB, 3),
+  C(RNMUL, 3),
+  C(RNDIV, 3),
+  C(RNLT, 3),
+  C(RNEQ, 3),
+  C(RNGT, 3),
+  C(FLOAD, 0),
+  C(FADD, 0),
+  C(FSUB, 0),
+  C(FMUL, 0),
+  C(FDIV, 0),
+  C(FBOX, 0),
+  C(RFLOAD, 1),
+  C(RFBOX, 1),
+  C(VADD, 0),
+  C(VMUL, 0),
+  C(VDOT, 0),
+  C(VSUM, 0),
+  C(VMIN, 0),
+  C(VMAX, 0),
+  C(VSCALE, 0),
+  C(VFILL, 0),
+  C(VCOPY, 0),
+  C(RVADD, 3),
+  C(RVMUL, 3),
+  C(RVDOT, 3),
+  C(RVSUM, 2),
+  C(RVMIN, 2),
+  C(RVMAX, 2),
+  C(RVSCALE, 3),
+  C(RVFILL, 3),
+  C(RVCOPY, 2),
+  C(RECMAKE, 1),
+  C(RECP, 1),
+  C(RECREF, 2),
+  C(RECSET, 2),
+  C(RRECNEW, 2),
+  C(RRECINIT, 3),
+  C(RRECP, 3),
+  C(RRECREF, 4),
+  C(RRECSET, 5),
+  C(GMETHOD, 2),
+  C(RGMETHOD, 4),
 };
 
 /* Categorize the instruction */
@@ -121,14 +211,13 @@ sexp extract_labels(sexp compiled_code, int *length) {
   return extract_labels_aux(compiled_code, 0, length);
 }
 
-int is_with_label(lisp_object_t code) {
-  static char *label_ins[] = {
-    "FJUMP", "JUMP", "SAVE", "TJUMP",
-  };
-  for (int i = 0; i < sizeof(label_ins) / sizeof(char *); i++)
-    if (pair_car(code) == S(label_ins[i]))
-      return yes;
-  return no;
+/* Returns the position of the label argument in instruction, or 0 if it has none */
+int get_label_position(sexp opcode) {
+  for (int i = 0; i < sizeof(opcodes) / sizeof(struct code_t); i++)
+    if (!symbol_name_comparator(opcodes[i].name, symbol_name(opcode)))
+      return opcodes[i].label;
+  port_format(scm_out_port, "Unexpected opcode: %*\n", opcode);
+  exit(1);
 }
 
 lisp_object_t search_label_offset(lisp_object_t label, lisp_object_t label_table) {
@@ -151,43 +240,33 @@ sexp to_opbyte(sexp opcode) {
   exit(1);
 }
 
-void write_arg_bytes(sexp code[], int *index, sexp ins) {
-  sexp opcode = opcode(ins);
-  if (is_const_op(opcode)) return;
-  if (is_unary_op(opcode)) {
-    code[*index] = arg1(ins);
+/* Writes the arguments of `ins' into `code', the label argument is replaced by its offset */
+void write_arg_bytes(sexp code[], int *index, sexp ins, sexp label_table) {
+  int label = get_label_position(opcode(ins));
+  int n = 1;
+  for (sexp args = pair_cdr(ins); is_pair(args); args = pair_cdr(args), n++) {
+    sexp arg = pair_car(args);
+    if (n == label && is_label(arg))
+      arg = search_label_offset(arg, label_table);
+    code[*index] = arg;
     (*index)++;
-    return;
   }
-  if (is_binary_op(opcode)) {
-    code[*index] = arg1(ins);
-    (*index)++;
-    code[*index] = arg2(ins);
-    (*index)++;
-    return;
-  }
-  port_format(scm_out_port, "Unexpected ins: %*\n", ins);
-  exit(1);
 }
 
-/* Convert the byte code stored as a list in COMPILED_PROC into a vector filled of the same code, except the label in instructions with label will be replace by an integer offset. */
+/* Convert the byte code stored as a list in COMPILED_PROC into a vector filled of the same code, except the label in instructions with label will be replace by an integer offset. The list itself is left untouched. */
 sexp vectorize_code(sexp compiled_code, int length, sexp label_table) {
   sexp code_vector = make_vector(length);
   int i = 0;
   while (is_pair(compiled_code)) {
     sexp code = pair_car(compiled_code);
     if (!is_label(code)) {
-      if (is_with_label(code) && is_label(arg1(code))) {
-        /* port_format(scm_out_port, "Replacing the label of %*\n", code); */
-        arg1(code) = search_label_offset(arg1(code), label_table);
-        label_table = pair_cdr(label_table);
-      }
       vector_data_at(code_vector, i) = to_opbyte(opcode(code));
       i++;
-      write_arg_bytes(vector_datum(code_vector), &i, code);
+      write_arg_bytes(vector_datum(code_vector), &i, code, label_table);
     }
     compiled_code = pair_cdr(compiled_code);
   }
+  vector_pos(code_vector) = length;
   return code_vector;
 }
 
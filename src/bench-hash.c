@@ -0,0 +1,145 @@
+/*
+ * bench-hash.c
+ *
+ * Lookups in hash tables and persistent maps against association lists
+ *
+ * Copyright (C) 2013-04-24 liutos <mat.liutos@gmail.com>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "types.h"
+#include "object.h"
+#include "hamt.h"
+#include "hashtable.h"
+#include "init.h"
+
+#define MAX_KEYS 10000000
+/* Strings take more memory, they stop earlier */
+#define MAX_STRING_KEYS 1000000
+#define MAX_HAMT_KEYS 1000000
+#define TABLE_LOOKUPS 1000000
+#define SNAPSHOTS 100
+/* The lookups in an alist are limited to about this many comparisons */
+#define ALIST_WORK 100000000L
+
+double seconds_since(clock_t start) {
+  return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+/* As `assv' or `assoc' */
+sexp alist_find(sexp key, sexp alist, int (*same)(sexp, sexp)) {
+  for (; !is_null(alist); alist = pair_cdr(alist))
+    if (same(pair_caar(alist), key))
+      return pair_car(alist);
+  return false_object;
+}
+
+sexp make_key(int i, int is_string_key) {
+  if (!is_string_key)
+    return make_fixnum(i);
+  char buffer[32];
+  sprintf(buffer, "key-%d", i);
+  return make_string(strdup(buffer));
+}
+
+void bench(int n, int is_string_key) {
+  sexp keys = make_vector(n);
+  for (int i = 0; i < n; i++)
+    vector_push(make_key(i, is_string_key), keys);
+  sexp table = is_string_key ? make_string_table_proc(): make_eqv_table_proc();
+  int (*same)(sexp, sexp) = is_string_key ? is_equal: is_eqv;
+
+  clock_t start = clock();
+  for (int i = 0; i < n; i++)
+    hash_table_set(table, vector_data_at(keys, i), make_fixnum(i));
+  double insert = seconds_since(start);
+  start = clock();
+  long found = 0;
+  for (int i = 0; i < TABLE_LOOKUPS; i++) {
+    sexp key = vector_data_at(keys, (i * 7919L) % n);
+    found += hash_table_ref(table, key, false_object) != false_object;
+  }
+  double lookup = seconds_since(start);
+
+  start = clock();
+  sexp alist = EOL;
+  for (int i = 0; i < n; i++)
+    alist = make_pair(make_pair(vector_data_at(keys, i), make_fixnum(i)), alist);
+  double cons = seconds_since(start);
+  long lookups = ALIST_WORK / n;
+  if (lookups > TABLE_LOOKUPS) lookups = TABLE_LOOKUPS;
+  if (lookups < 10) lookups = 10;
+  start = clock();
+  for (long i = 0; i < lookups; i++) {
+    sexp key = vector_data_at(keys, (i * 7919L) % n);
+    found += alist_find(key, alist, same) != false_object;
+  }
+  double search = seconds_since(start);
+
+  printf("%9d  table %7.1f ns/insert %7.1f ns/lookup   alist %7.1f ns/cons %12.1f ns/lookup  (%ld)\n",
+         n, insert * 1e9 / n, lookup * 1e9 / TABLE_LOOKUPS,
+         cons * 1e9 / n, search * 1e9 / lookups, found);
+}
+
+/* Bulk loads, lookups, and new versions which differ in one key. An alist
+   is copied for every version to keep the old one intact. */
+void bench_hamt(int n) {
+  clock_t start = clock();
+  sexp map = make_hamt_proc();
+  for (int i = 0; i < n; i++)
+    map = hamt_set(map, make_fixnum(i), make_fixnum(i));
+  double persistent = seconds_since(start);
+  start = clock();
+  sexp transient = hamt_transient(make_hamt_proc());
+  for (int i = 0; i < n; i++)
+    hamt_set_x(transient, make_fixnum(i), make_fixnum(i));
+  map = hamt_persistent(transient);
+  double bulk = seconds_since(start);
+  start = clock();
+  long found = 0;
+  for (int i = 0; i < TABLE_LOOKUPS; i++)
+    found += hamt_ref(map, make_fixnum((i * 7919L) % n), false_object) != false_object;
+  double lookup = seconds_since(start);
+  start = clock();
+  sexp version = map;
+  for (int i = 0; i < SNAPSHOTS; i++)
+    version = hamt_set(version, make_fixnum((i * 7919L) % n), make_fixnum(-i));
+  double update = seconds_since(start);
+  found += hamt_count(version);
+
+  sexp alist = EOL;
+  for (int i = 0; i < n; i++)
+    alist = make_pair(make_pair(make_fixnum(i), make_fixnum(i)), alist);
+  int copies = n > 100000 ? 10: SNAPSHOTS;
+  start = clock();
+  for (int i = 0; i < copies; i++) {
+    sexp key = make_fixnum((i * 7919L) % n);
+    sexp copy = EOL;
+    for (sexp l = alist; !is_null(l); l = pair_cdr(l))
+      copy = make_pair(pair_caar(l) == key ? make_pair(key, make_fixnum(-i)): pair_car(l), copy);
+    alist = copy;
+  }
+  double copy = seconds_since(start);
+
+  printf("%9d  hamt %7.1f ns/insert %7.1f ns/transient insert %7.1f ns/lookup %9.1f ns/version   alist %12.1f ns/version  (%ld)\n",
+         n, persistent * 1e9 / n, bulk * 1e9 / n, lookup * 1e9 / TABLE_LOOKUPS,
+         update * 1e9 / SNAPSHOTS, copy * 1e9 / copies, found);
+}
+
+int main(int argc, char *argv[])
+{
+  init_impl();
+  printf(">> eqv? on fixnums\n");
+  for (int n = 10; n <= MAX_KEYS; n *= 10)
+    bench(n, no);
+  printf(">> string=? on strings\n");
+  for (int n = 10; n <= MAX_STRING_KEYS; n *= 10)
+    bench(n, yes);
+  printf(">> persistent maps on fixnums\n");
+  for (int n = 10; n <= MAX_HAMT_KEYS; n *= 10)
+    bench_hamt(n);
+  return 0;
+}
@@ -0,0 +1,91 @@
+/*
+ * bench-regex.c
+ *
+ * Searches by the lazy DFA against the Pike VM alone and against strstr
+ *
+ * Copyright (C) 2013-04-27 liutos <mat.liutos@gmail.com>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "types.h"
+#include "object.h"
+#include "regexp.h"
+#include "init.h"
+
+#define TEXT_SIZE (16 << 20)
+/* The Pike VM is too slow for the whole text */
+#define PIKE_SIZE (1 << 20)
+#define ROUNDS 4
+
+/* Lines of words and numbers, the last one ended by `needle' */
+char *make_text(size_t size, const char *needle) {
+  static const char *words[] = {
+    "the", "quick", "brown", "fox", "jumps", "over", "lazy", "dog", "2013",
+    "haystack", "straw", "needles", "nee", "dle", "04", "-", "世界", "résumé",
+  };
+  int count = sizeof(words) / sizeof(char *);
+  char *text = malloc(size + 1);
+  size_t m = strlen(needle), i = 0;
+  unsigned int seed = 1;
+  while (i + 16 + m < size) {
+    seed = seed * 1103515245 + 12345;
+    const char *word = words[(seed >> 16) % count];
+    size_t n = strlen(word);
+    memcpy(text + i, word, n);
+    i += n;
+    text[i++] = (seed >> 8) % 10 == 0 ? '\n': ' ';
+  }
+  memcpy(text + i, needle, m);
+  text[i + m] = '\0';
+  return text;
+}
+
+double seconds_since(clock_t start) {
+  return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+void report(const char *engine, size_t n, double seconds, int result) {
+  printf("   %-7s %9.1f MB/s  (%d)\n", engine, ROUNDS * n / seconds / 1e6, result);
+}
+
+void bench(const char *pattern, const char *needle) {
+  struct regexp_t *re = regexp_program(regexp_compile(make_string(strdup(pattern))));
+  char *text = make_text(TEXT_SIZE, needle);
+  char *small = make_text(PIKE_SIZE, needle);
+  int result = 0;
+  printf(">> %s\n", pattern);
+  clock_t start = clock();
+  for (int i = 0; i < ROUNDS; i++)
+    result = dfa_run(re, text, TEXT_SIZE, no);
+  report("dfa", TEXT_SIZE, seconds_since(start), result);
+  start = clock();
+  for (int i = 0; i < ROUNDS; i++)
+    result = pike_run(re, small, PIKE_SIZE, 0, no);
+  report("pike", PIKE_SIZE, seconds_since(start), result);
+  if (strpbrk(pattern, "\\[](){}|*+?.^$") == NULL) {
+    start = clock();
+    for (int i = 0; i < ROUNDS; i++)
+      result = strstr(text, pattern) != NULL;
+    report("strstr", TEXT_SIZE, seconds_since(start), result);
+  }
+  free(text);
+  free(small);
+}
+
+int main(int argc, char *argv[])
+{
+  init_impl();
+  /* A literal prefix, searched by memchr */
+  bench("Z", "Z");
+  /* A longer one, searched by the SIMD kernel of utf8_search */
+  bench("needle in", "a needle in it");
+  bench("needle\\s+in", "a needle  in it");
+  /* No prefix, every byte steps the DFA */
+  bench("\\d{4}-\\d\\d-\\d\\d", "on 2013-04-27");
+  bench("(quick|lazy) (fox|cat)s", "lazy cats");
+  bench("[^ \n]{12,}", "antidisestablishment");
+  return 0;
+}
@@ -0,0 +1,78 @@
+/*
+ * bench-utf8.c
+ *
+ * Throughput of the UTF-8 kernels for each instruction set
+ *
+ * Copyright (C) 2013-04-20 liutos <mat.liutos@gmail.com>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "utf8.h"
+
+#define TEXT_SIZE (64 << 20)
+#define ROUNDS 8
+
+/* Fills `text' with copies of `line', ended by `needle' */
+char *make_text(const char *line, const char *needle) {
+  char *text = malloc(TEXT_SIZE + 1);
+  size_t n = strlen(line), m = strlen(needle), i = 0;
+  for (; i + n + m <= TEXT_SIZE; i += n)
+    memcpy(text + i, line, n);
+  memcpy(text + i, needle, m);
+  text[i + m] = '\0';
+  return text;
+}
+
+double seconds_since(clock_t start) {
+  return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+void report(const char *kernel, size_t n, double seconds, long result) {
+  printf("   %-9s %7.2f GB/s  (%ld)\n", kernel, ROUNDS * n / seconds / 1e9, result);
+}
+
+void bench(struct utf8_kernels_t *k, const char *text, const char *copy, const char *needle) {
+  size_t n = strlen(text), m = strlen(needle);
+  long result = 0;
+  clock_t start = clock();
+  for (int i = 0; i < ROUNDS; i++)
+    result = k->count(text, n);
+  report("count", n, seconds_since(start), result);
+  start = clock();
+  for (int i = 0; i < ROUNDS; i++)
+    result = k->validate(text, n);
+  report("validate", n, seconds_since(start), result);
+  start = clock();
+  for (int i = 0; i < ROUNDS; i++)
+    result = k->compare(text, copy, n);
+  report("compare", n, seconds_since(start), result);
+  start = clock();
+  for (int i = 0; i < ROUNDS; i++)
+    result = k->search(text, n, needle, m) - text;
+  report("search", n, seconds_since(start), result);
+}
+
+int main(int argc, char *argv[])
+{
+  const char *lines[] = {
+    "2013-04-20 12:00:01 INFO request served in 12ms path=/index.html\n",
+    "2013-04-20 12:00:01 信息 请求已处理 耗时12毫秒 路径=/首页.html\n",
+  };
+  const char *needle = "status=500 错误";
+  init_utf8();
+  for (int i = 0; i < sizeof(lines) / sizeof(char *); i++) {
+    char *text = make_text(lines[i], needle);
+    char *copy = strdup(text);
+    printf(">> %s", lines[i]);
+    for (int level = SIMD_SCALAR; level <= utf8_simd_level; level++) {
+      printf("%s\n", utf8_kernels[level].name);
+      bench(&utf8_kernels[level], text, copy, needle);
+    }
+    free(copy);
+    free(text);
+  }
+  return 0;
+}
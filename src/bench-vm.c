@@ -0,0 +1,142 @@
+/*
+ * bench-vm.c
+ *
+ * Benchmarks for the virtual machine
+ *
+ * Copyright (C) 2013-04-12 liutos <mat.liutos@gmail.com>
+ */
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "types.h"
+#include "object.h"
+#include "read.h"
+#include "write.h"
+#include "compiler.h"
+#include "eval.h"
+#include "vm.h"
+#include "init.h"
+
+int main(int argc, char *argv[])
+{
+  init_impl();
+  char *cases[] = {
+    /* Deep non-tail recursion */
+    "(define (build n) (if (eq? n 0) '() (cons n (build (-i n 1)))))",
+    "(define (len l n) (if (eq? l '()) n (len (cdr l) (+i n 1))))",
+    "(define (depth n) (if (eq? n 0) 0 (+i 1 (depth (-i n 1)))))",
+    "(len (build 1000000) 0)",
+    "(depth 1000000)",
+    /* Generic arithmetic */
+    "(define (fib n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))",
+    "(fib 30)",
+    "(set-vm-tier! 'register)",
+    "(define (fib n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))",
+    "(fib 30)",
+    "(define (build n) (if (eq? n 0) '() (cons n (build (-i n 1)))))",
+    "(define (depth n) (if (eq? n 0) 0 (+i 1 (depth (-i n 1)))))",
+    "(len (build 1000000) 0)",
+    "(depth 1000000)",
+    "(set-vm-tier! 'stack)",
+    /* Bignums */
+    "(define (fact n) (if (= n 0) 1 (* n (fact (- n 1)))))",
+    "(define (fib-iter n a b) (if (= n 0) a (fib-iter (- n 1) b (+ a b))))",
+    "(> (fact 10000) 0)",
+    "(> (fib-iter 100000 0 1) 0)",
+    "(string-length (number->string (fact 10000)))",
+    "(string-length (number->string (fib-iter 100000 0 1)))",
+    /* Unboxed flonum expressions */
+    "(define (horner n x acc) (if (= n 0) acc (horner (- n 1) (+. x 0.000001) (+. acc (*. (+. (*. (-. (*. 3.0 x) 2.0) x) 1.0) 0.000001)))))",
+    "(horner 1000000 0.0 0.0)",
+    /* Bulk operations on uniform vectors */
+    "(define (dots a n acc) (if (= n 0) acc (dots a (- n 1) (+. acc (uvector-dot a a)))))",
+    "(dots (make-f64vector 1000000 1.5) 200 0.0)",
+    "(uvector-max (uvector-scale (make-f64vector 1000000 1.5) 2.0))",
+    /* Growable vectors */
+    "(define (fill v n) (if (eq? n 0) v (begin (vector-push! v n) (fill v (-i n 1)))))",
+    "(vector-length (fill (make-vector 0) 1000000))",
+    "(define (fill2 v w n) (if (eq? n 0) v (begin (vector-push! v n) (vector-push! w n) (fill2 v w (-i n 1)))))",
+    "(vector-length (fill2 (make-vector 0) (make-vector 0) 1000000))",
+    "(vector-length (subvector (vector-grow (make-vector 1000000 0) 2000000) 1 1500000))",
+    /* Fields of a record against a vector and a list */
+    "(define-record-type point (make-point x y z) point? (x point-x) (y point-y) (z point-z set-point-z!))",
+    "(define (walk p n acc) (if (eq? n 0) acc (begin (set-point-z! p n) (walk p (-i n 1) (+i acc (point-z p))))))",
+    "(walk (make-point 1 2 3) 3000000 0)",
+    "(define (walkv v n acc) (if (eq? n 0) acc (begin (vector-set! v 2 n) (walkv v (-i n 1) (+i acc (vector-ref v 2))))))",
+    "(walkv (make-vector 3 0) 3000000 0)",
+    "(define (walkl l n acc) (if (eq? n 0) acc (begin (set-car! (cdr (cdr l)) n) (walkl l (-i n 1) (+i acc (car (cdr (cdr l))))))))",
+    "(walkl (list 1 2 3) 3000000 0)",
+    /* Generic functions: monomorphic, 4-way and megamorphic call sites */
+    "(define-generic size)",
+    "(define-method (size (x fixnum)) 1)",
+    "(define-method (size (x string)) 2)",
+    "(define-method (size (x symbol)) 3)",
+    "(define-method (size (x character)) 4)",
+    "(define-method (size (x flonum)) 5)",
+    "(define-method (size (x list)) 6)",
+    "(define-method (size (x vector)) 7)",
+    "(define-method (size x) 8)",
+    "(define (last l) (if (eq? (cdr l) '()) l (last (cdr l))))",
+    "(define (cycle l) (set-cdr! (last l) l) l)",
+    "(define (dispatch l n acc) (if (eq? n 0) acc (dispatch (cdr l) (-i n 1) (+i acc (size (car l))))))",
+    "(define (dispatch-uncached f l n acc) (if (eq? n 0) acc (dispatch-uncached f (cdr l) (-i n 1) (+i acc (f (car l))))))",
+    "(dispatch (cycle (list 1 2 3 4)) 3000000 0)",
+    "(dispatch (cycle (list 1 \"ab\" 'c #\\d)) 3000000 0)",
+    "(dispatch (cycle (list 1 \"ab\" 'c #\\d 2.5 (list 1) (make-vector 0) #t)) 3000000 0)",
+    /* No call-site cache: through the table of the methods resolved before */
+    "(dispatch-uncached size (cycle (list 1 \"ab\" 'c #\\d)) 3000000 0)",
+    /* No cache at all: the method is found through the classes on each call */
+    "(define (dispatch-resolved l n acc) (if (eq? n 0) acc (dispatch-resolved (cdr l) (-i n 1) (+i acc ((find-method size (type-of (car l))) (car l))))))",
+    "(dispatch-resolved (cycle (list 1 2 3 4)) 3000000 0)",
+    "(dispatch-resolved (cycle (list 1 \"ab\" 'c #\\d)) 3000000 0)",
+    /* Sorting: a merge sort in Scheme against the native sorts */
+    "(define (rand-list n seed acc) (if (eq? n 0) acc (rand-list (-i n 1) (remainder (+i (*i seed 1103) 12345) 1000003) (cons seed acc))))",
+    "(define xs '())",
+    "(len (begin (set! xs (rand-list 300000 7 '())) xs) 0)",
+    "(define (split l a b) (if (eq? l '()) (cons a b) (split (cdr l) b (cons (car l) a))))",
+    "(define (merge a b) (if (eq? a '()) b (if (eq? b '()) a (if (< (car b) (car a)) (cons (car b) (merge a (cdr b))) (cons (car a) (merge (cdr a) b))))))",
+    "(define (msort l) (if (eq? l '()) l (if (eq? (cdr l) '()) l ((lambda (p) (merge (msort (car p)) (msort (cdr p)))) (split l '() '())))))",
+    "(car (msort xs))",
+    "(car (sort xs <))",
+    "(car (sort xs (lambda (a b) (< a b))))",
+    "(define (push-all v l) (if (eq? l '()) v (begin (vector-push! v (car l)) (push-all v (cdr l)))))",
+    "(define v (make-vector 0))",
+    "(vector-length (push-all v xs))",
+    "(vector-ref (sort v <) 0)",
+    "(vector-ref (sort v (lambda (a b) (< a b))) 0)",
+    /* Mapping and folding: the native procedures against tail-recursive
+       versions in Scheme which reverse their results */
+    "(define (iota-list n acc) (if (eq? n 0) acc (iota-list (-i n 1) (cons n acc))))",
+    "(set! xs '())",
+    "(len (begin (set! xs (iota-list 10000000 '())) xs) 0)",
+    "(define (sreverse l acc) (if (eq? l '()) acc (sreverse (cdr l) (cons (car l) acc))))",
+    "(define (smap f l acc) (if (eq? l '()) (sreverse acc '()) (smap f (cdr l) (cons (f (car l)) acc))))",
+    "(define (sfold f acc l) (if (eq? l '()) acc (sfold f (f (car l) acc) (cdr l))))",
+    "(sfold + 0 xs)",
+    "(fold + 0 xs)",
+    "(sfold (lambda (x acc) (+i x acc)) 0 xs)",
+    "(fold (lambda (x acc) (+i x acc)) 0 xs)",
+    "(len (smap car (map list xs) '()) 0)",
+    "(len (map car (map list xs)) 0)",
+    "(len (smap (lambda (x) (+i x 1)) xs '()) 0)",
+    "(len (map (lambda (x) (+i x 1)) xs) 0)",
+    "(set! xs '())",
+    /* Growing the stack up to the limit */
+    "(catch 'stack-overflow (depth 100000000))",
+  };
+  for (int i = 0; i < sizeof(cases) / sizeof(char *); i++) {
+    FILE *fp = fmemopen(cases[i], strlen(cases[i]), "r");
+    sexp in_port = make_file_in_port(fp);
+    printf(">> %s\n", cases[i]);
+    clock_t start = clock();
+    sexp code = compile_object(read_object(in_port), repl_environment, yes, yes);
+    sexp proc = make_compiled_proc(EOL, code, repl_environment);
+    sexp value = run_compiled_code(proc, repl_environment, vm_stack);
+    double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+    port_format(scm_out_port, "=> %*\n", value);
+    printf("   %.3fs\n", seconds);
+    fclose(fp);
+  }
+  return 0;
+}
@@ -0,0 +1,219 @@
+/*
+ * bytevector.c
+ *
+ * Raw bytes: slices, bulk copies, endian-aware accessors and port I/O
+ *
+ * Copyright (C) 2013-04-23 liutos <mat.liutos@gmail.com>
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bytevector.h"
+#include "number.h"
+#include "object.h"
+#include "types.h"
+#include "uvector.h"
+#include "write.h"
+
+/* A bytevector is a u8vector, a slice shares the buffer of its parent */
+#define bytevector_data(x) uvector_u8(x)
+
+/* Checkers */
+void wrong_argument(sexp x, char *op) {
+  port_format(scm_err_port, "%s: Wrong type argument %*\n", make_string(op), x);
+  exit(1);
+}
+
+void check_bytevector(sexp bv, char *op) {
+  if (!is_uvector(bv) || uvector_kind(bv) != UVECTOR_U8)
+    wrong_argument(bv, op);
+}
+
+void check_argc(int argc, int lo, int hi, char *op) {
+  if (lo <= argc && argc <= hi) return;
+  port_format(scm_err_port, "%s: Wrong argument number: %*\n",
+              make_string(op), make_fixnum(argc));
+  exit(1);
+}
+
+/* Returns the fixnum `x', which must be in [lo, hi] */
+intptr_t check_range(sexp x, intptr_t lo, intptr_t hi, char *op) {
+  if (!is_fixnum(x) || fixnum_value(x) < lo || fixnum_value(x) > hi)
+    wrong_argument(x, op);
+  return fixnum_value(x);
+}
+
+/* Returns the position `x' in a bytevector, which must be in [lo, hi] */
+intptr_t check_index(sexp x, intptr_t lo, intptr_t hi, char *op) {
+  if (!is_fixnum(x))
+    wrong_argument(x, op);
+  if (fixnum_value(x) < lo || fixnum_value(x) > hi) {
+    port_format(scm_err_port, "%s: Index out of range %*\n", make_string(op), x);
+    exit(1);
+  }
+  return fixnum_value(x);
+}
+
+/* Returns the offset `k' of a field of `size' bytes in `bv' */
+int check_offset(sexp bv, sexp k, int size, char *op) {
+  check_bytevector(bv, op);
+  return check_index(k, 0, uvector_length(bv) - size, op);
+}
+
+/* Whether the bytes of `endian' are in the reverse order of the host */
+int is_swapped(sexp endian, char *op) {
+  int is_big = endian == S("big");
+  if (!is_big && endian != S("little"))
+    wrong_argument(endian, op);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  return !is_big;
+#else
+  return is_big;
+#endif
+}
+
+/* Length and bytes */
+sexp bytevector_length_proc(sexp bv) {
+  check_bytevector(bv, "bytevector-length");
+  return make_fixnum(uvector_length(bv));
+}
+
+sexp bytevector_u8_ref(sexp bv, sexp k) {
+  check_bytevector(bv, "bytevector-u8-ref");
+  return uvector_ref_as(bv, k, "bytevector-u8-ref");
+}
+
+sexp bytevector_u8_set(sexp bv, sexp k, sexp byte) {
+  check_bytevector(bv, "bytevector-u8-set!");
+  return uvector_set_as(bv, k, byte, "bytevector-u8-set!");
+}
+
+/* Slicing and copying */
+sexp bytevector_slice(sexp bv, sexp start, sexp end) {
+  check_bytevector(bv, "bytevector-slice");
+  int s = check_index(start, 0, uvector_length(bv), "bytevector-slice");
+  int e = check_index(end, s, uvector_length(bv), "bytevector-slice");
+  return make_uvector_slice(bv, s, e - s);
+}
+
+/* (bytevector-copy bv [start [end]]) */
+sexp bytevector_copy(int argc, sexp *argv) {
+  check_argc(argc, 1, 3, "bytevector-copy");
+  sexp bv = argv[0];
+  check_bytevector(bv, "bytevector-copy");
+  int n = uvector_length(bv);
+  int s = argc > 1 ? check_index(argv[1], 0, n, "bytevector-copy"): 0;
+  int e = argc > 2 ? check_index(argv[2], s, n, "bytevector-copy"): n;
+  sexp copy = make_uvector(UVECTOR_U8, e - s);
+  memcpy(bytevector_data(copy), bytevector_data(bv) + s, e - s);
+  return copy;
+}
+
+/* (bytevector-copy! to at from [start [end]]), the ranges may overlap */
+sexp bytevector_copy_to(int argc, sexp *argv) {
+  check_argc(argc, 3, 5, "bytevector-copy!");
+  sexp to = argv[0], from = argv[2];
+  check_bytevector(to, "bytevector-copy!");
+  check_bytevector(from, "bytevector-copy!");
+  int n = uvector_length(from);
+  int s = argc > 3 ? check_index(argv[3], 0, n, "bytevector-copy!"): 0;
+  int e = argc > 4 ? check_index(argv[4], s, n, "bytevector-copy!"): n;
+  int at = check_index(argv[1], 0, uvector_length(to) - (e - s), "bytevector-copy!");
+  memmove(bytevector_data(to) + at, bytevector_data(from) + s, e - s);
+  return to;
+}
+
+sexp bytevector_fill(sexp bv, sexp byte) {
+  check_bytevector(bv, "bytevector-fill!");
+  int b = check_range(byte, 0, UINT8_MAX, "bytevector-fill!");
+  memset(bytevector_data(bv), b, uvector_length(bv));
+  return bv;
+}
+
+/* Endian-aware accessors. The fields are copied in and out with `memcpy' as
+   they need not be aligned. */
+#define INTEGER_ACCESSORS(T, bits, name, lisp_name)                     \
+  sexp bytevector_##name##_ref(sexp bv, sexp k, sexp endian) {          \
+    int i = check_offset(bv, k, sizeof(T), "bytevector-" lisp_name "-ref"); \
+    uint##bits##_t u;                                                   \
+    memcpy(&u, bytevector_data(bv) + i, sizeof(T));                     \
+    if (is_swapped(endian, "bytevector-" lisp_name "-ref"))             \
+      u = __builtin_bswap##bits(u);                                     \
+    return make_integer((T)u);                                          \
+  }                                                                     \
+  sexp bytevector_##name##_set(int argc, sexp *argv) {                  \
+    check_argc(argc, 4, 4, "bytevector-" lisp_name "-set!");            \
+    int i = check_offset(argv[0], argv[1], sizeof(T),                   \
+                         "bytevector-" lisp_name "-set!");              \
+    uint##bits##_t u = (T)check_range(argv[2], name##_MIN, name##_MAX,  \
+                                      "bytevector-" lisp_name "-set!"); \
+    if (is_swapped(argv[3], "bytevector-" lisp_name "-set!"))           \
+      u = __builtin_bswap##bits(u);                                     \
+    memcpy(bytevector_data(argv[0]) + i, &u, sizeof(T));                \
+    return argv[0];                                                     \
+  }
+
+/* The 64-bit fields hold what a fixnum does */
+#define u16_MIN 0
+#define u16_MAX UINT16_MAX
+#define s16_MIN INT16_MIN
+#define s16_MAX INT16_MAX
+#define u32_MIN 0
+#define u32_MAX UINT32_MAX
+#define s32_MIN INT32_MIN
+#define s32_MAX INT32_MAX
+#define s64_MIN FIXNUM_MIN
+#define s64_MAX FIXNUM_MAX
+
+INTEGER_ACCESSORS(uint16_t, 16, u16, "u16")
+INTEGER_ACCESSORS(int16_t, 16, s16, "s16")
+INTEGER_ACCESSORS(uint32_t, 32, u32, "u32")
+INTEGER_ACCESSORS(int32_t, 32, s32, "s32")
+INTEGER_ACCESSORS(int64_t, 64, s64, "s64")
+
+#define FLOAT_ACCESSORS(T, bits, name, lisp_name)                       \
+  sexp bytevector_##name##_ref(sexp bv, sexp k, sexp endian) {          \
+    int i = check_offset(bv, k, sizeof(T), "bytevector-" lisp_name "-ref"); \
+    union { uint##bits##_t u; T f; } x;                                 \
+    memcpy(&x.u, bytevector_data(bv) + i, sizeof(T));                   \
+    if (is_swapped(endian, "bytevector-" lisp_name "-ref"))             \
+      x.u = __builtin_bswap##bits(x.u);                                 \
+    return make_flonum(x.f);                                            \
+  }                                                                     \
+  sexp bytevector_##name##_set(int argc, sexp *argv) {                  \
+    check_argc(argc, 4, 4, "bytevector-" lisp_name "-set!");            \
+    int i = check_offset(argv[0], argv[1], sizeof(T),                   \
+                         "bytevector-" lisp_name "-set!");              \
+    union { uint##bits##_t u; T f; } x;                                 \
+    x.f = real_value(argv[2], "bytevector-" lisp_name "-set!");         \
+    if (is_swapped(argv[3], "bytevector-" lisp_name "-set!"))           \
+      x.u = __builtin_bswap##bits(x.u);                                 \
+    memcpy(bytevector_data(argv[0]) + i, &x.u, sizeof(T));              \
+    return argv[0];                                                     \
+  }
+
+FLOAT_ACCESSORS(float, 32, f32, "ieee-single")
+FLOAT_ACCESSORS(double, 64, f64, "ieee-double")
+
+/* Bulk I/O, straight between the buffer and the stream */
+/* Fills `bv' from `port', returns the number of bytes read or the EOF
+   object when there is none left */
+sexp read_bytes(sexp bv, sexp port) {
+  check_bytevector(bv, "read-bytes!");
+  if (!is_in_port(port))
+    wrong_argument(port, "read-bytes!");
+  size_t n = fread(bytevector_data(bv), 1, uvector_length(bv), in_port_stream(port));
+  if (n == 0 && uvector_length(bv) > 0)
+    return eof_object;
+  return make_fixnum(n);
+}
+
+sexp write_bytes(sexp bv, sexp port) {
+  check_bytevector(bv, "write-bytes");
+  if (!is_out_port(port))
+    wrong_argument(port, "write-bytes");
+  return make_fixnum(fwrite(bytevector_data(bv), 1, uvector_length(bv),
+                            out_port_stream(port)));
+}
@@ -0,0 +1,166 @@
+/*
+ * class.c
+ *
+ * Classes and generic functions with inline method caches
+ *
+ * Copyright (C) 2013-04-26 liutos <mat.liutos@gmail.com>
+ */
+#include <stdlib.h>
+
+#include "class.h"
+#include "hashtable.h"
+#include "object.h"
+#include "types.h"
+#include "write.h"
+
+/* The classes cached by a call site before it becomes megamorphic */
+#define CACHE_WAYS 4
+
+/*
+ * A class is the symbol which `type-of' returns, the name of its type for
+ * a record. A method of a superclass is inherited unless it is redefined.
+ *
+ * The cache of a call site is a vector of the epoch it is valid for, then
+ * the dispatch keys and methods found, at most CACHE_WAYS of them. Any
+ * change to the methods or the classes increases `dispatch_epoch', which
+ * empties every cache at its next use.
+ */
+int dispatch_epoch = 0;
+
+extern sexp type_of_proc(sexp);
+
+void init_class_parents(void) {
+  static char *classes[][2] = {
+    {"fixnum", "integer"},
+    {"bignum", "integer"},
+    {"integer", "number"},
+    {"flonum", "number"},
+    {"empty-list", "list"},
+    {"pair", "list"},
+  };
+  class_parents = make_table(HASH_EQ, 16);
+  for (int i = 0; i < sizeof(classes) / sizeof(classes[0]); i++)
+    hash_table_set(class_parents, S(classes[i][0]), S(classes[i][1]));
+}
+
+sexp class_parent(sexp class) {
+  return hash_table_ref(class_parents, class, S("object"));
+}
+
+/* Cheaper to find than the class, the objects of a class may have several
+   keys */
+sexp dispatch_key(sexp x) {
+  if (is_record(x)) return record_type(x);
+  /* The kind of a uvector is its class */
+  if (is_uvector(x)) return make_fixnum(-3 - uvector_kind(x));
+  if (is_pointer(x)) return make_fixnum(x->type);
+  if (is_fixnum(x)) return make_fixnum(-1);
+  if (is_char(x)) return make_fixnum(-2);
+  return x;
+}
+
+/* Method resolution */
+sexp find_method(sexp generic, sexp class) {
+  sexp top = S("object");
+  for (sexp c = class; ; c = class_parent(c)) {
+    sexp method = hash_table_ref(generic_methods(generic), c, false_object);
+    if (!is_false(method)) return method;
+    if (c == top) break;
+  }
+  port_format(scm_err_port, "%*: No method for the class %*\n",
+              generic_name(generic), class);
+  exit(1);
+}
+
+/* The method applied to `x', through the table of the methods found
+   before. This is the megamorphic path. */
+sexp generic_method(sexp generic, sexp x) {
+  if (generic_epoch(generic) != dispatch_epoch) {
+    generic_resolved(generic) = make_table(HASH_EQ, 8);
+    generic_epoch(generic) = dispatch_epoch;
+  }
+  sexp key = dispatch_key(x);
+  sexp method = hash_table_ref(generic_resolved(generic), key, false_object);
+  if (is_false(method)) {
+    method = find_method(generic, type_of_proc(x));
+    hash_table_set(generic_resolved(generic), key, method);
+  }
+  return method;
+}
+
+/* Inline caches */
+sexp make_method_cache(void) {
+  sexp cache = make_vector(1 + 2 * CACHE_WAYS);
+  vector_push(make_fixnum(-1), cache);
+  return cache;
+}
+
+sexp cached_method(sexp generic, sexp cache, sexp x) {
+  sexp key = dispatch_key(x);
+  if (vector_data_at(cache, 0) == make_fixnum(dispatch_epoch)) {
+    for (int i = 1; i < vector_pos(cache); i += 2)
+      if (vector_data_at(cache, i) == key)
+        return vector_data_at(cache, i + 1);
+  } else {
+    vector_data_at(cache, 0) = make_fixnum(dispatch_epoch);
+    vector_pos(cache) = 1;
+  }
+  sexp method = generic_method(generic, x);
+  if (vector_pos(cache) < vector_length(cache)) {
+    vector_push(key, cache);
+    vector_push(method, cache);
+  }
+  return method;
+}
+
+/* Checkers */
+void check_class(sexp class, char *op) {
+  if (is_symbol(class)) return;
+  port_format(scm_err_port, "%s: Wrong type argument %*\n", make_string(op), class);
+  exit(1);
+}
+
+/* Primitives */
+sexp add_method_proc(sexp generic, sexp class, sexp method) {
+  if (!is_generic(generic) ||
+      !(is_primitive(method) || is_compiled_proc(method))) {
+    port_format(scm_err_port, "add-method!: Wrong type argument %*\n",
+                is_generic(generic) ? method: generic);
+    exit(1);
+  }
+  check_class(class, "add-method!");
+  hash_table_set(generic_methods(generic), class, method);
+  dispatch_epoch++;
+  return generic;
+}
+
+sexp set_class_parent_proc(sexp class, sexp parent) {
+  check_class(class, "set-class-parent!");
+  check_class(parent, "set-class-parent!");
+  sexp top = S("object");
+  for (sexp c = parent; ; c = class_parent(c)) {
+    if (c == class) {
+      port_format(scm_err_port, "set-class-parent!: Circular class %*\n", class);
+      exit(1);
+    }
+    if (c == top) break;
+  }
+  hash_table_set(class_parents, class, parent);
+  dispatch_epoch++;
+  return parent;
+}
+
+sexp class_parent_proc(sexp class) {
+  check_class(class, "class-parent");
+  return class == S("object") ? false_object: class_parent(class);
+}
+
+/* The method for `class' found through the classes above it, uncached */
+sexp find_method_proc(sexp generic, sexp class) {
+  if (!is_generic(generic)) {
+    port_format(scm_err_port, "find-method: Wrong type argument %*\n", generic);
+    exit(1);
+  }
+  check_class(class, "find-method");
+  return find_method(generic, class);
+}
@@ -10,24 +10,29 @@
 #include <stdarg.h>
 #include <stdlib.h>
 
+#include "class.h"
 #include "compiler.h"
 #include "eval.h"
+#include "hashtable.h"
 #include "object.h"
+#include "register.h"
 #include "types.h"
 #include "vm.h"
+#include "write.h"
 
 #define BUFFER_SIZE 10
 
 #define seq(...) sequenzie(__VA_ARGS__, NULL)
 #define gen(...) generate_code(__VA_ARGS__, NULL)
-#define gen_args(x) gen("ARGS", x)
-#define gen_argsdot(x) gen("ARGSD", x)
+#define gen_args(x, size) gen("ARGS", x, size)
+#define gen_argsdot(x, size) gen("ARGSD", x, size)
 #define gen_call(x) gen("CALL", x)
 #define gen_callj(x) gen("CALLJ", x)
+#define gen_scallj(x) gen("SCALLJ", x)
 #define gen_call0(x) gen("CALL0", x)
 #define gen_const(x) gen("CONST", x)
 #define gen_fjump(x) gen("FJUMP", x)
-#define gen_fn(x) gen("FN", x)
+#define gen_fn(x, n) gen("FN", x, n)
 #define gen_gset(x) gen("GSET", x)
 #define gen_gvar(x) gen("GVAR", x)
 #define gen_jump(x) gen("JUMP", x)
@@ -38,6 +43,10 @@
 #define gen_prim(x) gen("PRIM", x)
 #define gen_return() gen("RETURN")
 #define gen_save(k) gen("SAVE", k)
+#define gen_catch(k) gen("CATCH", k)
+#define gen_box(j) gen("LBOX", j)
+#define gen_bset(i, j) gen("BSET", i, j)
+#define gen_bvar(i, j) gen("BVAR", i, j)
 
 extern sexp make_lambda_form(sexp, sexp);
 
@@ -47,6 +56,12 @@ int is_variable_found(sexp var, sexp env, int *i, int *j) {
   return search_binding_index(var, env, i, j);
 }
 
+/* Returns the slot of the compile-time frame, which is a box if the variable is boxed */
+sexp variable_slot(sexp env, int i, int j) {
+  for (; i > 0; i--) env = frame_outer(env);
+  return frame_slot(env, j);
+}
+
 lisp_object_t va_list2pair(va_list ap) {
   lisp_object_t o = va_arg(ap, lisp_object_t);
   if (o)
@@ -94,12 +109,25 @@ lisp_object_t sequenzie_aux(va_list ap) {
     return nconc_pair(e, sequenzie_aux(ap));
 }
 
+/* Returns the instruction accessing the slot `j' of the `i'-th frame. When
+   the innermost frame lives on the VM stack, its slots are accessed by
+   `stack_op' and the frames on the heap start from the closure. */
+sexp gen_access(char *stack_op, char *op, int i, int j, sexp env) {
+  if (is_frame(env) && frame_on_stack(env)) {
+    if (i == 0) return gen(stack_op, make_fixnum(j));
+    i--;
+  }
+  return gen(op, make_fixnum(i), make_fixnum(j));
+}
+
 sexp gen_var(sexp x, sexp env) {
   int i, j;
   if (!is_variable_found(x, env, &i, &j))
     return gen_gvar(x);
+  else if (is_box(variable_slot(env, i, j)))
+    return gen_access("SBVAR", "BVAR", i, j, env);
   else
-    return gen_lvar(make_fixnum(i), make_fixnum(j));
+    return gen_access("SVAR", "LVAR", i, j, env);
 }
 
 /* Concatenates a series of list of instructions */
@@ -109,10 +137,11 @@ lisp_object_t sequenzie(lisp_object_t pair, ...) {
   return nconc_pair(pair, sequenzie_aux(ap));
 }
 
+/* The size of the frame is filled in after the body is scanned */
 sexp gen_args_ins(sexp pars, int n) {
 tail_loop:
-  if (is_null(pars)) return gen_args(make_fixnum(n));
-  if (is_symbol(pars)) return gen_argsdot(make_fixnum(n));
+  if (is_null(pars)) return gen_args(make_fixnum(n), make_fixnum(n));
+  if (is_symbol(pars)) return gen_argsdot(make_fixnum(n), make_fixnum(n + 1));
   if (is_pair(pars) && is_symbol(pair_car(pars))) {
     pars = pair_cdr(pars);
     n++;
@@ -122,8 +151,131 @@ tail_loop:
   exit(1);
 }
 
+/* Returns a new list of `vars' followed by `var' if it is not in `vars' */
+sexp adjoin_var(sexp vars, sexp var) {
+  if (is_null(vars)) return make_list1(var);
+  if (pair_car(vars) == var) return vars;
+  return make_pair(pair_car(vars), adjoin_var(pair_cdr(vars), var));
+}
+
+/* Appends the variables defined in a body to `vars' */
+sexp internal_definitions(sexp body, sexp vars) {
+  for (; is_pair(body); body = pair_cdr(body)) {
+    sexp form = pair_car(body);
+    if (is_begin_form(form))
+      vars = internal_definitions(begin_actions(form), vars);
+    else if (is_define_form(form))
+      vars = adjoin_var(vars, definition_variable(form));
+  }
+  return vars;
+}
+
+int is_member(sexp var, sexp vars) {
+  for (; is_pair(vars); vars = pair_cdr(vars))
+    if (pair_car(vars) == var) return yes;
+  return no;
+}
+
+/* Collects the symbols referenced in `form', except those in quoted data */
+sexp referenced_symbols(sexp form, sexp syms) {
+  if (is_symbol(form)) return adjoin_var(syms, form);
+  if (!is_pair(form) || is_quote_form(form)) return syms;
+  for (; is_pair(form); form = pair_cdr(form))
+    syms = referenced_symbols(pair_car(form), syms);
+  return syms;
+}
+
+/* Collects the symbols referenced in the lambdas nested in `form' */
+sexp captured_symbols(sexp form, sexp syms) {
+  if (!is_pair(form) || is_quote_form(form)) return syms;
+  if (is_lambda_form(form))
+    return referenced_symbols(lambda_body(form), syms);
+  if (is_define_form(form))
+    return captured_symbols(definition_value(form), syms);
+  for (; is_pair(form); form = pair_cdr(form))
+    syms = captured_symbols(pair_car(form), syms);
+  return syms;
+}
+
+/* Collects the variables assigned by `set!' or `define' in `form' */
+sexp assigned_variables(sexp form, sexp vars) {
+  if (!is_pair(form) || is_quote_form(form)) return vars;
+  if (is_assignment_form(form))
+    vars = adjoin_var(vars, assignment_variable(form));
+  else if (is_define_form(form))
+    vars = adjoin_var(vars, definition_variable(form));
+  for (; is_pair(form); form = pair_cdr(form))
+    vars = assigned_variables(pair_car(form), vars);
+  return vars;
+}
+
+/* The lexical variables of `env' referenced by a lambda, except its own `vars' */
+sexp free_variables(sexp body, sexp vars, sexp env) {
+  sexp free = EOL;
+  int i, j;
+  for (sexp syms = referenced_symbols(body, EOL); is_pair(syms); syms = pair_cdr(syms)) {
+    sexp var = pair_car(syms);
+    if (!is_member(var, vars) && is_variable_found(var, env, &i, &j))
+      free = adjoin_var(free, var);
+  }
+  return free;
+}
+
+/* The compile-time frame of the values captured by a flat closure. The
+   slot of a variable boxed in `env' is the same box. */
+sexp make_closure_env(sexp captured, sexp env) {
+  if (is_null(captured)) return global_environment(env);
+  sexp closure = make_frame(pair_length(captured), global_environment(env));
+  int i, j;
+  for (int k = 0; is_pair(captured); captured = pair_cdr(captured), k++) {
+    is_variable_found(pair_car(captured), env, &i, &j);
+    frame_slot(closure, k) = variable_slot(env, i, j);
+  }
+  return closure;
+}
+
+/* Boxes the variables of frame `env' which are assigned and captured */
+sexp gen_boxes(sexp body, sexp env) {
+  sexp assigned = assigned_variables(body, EOL);
+  sexp captured = captured_symbols(body, EOL);
+  sexp code = EOL;
+  for (int j = 0; j < frame_size(env); j++) {
+    sexp var = frame_slot(env, j);
+    if (is_member(var, assigned) && is_member(var, captured)) {
+      frame_slot(env, j) = make_box(var);
+      code = seq(code, frame_on_stack(env) ? gen("SBOX", make_fixnum(j)):
+                 gen_box(make_fixnum(j)));
+    }
+  }
+  return code;
+}
+
+/* Pushes the values captured by the closure `proc', the first one on top */
+sexp gen_captures(sexp closure, int k, sexp env) {
+  if (!is_frame(closure) || k == frame_size(closure)) return EOL;
+  sexp var = frame_slot(closure, k);
+  int i, j;
+  is_variable_found(is_box(var) ? box_value(var): var, env, &i, &j);
+  return seq(gen_captures(closure, k + 1, env),
+             gen_access("SVAR", "LVAR", i, j, env));
+}
+
+/* Returns true if `form' makes a macro out of nested lambdas. A macro
+   captures the frame of the procedure creating it, so such a frame must be
+   on the heap. Since flat closures copy the values they capture, the other
+   frames never escape and live on the VM stack. */
+int is_macro_created(sexp form) {
+  if (!is_pair(form) || is_quote_form(form) || is_lambda_form(form))
+    return no;
+  if (is_macro_form(form)) return yes;
+  for (; is_pair(form); form = pair_cdr(form))
+    if (is_macro_created(pair_car(form))) return yes;
+  return no;
+}
+
 sexp make_proper_list(sexp dotable_list) {
   if (is_null(dotable_list)) return EOL;
+  if (is_symbol(dotable_list)) return make_list1(dotable_list);
   sexp head = dotable_list;
   while (is_pair(pair_cdr(dotable_list)))
     dotable_list = pair_cdr(dotable_list);
@@ -134,7 +286,7 @@ sexp make_proper_list(sexp dotable_list) {
 
 sexp gen_primN(sexp op) {
   static char buffer[BUFFER_SIZE];
-  sprintf(buffer, "PRIM%d", fixnum_value(primitive_arity(op)));
+  sprintf(buffer, "PRIM%d", (int)fixnum_value(primitive_arity(op)));
   return gen(buffer);
 }
 
@@ -147,10 +299,15 @@ lisp_object_t compile_constant(lisp_object_t val, int is_val, int is_more) {
 
 lisp_object_t compile_set(lisp_object_t var, lisp_object_t environment) {
   int i, j;
-  if (!is_variable_found(var, environment, &i, &j))
+  if (!is_variable_found(var, environment, &i, &j)) {
+    /* A record procedure assigned is not opened any more */
+    hash_table_delete(open_procedures, var);
     return gen_gset(var);
+  }
+  else if (is_box(variable_slot(environment, i, j)))
+    return gen_access("SBSET", "BSET", i, j, environment);
   else
-    return gen_lset(make_fixnum(i), make_fixnum(j));
+    return gen_access("SSET", "LSET", i, j, environment);
 }
 
 sexp compile_begin(sexp actions, sexp env, int is_val, int is_more) {
@@ -158,10 +315,11 @@ sexp compile_begin(sexp actions, sexp env, int is_val, int is_more) {
     return compile_constant(EOL, is_val, is_more);
   if (is_null(pair_cdr(actions)))
     return compile_object(pair_car(actions), env, is_val, is_more);
-  else
-    return seq(compile_object(pair_car(actions), env, no, yes),
-               /* gen_pop(), */
-               compile_begin(pair_cdr(actions), env, is_val, is_more));
+  /* In order, a form may depend on the definitions compiled before */
+  sexp first = compile_object(pair_car(actions), env, no, yes);
+  return seq(first,
+             /* gen_pop(), */
+             compile_begin(pair_cdr(actions), env, is_val, is_more));
 }
 
 sexp compile_lambda(sexp args, sexp body, sexp env) {
@@ -174,10 +332,24 @@ sexp compile_lambda(sexp args, sexp body, sexp env) {
    * after parsing */
   sexp arg_ins = gen_args_ins(args, 0);
   sexp pars = make_proper_list(args);
-
-  sexp new_env = extend_environment(pars, EOL, env);
-  sexp code = seq(arg_ins, compile_begin(body, new_env, yes, no));
-  return make_compiled_proc(args, code, new_env);
+  /* Internal definitions live in the frame after the parameters */
+  sexp vars = internal_definitions(body, pars);
+  pair_caddr(pair_car(arg_ins)) = make_fixnum(pair_length(vars));
+
+  /* A flat closure keeps only the variables referenced in the body */
+  sexp closure = make_closure_env(free_variables(body, vars, env), env);
+  sexp new_env = extend_frame(vars, closure);
+  if (!is_macro_created(body)) {
+    frame_on_stack(new_env) = yes;
+    sexp ins = pair_car(arg_ins);
+    pair_car(ins) = S(pair_car(ins) == S("ARGS") ? "SARGS": "SARGSD");
+  }
+  sexp boxes = gen_boxes(body, new_env);
+  sexp code = seq(arg_ins, boxes, compile_begin(body, new_env, yes, no));
+  sexp proc = make_compiled_proc(args, code, new_env);
+  if (is_register_tier)
+    use_register_tier(proc);
+  return proc;
 }
 
 sexp compile_macro(sexp args, sexp body, sexp env) {
@@ -185,8 +357,10 @@ sexp compile_macro(sexp args, sexp body, sexp env) {
    * after parsing */
   sexp arg_ins = gen_args_ins(args, 0);
   sexp pars = make_proper_list(args);
+  sexp vars = internal_definitions(body, pars);
+  pair_caddr(pair_car(arg_ins)) = make_fixnum(pair_length(vars));
 
-  sexp new_env = extend_environment(pars, EOL, env);
+  sexp new_env = extend_frame(vars, env);
   sexp code = seq(arg_ins, compile_begin(body, new_env, yes, no));
   return make_macro_procedure(args, code, new_env);
 }
@@ -250,6 +424,79 @@ sexp compile_if(sexp object, sexp env, int is_val, int is_more) {
              (is_more ? make_list1(l2): EOL));
 }
 
+/* Returns the unboxed instruction of `x' if it applies a flonum primitive */
+char *float_instruction(sexp x, sexp env) {
+  static char *names[] = {"FADD", "FSUB", "FMUL", "FDIV"};
+  int i, j;
+  if (!is_application_form(x)) return NULL;
+  sexp operator = application_operator(x);
+  if (!is_symbol(operator) || is_variable_found(operator, env, &i, &j) ||
+      pair_length(application_operands(x)) != 2)
+    return NULL;
+  sexp op = get_variable_value(operator, env);
+  if (!is_primitive(op) || !is_code_exist(op)) return NULL;
+  for (i = 0; i < sizeof(names) / sizeof(char *); i++)
+    if (strcmp(primitive_opcode(op), names[i]) == 0) return names[i];
+  return NULL;
+}
+
+/* A nested flonum application is unboxed if the float stack has room for
+   its two operands above the `depth' values below */
+int is_float_node(sexp x, sexp env, int depth) {
+  return depth + 2 <= FLOAT_STACK_SIZE && float_instruction(x, env) != NULL;
+}
+
+/* Pushes the operands which are not unboxed, the first one on top */
+sexp compile_float_leaves(sexp x, sexp env, int depth) {
+  if (!is_float_node(x, env, depth))
+    return compile_object(x, env, yes, yes);
+  sexp operands = application_operands(x);
+  return seq(compile_float_leaves(pair_cadr(operands), env, depth + 1),
+             compile_float_leaves(pair_car(operands), env, depth));
+}
+
+/* Computes on the float stack, loading the operands pushed before */
+sexp gen_float_ops(sexp x, sexp env, int depth) {
+  if (!is_float_node(x, env, depth)) return gen("FLOAD");
+  sexp operands = application_operands(x);
+  return seq(gen_float_ops(pair_car(operands), env, depth),
+             gen_float_ops(pair_cadr(operands), env, depth + 1),
+             gen(float_instruction(x, env)));
+}
+
+/* A tree of flonum primitives is computed on unboxed doubles, only its
+   value is boxed. The operands are all evaluated before, so no call
+   happens while the float stack is in use. */
+sexp compile_float(sexp object, sexp env, int is_val, int is_more) {
+  return seq(compile_float_leaves(object, env, 0),
+             gen_float_ops(object, env, 0),
+             gen("FBOX"),
+             (is_val ? EOL: gen_pop()),
+             (is_more ? EOL: gen_return()));
+}
+
+/* The operands of a record constructor in the order of the fields of
+   `type', a field which is not a parameter is false */
+sexp field_operands(sexp fields, sexp params, sexp operands) {
+  if (is_null(fields)) return EOL;
+  sexp x = false_object;
+  for (sexp p = params, o = operands; is_pair(p); p = pair_cdr(p), o = pair_cdr(o))
+    if (pair_car(p) == pair_car(fields)) x = pair_car(o);
+  return make_pair(x, field_operands(pair_cdr(fields), params, operands));
+}
+
+/* Opens a call to the procedure `proc' of a record type, which is its
+   instruction and parameters */
+sexp compile_record_application(sexp proc, sexp operands, sexp env, int is_val, int is_more) {
+  sexp ins = pair_car(proc);
+  if (pair_car(ins) == S("RECMAKE"))
+    operands = field_operands(record_type_fields(second(ins)), pair_cdr(proc), operands);
+  return seq(compile_arguments(operands, env),
+             make_list1(ins),
+             (is_val ? EOL: gen_pop()),
+             (is_more ? EOL: gen_return()));
+}
+
 sexp compile_application(sexp object, sexp env, int is_val, int is_more) {
   /* int length = pair_length(application_operands(object)); */
   /* return seq(compile_arguments(application_operands(object), env), */
@@ -259,19 +506,29 @@ sexp compile_application(sexp object, sexp env, int is_val, int is_more) {
   sexp operands = application_operands(object);
   int len = pair_length(operands);
   /* optimize: side-effect free primitive */
-  if (is_symbol(operator)) {
+  int i, j;
+  sexp generic = false_object;
+  if (is_symbol(operator) && !is_variable_found(operator, env, &i, &j)) {
+    sexp proc = hash_table_ref(open_procedures, operator, false_object);
+    if (is_pair(proc) && len == pair_length(pair_cdr(proc)))
+      return compile_record_application(proc, operands, env, is_val, is_more);
+    if (is_generic(proc) && len > 0)
+      generic = proc;
     sexp op = get_variable_value(operator, env);
     if (is_primitive(op)) {
+      int arity = fixnum_value(primitive_arity(op));
       if (!is_val && primitive_se(op) == no)
         return compile_begin(operands, env, no, is_more);
-      else if (is_code_exist(op))
+      else if (float_instruction(object, env))
+        return compile_float(object, env, is_val, is_more);
+      else if (is_code_exist(op) && len == arity)
         return seq(compile_arguments(operands, env),
                    /* compile_object(operator, env, yes, yes), */
                    /* gen_prim(make_fixnum(len)), */
                    gen(primitive_opcode(op)),
                    (is_val ? EOL: gen_pop()),
                    (is_more ? EOL: gen_return()));
-      else if (is_arity_exist(op))
+      else if (is_arity_exist(op) && len == arity)
         return seq(compile_arguments(operands, env),
                    compile_object(operator, env, yes, yes),
                    gen_primN(op),
@@ -294,18 +551,93 @@ sexp compile_application(sexp object, sexp env, int is_val, int is_more) {
       /*            (is_more ? EOL: gen_return())); */
   }
 
+  /* A generic function is dispatched by the cache of the call site */
+  sexp fn = is_generic(generic) ?
+      gen("GMETHOD", generic, make_method_cache()):
+      compile_object(operator, env, yes, yes);
   if (is_more) {
     sexp k = make_label();
     return seq(gen_save(k),
                compile_arguments(operands, env),
-               compile_object(operator, env, yes, yes),
+               fn,
                gen_callj(make_fixnum(len)),
                make_list1(k),
                (is_val ? EOL: gen_pop()));
   } else
     return seq(compile_arguments(operands, env),
-               compile_object(operator, env, yes, yes),
-               gen_callj(make_fixnum(len)));
+               fn,
+               /* A tail call also discards the frame on the VM stack */
+               (is_frame(env) && frame_on_stack(env) ?
+                gen_scallj(make_fixnum(len)): gen_callj(make_fixnum(len))));
+}
+
+/* The body runs with a catch frame of the tag on the stack. A throw to the tag jumps to the label `k' with the thrown value. */
+sexp compile_catch(sexp object, sexp env, int is_val, int is_more) {
+  sexp k = make_label();
+  return seq(compile_object(catch_tag(object), env, yes, yes),
+             gen_catch(k),
+             compile_begin(catch_body(object), env, yes, yes),
+             gen("UNCATCH"),
+             make_list1(k),
+             (is_val ? EOL: gen_pop()),
+             (is_more ? EOL: gen_return()));
+}
+
+/* Defines the global `name' as a procedure of a record type. A call to it
+   is opened as the instruction of `code' when the arguments match `params'. */
+sexp gen_record_procedure(sexp name, sexp params, sexp code, sexp env) {
+  hash_table_set(open_procedures, name, make_pair(pair_car(code), params));
+  sexp body = make_list1(make_pair(name, params));
+  return seq(compile_object(make_lambda_form(params, body), env, yes, yes),
+             gen_gset(name),
+             gen_pop());
+}
+
+void check_record_field(sexp field, sexp fields) {
+  if (is_member(field, fields)) return;
+  port_format(scm_err_port, "define-record-type: Unknown field %*\n", field);
+  exit(1);
+}
+
+/* The type descriptor is created at compile time, so every access is
+   compiled with the type and the slot index as immediate arguments */
+sexp compile_record_type(sexp object, sexp env, int is_val, int is_more) {
+  sexp name = record_type_form_name(object);
+  sexp constructor = record_constructor_spec(object);
+  sexp fields = EOL;
+  for (sexp l = record_field_specs(object); is_pair(l); l = pair_cdr(l))
+    fields = adjoin_var(fields, pair_caar(l));
+  sexp type = make_record_type(name, fields);
+  sexp code = seq(gen_const(type), gen_gset(name), gen_pop());
+
+  for (sexp l = pair_cdr(constructor); is_pair(l); l = pair_cdr(l))
+    check_record_field(pair_car(l), fields);
+  code = seq(code, gen_record_procedure(pair_car(constructor), pair_cdr(constructor),
+                                        gen("RECMAKE", type), env));
+  sexp object_par = LIST(S("object"));
+  code = seq(code, gen_record_procedure(record_predicate_name(object), object_par,
+                                        gen("RECP", type), env));
+  int i = 0;
+  for (sexp l = record_field_specs(object); is_pair(l); l = pair_cdr(l), i++) {
+    sexp spec = pair_cdr(pair_car(l));
+    if (is_pair(spec))
+      code = seq(code, gen_record_procedure(pair_car(spec), object_par,
+                                            gen("RECREF", type, make_fixnum(i)), env));
+    if (is_pair(spec) && is_pair(pair_cdr(spec)))
+      code = seq(code, gen_record_procedure(pair_cadr(spec), LIST(S("object"), S("value")),
+                                            gen("RECSET", type, make_fixnum(i)), env));
+  }
+  return seq(code, compile_constant(name, is_val, is_more));
+}
+
+/* The generic function is created at compile time, so that its call sites
+   are compiled with a method cache */
+sexp compile_generic(sexp object, sexp env, int is_val, int is_more) {
+  sexp name = generic_form_name(object);
+  sexp generic = make_generic(name);
+  hash_table_set(open_procedures, name, generic);
+  return seq(gen_const(generic), gen_gset(name), gen_pop(),
+             compile_constant(name, is_val, is_more));
 }
 
 /* Generate a list of instructions based-on a stack-based virtual machine. */
@@ -332,7 +664,11 @@ sexp compile_object(sexp object, sexp env, int is_val, int is_more) {
     sexp args = lambda_parameters(object);
     sexp body = lambda_body(object);
     sexp code = compile_lambda(args, body, env);
-    return seq(gen_fn(code), is_more ? EOL: gen_return());
+    sexp closure = frame_outer(compiled_proc_env(code));
+    int n = is_frame(closure) ? frame_size(closure): 0;
+    return seq(gen_captures(closure, 0, env),
+               gen_fn(code, make_fixnum(n)),
+               is_more ? EOL: gen_return());
   }
   /* macro */
   if (is_macro_form(object) && is_val) {
@@ -341,6 +677,18 @@ sexp compile_object(sexp object, sexp env, int is_val, int is_more) {
     sexp code = compile_macro(args, body, env);
     return seq(gen_macro(code), is_more ? EOL: gen_return());
   }
+  /* catch */
+  if (is_catch_form(object))
+    return compile_catch(object, env, is_val, is_more);
+  /* define-record-type */
+  if (is_record_type_form(object))
+    return compile_record_type(object, env, is_val, is_more);
+  /* define-generic */
+  if (is_generic_form(object))
+    return compile_generic(object, env, is_val, is_more);
+  /* define-method */
+  if (is_method_form(object))
+    return compile_object(method2add(object), env, is_val, is_more);
   if (is_application_form(object))
     return compile_application(object, env, is_val, is_more);
   return compile_constant(object, is_val, is_more);
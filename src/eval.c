@@ -8,8 +8,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "compiler.h"
 #include "object.h"
 #include "types.h"
+#include "vm.h"
 #include "write.h"
 
 #define DEFACC(fn, acc)                         \
@@ -221,6 +223,47 @@ DEFORM(is_macro_form, "macro")
 DEFACC(macro_parameters, pair_cadr)
 DEFACC(macro_body, pair_cddr)
 
+/* catch */
+
+DEFORM(is_catch_form, "catch")
+DEFACC(catch_tag, pair_cadr)
+DEFACC(catch_body, pair_cddr)
+
+/* define-record-type */
+
+DEFORM(is_record_type_form, "define-record-type")
+DEFACC(record_type_form_name, pair_cadr)
+DEFACC(record_constructor_spec, pair_caddr)
+DEFACC(record_predicate_name, pair_cadddr)
+
+sexp record_field_specs(sexp form) {
+  return pair_cdr(pair_cdddr(form));
+}
+
+/* define-generic */
+
+DEFORM(is_generic_form, "define-generic")
+DEFACC(generic_form_name, pair_cadr)
+
+/* define-method */
+
+DEFORM(is_method_form, "define-method")
+
+/* The class of the first parameter is written as (self class), which is
+   `object' if omitted */
+sexp method2add(sexp form) {
+  sexp name = pair_car(pair_cadr(form));
+  sexp pars = pair_cdr(pair_cadr(form));
+  sexp self = pair_car(pars);
+  sexp class = S("object");
+  if (is_pair(self)) {
+    class = pair_cadr(self);
+    self = pair_car(self);
+  }
+  sexp lambda = make_lambda_form(make_pair(self, pair_cdr(pars)), pair_cddr(form));
+  return LIST(S("add-method!"), name, LIST(S("quote"), class), lambda);
+}
+
 /* evaluators */
 sexp eval_begin(sexp actions, sexp env) {
   if (is_null(actions)) return EOL;
@@ -232,8 +275,13 @@ sexp eval_begin(sexp actions, sexp env) {
 }
 
 sexp eval_application(sexp operator, sexp operands) {
-  if (is_primitive(operator))
-    return (primitive_C_proc(operator))(operands);
+  if (is_primitive(operator)) {
+    int argc = pair_length(operands);
+    sexp argv[argc + 1];
+    for (int i = 0; i < argc; i++, operands = pair_cdr(operands))
+      argv[i] = pair_car(operands);
+    return call_primitive(operator, argc, argv);
+  }
   if (is_compound(operator)) {
     sexp body = compound_proc_body(operator);
     sexp vars = compound_proc_parameters(operator);
@@ -242,6 +290,13 @@ sexp eval_application(sexp operator, sexp operands) {
     sexp env = extend_environment(vars, operands, def_env);
     return eval_object(object, env);
   }
+  if (is_compiled_proc(operator) || is_generic(operator)) {
+    int argc = pair_length(operands);
+    sexp argv[argc + 1];
+    for (int i = 0; i < argc; i++, operands = pair_cdr(operands))
+      argv[i] = pair_car(operands);
+    return vm_apply(operator, argc, argv);
+  }
   fprintf(stderr, "Unknown operator type %d\n", operator->type);
   exit(1);
 }
@@ -322,6 +377,13 @@ tail_loop:
     }
     return eval_object(pair_car(tests), environment);
   }
+  /* The forms implemented by the compiler alone run in the VM */
+  if (is_catch_form(object) || is_record_type_form(object) ||
+      is_generic_form(object) || is_method_form(object)) {
+    sexp code = compile_object(object, environment, yes, yes);
+    sexp proc = make_compiled_proc(EOL, code, environment);
+    return run_compiled_code(proc, environment, vm_stack);
+  }
   if (is_macro_form(object)) {
     sexp pars = macro_parameters(object);
     sexp body = macro_body(object);
@@ -331,7 +393,8 @@ tail_loop:
     sexp operator = application_operator(object);
     sexp operands = application_operands(object);
     operator = eval_object(operator, environment);
-    if (!is_function(operator) && !is_macro(operator)) {
+    if (!is_function(operator) && !is_macro(operator) &&
+        !is_compiled_proc(operator) && !is_generic(operator)) {
       fprintf(stderr, "Illegal functional object ");
       write_object(operator, make_file_out_port(stderr));
       fprintf(stderr, " from ");
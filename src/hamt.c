@@ -0,0 +1,327 @@
+/*
+ * hamt.c
+ *
+ * Persistent hash maps as hash array mapped tries, keyed by equal?
+ *
+ * Copyright (C) 2013-04-25 liutos <mat.liutos@gmail.com>
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hamt.h"
+#include "hashtable.h"
+#include "object.h"
+#include "types.h"
+#include "write.h"
+
+/* Every level of the trie consumes this many bits of the hash */
+#define LEVEL_BITS 5
+#define LEVEL_MASK 0x1f
+#define HASH_BITS (sizeof(uintptr_t) * 8)
+
+/* A node whose `shift' used up the hash holds colliding keys */
+#define is_collision(shift) ((shift) >= HASH_BITS)
+
+uint32_t hash_bit(uintptr_t hash, int shift) {
+  return 1u << ((hash >> shift) & LEVEL_MASK);
+}
+
+/* The position of the child `bit' among those present in `node' */
+int child_index(sexp node, uint32_t bit) {
+  return __builtin_popcount(node_bitmap(node) & (bit - 1));
+}
+
+/* Path copying. A node created by the transient owning `edit' is mutated in
+   place, any other node is copied before a change. */
+int is_editable(sexp node, sexp edit) {
+  return edit != NULL && node_edit(node) == edit;
+}
+
+sexp editable_node(sexp node, sexp edit) {
+  if (is_editable(node, edit)) return node;
+  sexp copy = make_hamt_node(edit, node_bitmap(node), node_length(node));
+  memcpy(node_array(copy), node_array(node), 2 * node_length(node) * sizeof(sexp));
+  return copy;
+}
+
+sexp set_child(sexp node, sexp edit, int i, sexp key, sexp value) {
+  node = editable_node(node, edit);
+  node_array(node)[2 * i] = key;
+  node_array(node)[2 * i + 1] = value;
+  return node;
+}
+
+/* Adds `key' and `value' as the child `bit' at position `i' */
+sexp insert_child(sexp node, sexp edit, int i, uint32_t bit, sexp key, sexp value) {
+  int length = node_length(node);
+  sexp n = node;
+  if (is_editable(node, edit)) {
+    node_array(n) = realloc(node_array(n), 2 * (length + 1) * sizeof(sexp));
+    memmove(node_array(n) + 2 * i + 2, node_array(n) + 2 * i,
+            2 * (length - i) * sizeof(sexp));
+  } else {
+    n = make_hamt_node(edit, node_bitmap(node), length + 1);
+    memcpy(node_array(n), node_array(node), 2 * i * sizeof(sexp));
+    memcpy(node_array(n) + 2 * i + 2, node_array(node) + 2 * i,
+           2 * (length - i) * sizeof(sexp));
+  }
+  node_array(n)[2 * i] = key;
+  node_array(n)[2 * i + 1] = value;
+  node_bitmap(n) |= bit;
+  node_length(n) = length + 1;
+  return n;
+}
+
+/* Removes the child `bit' at position `i', NULL if none is left */
+sexp remove_child(sexp node, sexp edit, int i, uint32_t bit) {
+  int length = node_length(node);
+  if (length == 1) return NULL;
+  sexp n = node;
+  if (is_editable(node, edit))
+    memmove(node_array(n) + 2 * i, node_array(n) + 2 * i + 2,
+            2 * (length - i - 1) * sizeof(sexp));
+  else {
+    n = make_hamt_node(edit, node_bitmap(node), length - 1);
+    memcpy(node_array(n), node_array(node), 2 * i * sizeof(sexp));
+    memcpy(node_array(n) + 2 * i, node_array(node) + 2 * i + 2,
+           2 * (length - i - 1) * sizeof(sexp));
+  }
+  node_bitmap(n) &= ~bit;
+  node_length(n) = length - 1;
+  return n;
+}
+
+/* A subtree at `shift' of two keys whose hashes agree on the upper levels */
+sexp make_pair_node(sexp edit, int shift, sexp k1, uintptr_t h1, sexp v1,
+                    sexp k2, uintptr_t h2, sexp v2) {
+  if (is_collision(shift)) {
+    sexp node = make_hamt_node(edit, 0, 2);
+    node_array(node)[0] = k1;
+    node_array(node)[1] = v1;
+    node_array(node)[2] = k2;
+    node_array(node)[3] = v2;
+    return node;
+  }
+  uint32_t b1 = hash_bit(h1, shift), b2 = hash_bit(h2, shift);
+  if (b1 == b2) {
+    sexp sub = make_pair_node(edit, shift + LEVEL_BITS, k1, h1, v1, k2, h2, v2);
+    sexp node = make_hamt_node(edit, b1, 1);
+    node_array(node)[1] = sub;
+    return node;
+  }
+  sexp node = make_hamt_node(edit, b1 | b2, 2);
+  int i = b1 < b2 ? 0: 1;
+  node_array(node)[2 * i] = k1;
+  node_array(node)[2 * i + 1] = v1;
+  node_array(node)[2 - 2 * i] = k2;
+  node_array(node)[3 - 2 * i] = v2;
+  return node;
+}
+
+/* Trie operations */
+/* Returns the value of `key', or NULL */
+sexp node_find(sexp node, uintptr_t hash, sexp key) {
+  for (int shift = 0; node != NULL; shift += LEVEL_BITS) {
+    if (is_collision(shift)) {
+      for (int i = 0; i < node_length(node); i++)
+        if (is_equal(node_array(node)[2 * i], key))
+          return node_array(node)[2 * i + 1];
+      return NULL;
+    }
+    uint32_t bit = hash_bit(hash, shift);
+    if (!(node_bitmap(node) & bit)) return NULL;
+    int i = child_index(node, bit);
+    sexp k = node_array(node)[2 * i];
+    if (k != NULL)
+      return is_equal(k, key) ? node_array(node)[2 * i + 1]: NULL;
+    node = node_array(node)[2 * i + 1];
+  }
+  return NULL;
+}
+
+/* Returns `node' with `key' bound to `value', `added' is set for a new key */
+sexp node_assoc(sexp node, sexp edit, int shift, uintptr_t hash,
+                sexp key, sexp value, int *added) {
+  if (is_collision(shift)) {
+    for (int i = 0; i < node_length(node); i++)
+      if (is_equal(node_array(node)[2 * i], key))
+        return node_array(node)[2 * i + 1] == value ? node:
+            set_child(node, edit, i, node_array(node)[2 * i], value);
+    *added = yes;
+    return insert_child(node, edit, node_length(node), 0, key, value);
+  }
+  uint32_t bit = hash_bit(hash, shift);
+  int i = child_index(node, bit);
+  if (!(node_bitmap(node) & bit)) {
+    *added = yes;
+    return insert_child(node, edit, i, bit, key, value);
+  }
+  sexp k = node_array(node)[2 * i];
+  sexp v = node_array(node)[2 * i + 1];
+  if (k == NULL) {
+    sexp sub = node_assoc(v, edit, shift + LEVEL_BITS, hash, key, value, added);
+    return sub == v ? node: set_child(node, edit, i, NULL, sub);
+  }
+  if (is_equal(k, key))
+    return v == value ? node: set_child(node, edit, i, k, value);
+  *added = yes;
+  sexp sub = make_pair_node(edit, shift + LEVEL_BITS, k, equal_hash(k), v,
+                            key, hash, value);
+  return set_child(node, edit, i, NULL, sub);
+}
+
+/* Returns `node' without `key', or NULL when it becomes empty */
+sexp node_dissoc(sexp node, sexp edit, int shift, uintptr_t hash,
+                 sexp key, int *removed) {
+  if (is_collision(shift)) {
+    for (int i = 0; i < node_length(node); i++)
+      if (is_equal(node_array(node)[2 * i], key)) {
+        *removed = yes;
+        return remove_child(node, edit, i, 0);
+      }
+    return node;
+  }
+  uint32_t bit = hash_bit(hash, shift);
+  if (!(node_bitmap(node) & bit)) return node;
+  int i = child_index(node, bit);
+  sexp k = node_array(node)[2 * i];
+  sexp v = node_array(node)[2 * i + 1];
+  if (k == NULL) {
+    sexp sub = node_dissoc(v, edit, shift + LEVEL_BITS, hash, key, removed);
+    if (sub == v) return node;
+    if (sub == NULL) return remove_child(node, edit, i, bit);
+    return set_child(node, edit, i, NULL, sub);
+  }
+  if (!is_equal(k, key)) return node;
+  *removed = yes;
+  return remove_child(node, edit, i, bit);
+}
+
+sexp root_assoc(sexp root, sexp edit, sexp key, sexp value, int *added) {
+  uintptr_t hash = equal_hash(key);
+  if (root != NULL)
+    return node_assoc(root, edit, 0, hash, key, value, added);
+  *added = yes;
+  root = make_hamt_node(edit, hash_bit(hash, 0), 1);
+  node_array(root)[0] = key;
+  node_array(root)[1] = value;
+  return root;
+}
+
+sexp root_dissoc(sexp root, sexp edit, sexp key, int *removed) {
+  if (root == NULL) return NULL;
+  return node_dissoc(root, edit, 0, equal_hash(key), key, removed);
+}
+
+/* Checkers */
+void check_hamt(sexp map, char *op) {
+  if (is_hamt(map)) return;
+  port_format(scm_err_port, "%s: Wrong type argument %*\n", make_string(op), map);
+  exit(1);
+}
+
+/* The persistent operations refuse a transient, whose nodes may still be
+   mutated */
+void check_persistent(sexp map, char *op) {
+  check_hamt(map, op);
+  if (!hamt_is_transient(map)) return;
+  port_format(scm_err_port, "%s: Transient map %*\n", make_string(op), map);
+  exit(1);
+}
+
+void check_transient(sexp map, char *op) {
+  check_hamt(map, op);
+  if (hamt_is_transient(map) && hamt_edit(map) != NULL) return;
+  port_format(scm_err_port, "%s: Not a usable transient map %*\n",
+              make_string(op), map);
+  exit(1);
+}
+
+/* Persistent maps */
+sexp make_hamt_proc(void) {
+  return make_hamt(NULL, 0, no);
+}
+
+sexp hamt_ref(sexp map, sexp key, sexp fallback) {
+  check_hamt(map, "hamt-ref");
+  sexp value = node_find(hamt_root(map), equal_hash(key), key);
+  return value != NULL ? value: fallback;
+}
+
+sexp hamt_contains(sexp map, sexp key) {
+  check_hamt(map, "hamt-contains?");
+  return node_find(hamt_root(map), equal_hash(key), key) != NULL ?
+      true_object: false_object;
+}
+
+sexp hamt_count_proc(sexp map) {
+  check_hamt(map, "hamt-count");
+  return make_fixnum(hamt_count(map));
+}
+
+sexp hamt_set(sexp map, sexp key, sexp value) {
+  check_persistent(map, "hamt-set");
+  int added = no;
+  sexp root = root_assoc(hamt_root(map), NULL, key, value, &added);
+  if (root == hamt_root(map)) return map;
+  return make_hamt(root, hamt_count(map) + added, no);
+}
+
+sexp hamt_delete(sexp map, sexp key) {
+  check_persistent(map, "hamt-delete");
+  int removed = no;
+  sexp root = root_dissoc(hamt_root(map), NULL, key, &removed);
+  if (!removed) return map;
+  return make_hamt(root, hamt_count(map) - 1, no);
+}
+
+void collect_entries(sexp node, sexp *list) {
+  for (int i = 0; i < node_length(node); i++) {
+    sexp k = node_array(node)[2 * i];
+    sexp v = node_array(node)[2 * i + 1];
+    if (k == NULL)
+      collect_entries(v, list);
+    else {
+      sexp entry = make_pair(k, v);
+      *list = make_pair(entry, *list);
+    }
+  }
+}
+
+sexp hamt_to_alist(sexp map) {
+  check_hamt(map, "hamt->alist");
+  sexp list = EOL;
+  if (hamt_root(map) != NULL)
+    collect_entries(hamt_root(map), &list);
+  return list;
+}
+
+/* Transients, which own the nodes they create */
+sexp hamt_transient(sexp map) {
+  check_persistent(map, "hamt-transient");
+  return make_hamt(hamt_root(map), hamt_count(map), yes);
+}
+
+sexp hamt_set_x(sexp map, sexp key, sexp value) {
+  check_transient(map, "hamt-set!");
+  int added = no;
+  hamt_root(map) = root_assoc(hamt_root(map), hamt_edit(map), key, value, &added);
+  hamt_count(map) += added;
+  return map;
+}
+
+sexp hamt_delete_x(sexp map, sexp key) {
+  check_transient(map, "hamt-delete!");
+  int removed = no;
+  hamt_root(map) = root_dissoc(hamt_root(map), hamt_edit(map), key, &removed);
+  hamt_count(map) -= removed;
+  return map;
+}
+
+/* Ends the transient, its nodes are shared by the returned map from now on */
+sexp hamt_persistent(sexp map) {
+  check_transient(map, "hamt-persistent!");
+  hamt_edit(map) = NULL;
+  return make_hamt(hamt_root(map), hamt_count(map), no);
+}
@@ -0,0 +1,313 @@
+/*
+ * hashtable.c
+ *
+ * Hash tables for Lisp code, keyed by eq?, eqv?, equal? or string=?
+ *
+ * Copyright (C) 2013-04-24 liutos <mat.liutos@gmail.com>
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hashtable.h"
+#include "object.h"
+#include "types.h"
+#include "vm.h"
+#include "write.h"
+
+#define INITIAL_SIZE 8
+/* Sub-objects of a key visited by `hash_equal' */
+#define HASH_BUDGET 32
+
+/* Equivalences */
+int is_eqv(sexp x, sexp y) {
+  if (x == y) return yes;
+  if (is_float(x) && is_float(y))
+    return memcmp(&float_value(x), &float_value(y), sizeof(double)) == 0;
+  if (is_bignum(x) && is_bignum(y))
+    return bignum_sign(x) == bignum_sign(y) &&
+        bignum_length(x) == bignum_length(y) &&
+        memcmp(bignum_digits(x), bignum_digits(y),
+               bignum_length(x) * sizeof(uint32_t)) == 0;
+  return no;
+}
+
+int is_equal(sexp x, sexp y) {
+tail_loop:
+  if (is_eqv(x, y)) return yes;
+  if (!is_pointer(x) || !is_pointer(y) || x->type != y->type) return no;
+  switch (x->type) {
+    case STRING:
+      return string_byte_length(x) == string_byte_length(y) &&
+          memcmp(string_value(x), string_value(y), string_byte_length(x)) == 0;
+    case PAIR:
+      if (!is_equal(pair_car(x), pair_car(y))) return no;
+      x = pair_cdr(x);
+      y = pair_cdr(y);
+      goto tail_loop;
+    case VECTOR:
+      if (vector_pos(x) != vector_pos(y)) return no;
+      for (int i = 0; i < vector_pos(x); i++)
+        if (!is_equal(vector_data_at(x, i), vector_data_at(y, i))) return no;
+      return yes;
+    case UVECTOR:
+      return uvector_kind(x) == uvector_kind(y) &&
+          uvector_length(x) == uvector_length(y) &&
+          memcmp(uvector_data(x), uvector_data(y),
+                 uvector_length(x) * uvector_element_size(uvector_kind(x))) == 0;
+    default: return no;
+  }
+}
+
+/* Hash functions, equivalent keys have the same hash */
+/* The finalizer of MurmurHash3, every bit of `x' affects the low bits */
+uintptr_t hash_word(uintptr_t x) {
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ULL;
+  x ^= x >> 33;
+  return x;
+}
+
+/* FNV-1a */
+uintptr_t hash_bytes(const void *bytes, size_t n) {
+  const unsigned char *p = bytes;
+  uint64_t h = 0xcbf29ce484222325ULL;
+  for (size_t i = 0; i < n; i++)
+    h = (h ^ p[i]) * 0x100000001b3ULL;
+  return hash_word(h);
+}
+
+/* The objects never move, so an address is a stable hash */
+uintptr_t hash_eqv(sexp x) {
+  if (is_float(x))
+    return hash_bytes(&float_value(x), sizeof(double));
+  if (is_bignum(x))
+    return hash_bytes(bignum_digits(x), bignum_length(x) * sizeof(uint32_t)) ^
+        bignum_sign(x);
+  return hash_word((uintptr_t)x);
+}
+
+/* Visits at most `*budget' sub-objects, so that a long list costs a
+   bounded time */
+uintptr_t hash_equal(sexp x, int *budget) {
+  uintptr_t h = 0;
+tail_loop:
+  if (--*budget < 0) return h;
+  if (!is_pointer(x)) return h ^ hash_eqv(x);
+  switch (x->type) {
+    case STRING:
+      return h ^ hash_bytes(string_value(x), string_byte_length(x));
+    case PAIR:
+      h = (h ^ hash_equal(pair_car(x), budget)) * 31;
+      x = pair_cdr(x);
+      goto tail_loop;
+    case VECTOR:
+      for (int i = 0; i < vector_pos(x) && *budget > 0; i++)
+        h = (h ^ hash_equal(vector_data_at(x, i), budget)) * 31;
+      return h ^ vector_pos(x);
+    case UVECTOR:
+      return h ^ hash_bytes(uvector_data(x), uvector_length(x) *
+                            uvector_element_size(uvector_kind(x)));
+    default: return h ^ hash_eqv(x);
+  }
+}
+
+uintptr_t equal_hash(sexp x) {
+  int budget = HASH_BUDGET;
+  return hash_equal(x, &budget);
+}
+
+void check_table(sexp table, char *op) {
+  if (is_hash_table(table)) return;
+  port_format(scm_err_port, "%s: Wrong type argument %*\n", make_string(op), table);
+  exit(1);
+}
+
+uintptr_t hash_key(sexp table, sexp key, char *op) {
+  switch (table_kind(table)) {
+    case HASH_EQ: return hash_word((uintptr_t)key);
+    case HASH_EQV: return hash_eqv(key);
+    case HASH_EQUAL: return equal_hash(key);
+    default:
+      if (!is_string(key)) {
+        port_format(scm_err_port, "%s: Wrong type argument %*\n", make_string(op), key);
+        exit(1);
+      }
+      return hash_bytes(string_value(key), string_byte_length(key));
+  }
+}
+
+int is_same_key(sexp table, sexp k1, sexp k2) {
+  switch (table_kind(table)) {
+    case HASH_EQ: return k1 == k2;
+    case HASH_EQV: return is_eqv(k1, k2);
+    default: return is_equal(k1, k2);
+  }
+}
+
+/* Probing */
+/* Returns the slot of `key', or the free one where it is to be stored */
+struct hash_slot *find_slot(sexp table, sexp key, uintptr_t hash) {
+  unsigned int mask = table_size(table) - 1;
+  struct hash_slot *deleted = NULL;
+  for (unsigned int i = hash & mask; ; i = (i + 1) & mask) {
+    struct hash_slot *slot = &table_slots(table)[i];
+    if (slot->key == NULL)
+      return deleted ? deleted: slot;
+    if (slot->key == deleted_object) {
+      if (deleted == NULL) deleted = slot;
+    } else if (slot->hash == hash && is_same_key(table, slot->key, key))
+      return slot;
+  }
+}
+
+/* Moves the live entries into `size' slots, dropping the deleted ones */
+void rehash_table(sexp table, unsigned int size) {
+  struct hash_slot *old = table_slots(table);
+  unsigned int old_size = table_size(table);
+  table_slots(table) = calloc(size, sizeof(struct hash_slot));
+  if (table_slots(table) == NULL) {
+    fprintf(stderr, "Memory exhausted\n");
+    exit(1);
+  }
+  table_size(table) = size;
+  table_filled(table) = table_count(table);
+  for (unsigned int i = 0; i < old_size; i++) {
+    if (!is_live_slot(&old[i])) continue;
+    unsigned int j = old[i].hash & (size - 1);
+    while (table_slots(table)[j].key != NULL)
+      j = (j + 1) & (size - 1);
+    table_slots(table)[j] = old[i];
+  }
+  free(old);
+}
+
+/* Keeps at least a quarter of the slots free, so that a probe always
+   ends. A rehash leaves at most half of them in use. */
+void reserve_slot(sexp table) {
+  if ((table_filled(table) + 1) * 4 <= table_size(table) * 3) return;
+  unsigned int size = table_size(table);
+  while ((table_count(table) + 1) * 2 > size)
+    size *= 2;
+  rehash_table(table, size);
+}
+
+/* Constructors */
+sexp make_eq_table_proc(void) {
+  return make_table(HASH_EQ, INITIAL_SIZE);
+}
+
+sexp make_eqv_table_proc(void) {
+  return make_table(HASH_EQV, INITIAL_SIZE);
+}
+
+sexp make_equal_table_proc(void) {
+  return make_table(HASH_EQUAL, INITIAL_SIZE);
+}
+
+sexp make_string_table_proc(void) {
+  return make_table(HASH_STRING, INITIAL_SIZE);
+}
+
+/* Accessors */
+sexp hash_table_ref(sexp table, sexp key, sexp fallback) {
+  check_table(table, "hash-table-ref/default");
+  struct hash_slot *slot =
+      find_slot(table, key, hash_key(table, key, "hash-table-ref/default"));
+  return is_live_slot(slot) ? slot->value: fallback;
+}
+
+sexp hash_table_set(sexp table, sexp key, sexp value) {
+  check_table(table, "hash-table-set!");
+  uintptr_t hash = hash_key(table, key, "hash-table-set!");
+  reserve_slot(table);
+  struct hash_slot *slot = find_slot(table, key, hash);
+  if (!is_live_slot(slot)) {
+    if (slot->key == NULL) table_filled(table)++;
+    table_count(table)++;
+    slot->key = key;
+    slot->hash = hash;
+  }
+  slot->value = value;
+  return value;
+}
+
+sexp hash_table_delete(sexp table, sexp key) {
+  check_table(table, "hash-table-delete!");
+  struct hash_slot *slot =
+      find_slot(table, key, hash_key(table, key, "hash-table-delete!"));
+  if (!is_live_slot(slot)) return false_object;
+  slot->key = deleted_object;
+  slot->value = NULL;
+  table_count(table)--;
+  return true_object;
+}
+
+sexp hash_table_contains(sexp table, sexp key) {
+  check_table(table, "hash-table-contains?");
+  struct hash_slot *slot =
+      find_slot(table, key, hash_key(table, key, "hash-table-contains?"));
+  return is_live_slot(slot) ? true_object: false_object;
+}
+
+sexp hash_table_count(sexp table) {
+  check_table(table, "hash-table-count");
+  return make_fixnum(table_count(table));
+}
+
+/* Iteration */
+sexp hash_table_keys(sexp table) {
+  check_table(table, "hash-table-keys");
+  sexp list = EOL;
+  for (unsigned int i = 0; i < table_size(table); i++)
+    if (is_live_slot(&table_slots(table)[i]))
+      list = make_pair(table_slots(table)[i].key, list);
+  return list;
+}
+
+sexp hash_table_values(sexp table) {
+  check_table(table, "hash-table-values");
+  sexp list = EOL;
+  for (unsigned int i = 0; i < table_size(table); i++)
+    if (is_live_slot(&table_slots(table)[i]))
+      list = make_pair(table_slots(table)[i].value, list);
+  return list;
+}
+
+sexp hash_table_to_alist(sexp table) {
+  check_table(table, "hash-table->alist");
+  sexp list = EOL;
+  for (unsigned int i = 0; i < table_size(table); i++) {
+    struct hash_slot *slot = &table_slots(table)[i];
+    if (is_live_slot(slot)) {
+      sexp entry = make_pair(slot->key, slot->value);
+      list = make_pair(entry, list);
+    }
+  }
+  return list;
+}
+
+/* Calls `proc' on the key and the value of each entry. The slots are looked
+   up again after each call, as `proc' may grow the table. */
+sexp hash_table_walk(sexp table, sexp proc) {
+  check_table(table, "hash-table-walk");
+  for (unsigned int i = 0; i < table_size(table); i++) {
+    struct hash_slot *slot = &table_slots(table)[i];
+    if (is_live_slot(slot)) {
+      sexp argv[2] = {slot->key, slot->value};
+      vm_apply(proc, 2, argv);
+    }
+  }
+  return table;
+}
+
+sexp eqv_proc(sexp x, sexp y) {
+  return is_eqv(x, y) ? true_object: false_object;
+}
+
+sexp equal_proc(sexp x, sexp y) {
+  return is_equal(x, y) ? true_object: false_object;
+}
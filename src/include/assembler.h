@@ -36,12 +36,111 @@ enum code_type {
   CDR,
   /* Others */
   EQ,
+  /* Register tier: three-address instructions on frame slots */
+  RARGS,
+  RARGSD,
+  RCALLJ,
+  RRET,
+  RMOV,
+  RPUSH,
+  RPOP,
+  RGVAR,
+  RGSET,
+  RLVAR,
+  RLSET,
+  RFJUMP,
+  RTJUMP,
+  RPRIM0,
+  RPRIM1,
+  RPRIM2,
+  RPRIM3,
+  RADD,
+  RSUB,
+  RMUL,
+  RDIV,
+  RCAR,
+  RCDR,
+  REQ,
+  /* Non-local exit */
+  CATCH,
+  UNCATCH,
+  THROW,
+  /* Variables both captured and assigned */
+  LBOX,
+  BVAR,
+  BSET,
+  /* Frames kept on the VM stack */
+  SARGS,
+  SARGSD,
+  SCALLJ,
+  SVAR,
+  SSET,
+  SBOX,
+  SBVAR,
+  SBSET,
+  /* Generic arithmetic operations */
+  NADD,
+  NSUB,
+  NMUL,
+  NDIV,
+  NLT,
+  NEQ,
+  NGT,
+  RNADD,
+  RNSUB,
+  RNMUL,
+  RNDIV,
+  RNLT,
+  RNEQ,
+  RNGT,
+  /* Unboxed flonum operations */
+  FLOAD,
+  FADD,
+  FSUB,
+  FMUL,
+  FDIV,
+  FBOX,
+  RFLOAD,
+  RFBOX,
+  /* Bulk operations on uniform vectors */
+  VADD,
+  VMUL,
+  VDOT,
+  VSUM,
+  VMIN,
+  VMAX,
+  VSCALE,
+  VFILL,
+  VCOPY,
+  RVADD,
+  RVMUL,
+  RVDOT,
+  RVSUM,
+  RVMIN,
+  RVMAX,
+  RVSCALE,
+  RVFILL,
+  RVCOPY,
+  /* Records, the type and the slot index are immediate */
+  RECMAKE,
+  RECP,
+  RECREF,
+  RECSET,
+  RRECNEW,
+  RRECINIT,
+  RRECP,
+  RRECREF,
+  RRECSET,
+  /* Generic functions, the method is found by the cache of the call site */
+  GMETHOD,
+  RGMETHOD,
 };
 
 struct code_t {
   enum code_type code;
   char *name;
   int arity;
+  int label;                            /* Position of the label argument */
 };
 
 extern struct code_t opcodes[];
@@ -0,0 +1,39 @@
+/*
+ * bytevector.h
+ *
+ * Raw bytes: slices, bulk copies, endian-aware accessors and port I/O
+ *
+ * Copyright (C) 2013-04-23 liutos <mat.liutos@gmail.com>
+ */
+#ifndef BYTEVECTOR_H
+#define BYTEVECTOR_H
+
+#include "types.h"
+
+extern sexp bytevector_length_proc(sexp);
+extern sexp bytevector_u8_ref(sexp, sexp);
+extern sexp bytevector_u8_set(sexp, sexp, sexp);
+extern sexp bytevector_slice(sexp, sexp, sexp);
+extern sexp bytevector_copy(int, sexp *);
+extern sexp bytevector_copy_to(int, sexp *);
+extern sexp bytevector_fill(sexp, sexp);
+
+extern sexp bytevector_u16_ref(sexp, sexp, sexp);
+extern sexp bytevector_u16_set(int, sexp *);
+extern sexp bytevector_s16_ref(sexp, sexp, sexp);
+extern sexp bytevector_s16_set(int, sexp *);
+extern sexp bytevector_u32_ref(sexp, sexp, sexp);
+extern sexp bytevector_u32_set(int, sexp *);
+extern sexp bytevector_s32_ref(sexp, sexp, sexp);
+extern sexp bytevector_s32_set(int, sexp *);
+extern sexp bytevector_s64_ref(sexp, sexp, sexp);
+extern sexp bytevector_s64_set(int, sexp *);
+extern sexp bytevector_f32_ref(sexp, sexp, sexp);
+extern sexp bytevector_f32_set(int, sexp *);
+extern sexp bytevector_f64_ref(sexp, sexp, sexp);
+extern sexp bytevector_f64_set(int, sexp *);
+
+extern sexp read_bytes(sexp, sexp);
+extern sexp write_bytes(sexp, sexp);
+
+#endif
@@ -0,0 +1,24 @@
+/*
+ * class.h
+ *
+ * Classes and generic functions with inline method caches
+ *
+ * Copyright (C) 2013-04-26 liutos <mat.liutos@gmail.com>
+ */
+#ifndef CLASS_H
+#define CLASS_H
+
+#include "types.h"
+
+extern int dispatch_epoch;
+
+extern void init_class_parents(void);
+extern sexp make_method_cache(void);
+extern sexp generic_method(sexp, sexp);
+extern sexp cached_method(sexp, sexp, sexp);
+extern sexp add_method_proc(sexp, sexp, sexp);
+extern sexp set_class_parent_proc(sexp, sexp);
+extern sexp class_parent_proc(sexp);
+extern sexp find_method_proc(sexp, sexp);
+
+#endif
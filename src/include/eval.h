@@ -13,6 +13,8 @@ extern lisp_object_t begin_actions(lisp_object_t);
 /* define */
 extern int is_define_form(sexp);
 extern sexp define2set(sexp);
+extern sexp definition_variable(sexp);
+extern sexp definition_value(sexp);
 /* if */
 extern int is_if_form(lisp_object_t);
 extern lisp_object_t if_test_part(lisp_object_t);
@@ -33,6 +35,22 @@ extern lisp_object_t assignment_value(lisp_object_t);
 extern int is_macro_form(sexp);
 extern sexp macro_parameters(sexp);
 extern sexp macro_body(sexp);
+/* catch */
+extern int is_catch_form(sexp);
+extern sexp catch_tag(sexp);
+extern sexp catch_body(sexp);
+/* define-record-type */
+extern int is_record_type_form(sexp);
+extern sexp record_type_form_name(sexp);
+extern sexp record_constructor_spec(sexp);
+extern sexp record_predicate_name(sexp);
+extern sexp record_field_specs(sexp);
+/* define-generic */
+extern int is_generic_form(sexp);
+extern sexp generic_form_name(sexp);
+/* define-method */
+extern int is_method_form(sexp);
+extern sexp method2add(sexp);
 
 extern int is_variable_form(lisp_object_t);
 extern int is_application_form(lisp_object_t);
@@ -0,0 +1,25 @@
+/*
+ * hamt.h
+ *
+ * Persistent hash maps as hash array mapped tries, keyed by equal?
+ *
+ * Copyright (C) 2013-04-25 liutos <mat.liutos@gmail.com>
+ */
+#ifndef HAMT_H
+#define HAMT_H
+
+#include "types.h"
+
+extern sexp make_hamt_proc(void);
+extern sexp hamt_ref(sexp, sexp, sexp);
+extern sexp hamt_contains(sexp, sexp);
+extern sexp hamt_count_proc(sexp);
+extern sexp hamt_set(sexp, sexp, sexp);
+extern sexp hamt_delete(sexp, sexp);
+extern sexp hamt_to_alist(sexp);
+extern sexp hamt_transient(sexp);
+extern sexp hamt_set_x(sexp, sexp, sexp);
+extern sexp hamt_delete_x(sexp, sexp);
+extern sexp hamt_persistent(sexp);
+
+#endif
@@ -0,0 +1,33 @@
+/*
+ * hashtable.h
+ *
+ * Hash tables for Lisp code, keyed by eq?, eqv?, equal? or string=?
+ *
+ * Copyright (C) 2013-04-24 liutos <mat.liutos@gmail.com>
+ */
+#ifndef HASHTABLE_H
+#define HASHTABLE_H
+
+#include "types.h"
+
+extern int is_eqv(sexp, sexp);
+extern int is_equal(sexp, sexp);
+extern uintptr_t equal_hash(sexp);
+
+extern sexp make_eq_table_proc(void);
+extern sexp make_eqv_table_proc(void);
+extern sexp make_equal_table_proc(void);
+extern sexp make_string_table_proc(void);
+extern sexp hash_table_ref(sexp, sexp, sexp);
+extern sexp hash_table_set(sexp, sexp, sexp);
+extern sexp hash_table_delete(sexp, sexp);
+extern sexp hash_table_contains(sexp, sexp);
+extern sexp hash_table_count(sexp);
+extern sexp hash_table_keys(sexp);
+extern sexp hash_table_values(sexp);
+extern sexp hash_table_to_alist(sexp);
+extern sexp hash_table_walk(sexp, sexp);
+extern sexp eqv_proc(sexp, sexp);
+extern sexp equal_proc(sexp, sexp);
+
+#endif
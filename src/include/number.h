@@ -0,0 +1,23 @@
+#ifndef NUMBER_H
+#define NUMBER_H
+
+#include "types.h"
+
+extern double real_value(sexp, char *);
+extern sexp make_integer(long long);
+extern sexp string_to_integer(char *, int);
+extern char *integer_to_string(sexp);
+
+extern sexp number_add(sexp, sexp);
+extern sexp number_sub(sexp, sexp);
+extern sexp number_mul(sexp, sexp);
+extern sexp number_div(sexp, sexp);
+extern sexp number_quotient(sexp, sexp);
+extern sexp number_remainder(sexp, sexp);
+extern sexp number_modulo(sexp, sexp);
+extern sexp number_lt(sexp, sexp);
+extern sexp number_eq(sexp, sexp);
+extern sexp number_gt(sexp, sexp);
+extern sexp number_to_string(sexp);
+
+#endif
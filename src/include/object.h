@@ -23,6 +23,9 @@ extern sexp scm_out_port;
 extern struct lisp_object_t *objects_heap;
 extern sexp root;
 extern sexp vm_stack;
+extern sexp open_procedures;
+extern sexp class_parents;
+extern unsigned int vm_stack_limit;
 
 /* extern void reclaim(sexp); */
 extern void trigger_gc(void);
@@ -35,25 +38,36 @@ extern sexp make_false(void);
 extern sexp make_true(void);
 extern sexp make_undefined(void);
 
-extern sexp make_fixnum(int);
-extern sexp make_character(char);
+extern sexp make_fixnum(intptr_t);
+extern sexp make_character(int);
 
 extern sexp make_string(char *);
 extern sexp make_pair(sexp, sexp);
 extern sexp make_symbol(char *);
 extern sexp make_file_in_port(FILE *);
 extern sexp make_file_out_port(FILE *);
-extern sexp make_flonum(float);
+extern sexp make_flonum(double);
+extern sexp make_bignum(int);
+extern size_t uvector_element_size(enum uvector_kind);
+extern sexp make_uvector(enum uvector_kind, int);
+extern sexp make_uvector_slice(sexp, int, int);
+extern sexp make_table(enum hash_kind, unsigned int);
+extern sexp make_hamt(sexp, int, int);
+extern sexp make_hamt_node(sexp, uint32_t, int);
 extern sexp make_primitive_proc(C_proc_t);
 extern sexp make_lambda_procedure(sexp, sexp, sexp);
 extern sexp make_compiled_proc(sexp, sexp, sexp);
 extern sexp make_vector(unsigned int);
-extern sexp make_return_info(sexp, int, sexp);
+extern sexp make_return_info(sexp, int, sexp, int);
 extern sexp make_macro_procedure(sexp, sexp, sexp);
 extern sexp make_environment(sexp, sexp);
 /* extern sexp make_string_in_port(char *); */
-extern sexp make_wchar(void);
-extern sexp make_wstring(char *);
+extern sexp make_frame(int, sexp);
+extern sexp make_box(sexp);
+extern sexp make_record_type(sexp, sexp);
+extern sexp make_record(sexp);
+extern sexp make_generic(sexp);
+extern sexp make_regexp(struct regexp_t *, sexp);
 
 extern sexp make_list(sexp e, ...);
 extern sexp nconc_pair(sexp, sexp);
@@ -62,8 +76,13 @@ extern sexp pair_nthcdr(sexp, int);
 
 extern sexp read_byte(sexp);
 extern sexp read_char(sexp);
+extern int utf8_decode(char *, int *);
+extern int utf8_encode(int, char *);
+extern char *string_char_at(sexp, int);
+extern void string_splice(sexp, char *, int, char *, int);
 
 extern sexp is_vector_full(sexp);
+extern void vector_reserve(sexp, unsigned int);
 extern sexp vector_push(sexp, sexp);
 extern sexp is_vector_empty(sexp);
 extern sexp vector_pop(sexp);
@@ -77,6 +96,8 @@ extern hash_table_t make_symbol_table(void);
 extern sexp find_or_create_symbol(char *);
 
 extern sexp extend_environment(sexp, sexp, sexp);
+extern sexp extend_frame(sexp, sexp);
+extern sexp global_environment(sexp);
 extern sexp make_startup_environment(void);
 extern sexp make_global_env(void);
 extern sexp make_repl_environment(void);
@@ -0,0 +1,24 @@
+/*
+ * regexp.h
+ *
+ * Regular expressions run by a lazily built DFA, captures by a Pike VM
+ *
+ * Copyright (C) 2013-04-27 liutos <mat.liutos@gmail.com>
+ */
+#ifndef REGEXP_H
+#define REGEXP_H
+
+#include "types.h"
+
+struct regexp_t;
+
+extern void free_regexp(struct regexp_t *);
+/* The engines alone, without the other as a filter */
+extern int dfa_run(struct regexp_t *, char *, int, int);
+extern int pike_run(struct regexp_t *, char *, int, int, int);
+extern sexp regexp_compile(sexp);
+extern sexp regexp_match(sexp, sexp);
+extern sexp regexp_search(sexp, sexp);
+extern sexp regexp_search_port(sexp, sexp);
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef REGISTER_H
+#define REGISTER_H
+
+#include "types.h"
+
+extern int is_register_tier;
+
+extern sexp translate_to_register(sexp);
+extern sexp use_register_tier(sexp);
+
+#endif
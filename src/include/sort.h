@@ -0,0 +1,16 @@
+/*
+ * sort.h
+ *
+ * Sorting of lists and vectors
+ *
+ * Copyright (C) 2013-04-28 liutos <mat.liutos@gmail.com>
+ */
+#ifndef SORT_H
+#define SORT_H
+
+#include "types.h"
+
+extern sexp sort_proc(sexp, sexp);
+extern sexp sort_x_proc(sexp, sexp);
+
+#endif
@@ -8,11 +8,17 @@
 #ifndef TYPES_H
 #define TYPES_H
 
+#include <stdint.h>
 #include <stdio.h>
 
-#define WCHAR_LENGTH 6
+/* The longest UTF-8 encoding of a code point */
+#define UTF8_LENGTH 4
+#define STRING_INDEX_STEP 32
+#define FRAME_INLINE_SLOTS 2
+#define RECORD_INLINE_SLOTS 3
 
 typedef struct lisp_object_t *sexp;
+struct regexp_t;
 typedef sexp (*C_proc_t)(sexp);
 typedef unsigned int (*hash_fn_t)(char *);
 typedef int (*comp_fn_t)(char *, char *);
@@ -20,6 +26,7 @@ typedef sexp (*proc0_t)(void);
 typedef sexp (*proc1_t)(sexp);
 typedef sexp (*proc2_t)(sexp, sexp);
 typedef sexp (*proc3_t)(sexp, sexp, sexp);
+typedef sexp (*procv_t)(int, sexp *);     /* Variadic: `argc' and `argv' */
 
 enum object_type {
   /* tagged pointer types */
@@ -45,8 +52,32 @@ enum object_type {
   FLONUM,
   MACRO,
   ENVIRONMENT,
-  WCHAR,
-  WSTRING,
+  FRAME,
+  BOX,
+  BIGNUM,
+  UVECTOR,
+  HASH_TABLE,
+  HAMT,
+  HAMT_NODE,
+  RECORD_TYPE,
+  RECORD,
+  GENERIC,
+  REGEXP,
+};
+
+/* Element types of the uniform vectors */
+enum uvector_kind {
+  UVECTOR_F64,
+  UVECTOR_S32,
+  UVECTOR_U8,
+};
+
+/* Equivalences of the keys of a hash table */
+enum hash_kind {
+  HASH_EQ,
+  HASH_EQV,
+  HASH_EQUAL,
+  HASH_STRING,
 };
 
 /* Lisp object */
@@ -59,6 +90,10 @@ typedef struct lisp_object_t {
   union {
     struct {
       char *value;
+      int length;
+      int byte_length;
+      int is_ascii;
+      int *index;
     } string;
     struct {
       sexp car;
@@ -90,6 +125,7 @@ typedef struct lisp_object_t {
       sexp args;
       sexp code;
       sexp env;
+      sexp bytecode;                    /* The assembled `code' */
     } compiled_proc;
     struct {
       sexp *datum;
@@ -100,24 +136,86 @@ typedef struct lisp_object_t {
       sexp code;
       int pc;
       sexp env;
+      int fp;
     } return_info;
     struct {
-      float value;
+      double value;
     } flonum;
     struct {
       sexp bindings;
       sexp outer_env;
     } environment;
     struct {
-      char bytes[WCHAR_LENGTH];
-    } wchar;
+      sexp *slots;                      /* Points to `inline_slots' if fits */
+      int size;
+      sexp outer;
+      int is_on_stack;                  /* Compile-time frame kept on the VM stack */
+      sexp inline_slots[FRAME_INLINE_SLOTS];
+    } frame;
     struct {
-      sexp *string;
+      sexp value;
+    } box;
+    struct {
+      uint32_t *digits;                 /* Base 2^32, the least significant first */
+      int length;
+      int sign;
+    } bignum;
+    struct {
+      void *data;                       /* Unboxed elements */
       int length;
-    } wstring;
+      enum uvector_kind kind;
+      struct lisp_object_t *parent;     /* Owner of `data' for a slice */
+    } uvector;
+    struct {
+      struct hash_slot *slots;          /* Open addressing, linear probing */
+      unsigned int size;                /* A power of two */
+      unsigned int count;               /* The live entries */
+      unsigned int filled;              /* The live and deleted entries */
+      enum hash_kind kind;
+    } table;
+    struct {
+      struct lisp_object_t *root;       /* NULL when empty */
+      int count;
+      int is_transient;
+      struct lisp_object_t *edit;       /* Itself while the transient is usable */
+    } hamt;
+    struct {
+      /* A key and its value, or NULL and a subnode, for each child */
+      struct lisp_object_t **array;
+      uint32_t bitmap;                  /* The present children of a branch */
+      int length;                       /* The number of children */
+      struct lisp_object_t *edit;       /* The transient which may mutate it */
+    } hamt_node;
+    struct {
+      struct lisp_object_t *name;
+      struct lisp_object_t *fields;     /* The list of the field names */
+      int size;
+    } record_type;
+    struct {
+      struct lisp_object_t *type;
+      struct lisp_object_t **slots;     /* Points to `inline_slots' if fits */
+      struct lisp_object_t *inline_slots[RECORD_INLINE_SLOTS];
+    } record;
+    struct {
+      struct lisp_object_t *name;
+      struct lisp_object_t *methods;    /* The methods defined, by class */
+      struct lisp_object_t *resolved;   /* The methods found, by dispatch key */
+      int epoch;                        /* The `dispatch_epoch' of `resolved' */
+    } generic;
+    struct {
+      struct regexp_t *program;         /* Owned, freed with the object */
+      struct lisp_object_t *source;     /* The pattern string */
+    } regexp;
   } values;
 } *lisp_object_t;
 
+/* A slot of HASH_TABLE, free when `key' is NULL */
+struct hash_slot {
+  lisp_object_t key;
+  lisp_object_t value;
+  uintptr_t hash;
+};
+
 /* hash table */
 typedef struct table_entry_t {
   char *key;
@@ -141,7 +239,7 @@ typedef struct hash_table_t {
 #define EXTENDED_MASK 0x0f
 #define EXTENDED_TAG 0x0e
 #define MAKE_SINGLETON_OBJECT(n)\
-  ((lisp_object_t)((n << EXTENDED_BITS) | EXTENDED_TAG))
+  ((lisp_object_t)(((uintptr_t)(n) << EXTENDED_BITS) | EXTENDED_TAG))
 /* tagged pointer constant definitions */
 #define false_object                            \
   MAKE_SINGLETON_OBJECT(0)
@@ -157,8 +255,12 @@ typedef struct hash_table_t {
   MAKE_SINGLETON_OBJECT(5)
 #define dot_object                              \
   MAKE_SINGLETON_OBJECT(6)
+/* The key of a deleted slot of HASH_TABLE */
+#define deleted_object                          \
+  MAKE_SINGLETON_OBJECT(7)
 
-#define is_of_tag(x, mask, tag) (tag == (((int)(x)) & mask))
+/* The tags are read from the whole word, so objects may live anywhere */
+#define is_of_tag(x, mask, tag) (tag == (((uintptr_t)(x)) & mask))
 /* BOOLEAN */
 #define BOOL_MASK 0x0f
 #define BOOL_TAG 0x0e
@@ -166,7 +268,7 @@ typedef struct hash_table_t {
 #define is_true(x) (true_object == x)
 #define is_false(x) (false_object == x)
 #define is_bool(x) (is_true(x) || is_false(x))
-#define bool_value(x) (((int)(x)) >> BOOL_BITS)
+#define bool_value(x) (((intptr_t)(x)) >> BOOL_BITS)
 /* CLOSE_OBJECT */
 #define is_close_object(x) (close_object == x)
 /* DOT_OBJECT */
@@ -190,15 +292,29 @@ typedef struct hash_table_t {
 #define FIXNUM_MASK 0x03
 #define FIXNUM_TAG 0x01
 #define is_fixnum(x) is_of_tag(x, FIXNUM_MASK, FIXNUM_TAG)
-#define to_fixnum(x) ((lisp_object_t)((x << FIXNUM_BITS) | FIXNUM_TAG))
-#define fixnum_value(x) (((int)(x)) >> FIXNUM_BITS)
-/* CHARACTER */
+#define to_fixnum(x)                                            \
+  ((lisp_object_t)(((uintptr_t)(x) << FIXNUM_BITS) | FIXNUM_TAG))
+/* Relies on the arithmetic right shift of a signed word */
+#define fixnum_value(x) (((intptr_t)(x)) >> FIXNUM_BITS)
+#define FIXNUM_MAX (INTPTR_MAX >> FIXNUM_BITS)
+#define FIXNUM_MIN (-FIXNUM_MAX - 1)
+#define is_fixnum_range(n) ((n) >= FIXNUM_MIN && (n) <= FIXNUM_MAX)
+/* Only the tag of fixnum has the lowest bit set */
+#define are_fixnums(x, y) is_fixnum((sexp)((intptr_t)(x) & (intptr_t)(y)))
+/* CHARACTER: The code point of an Unicode character */
 #define CHAR_BITS 4
 #define CHAR_MASK 0x0f
 #define CHAR_TAG 0x06
 #define is_char(x) is_of_tag(x, CHAR_MASK, CHAR_TAG)
-#define to_char(x) ((lisp_object_t)((x << CHAR_BITS) | CHAR_TAG))
-#define char_value(x) (((int)(x)) >> CHAR_BITS)
+#define to_char(x) ((lisp_object_t)(((uintptr_t)(x) << CHAR_BITS) | CHAR_TAG))
+#define char_value(x) ((int)(((intptr_t)(x)) >> CHAR_BITS))
+/* REGISTER: Operand of the register-based instructions */
+#define REG_BITS 4
+#define REG_MASK 0x0f
+#define REG_TAG 0x0a
+#define is_register(x) is_of_tag(x, REG_MASK, REG_TAG)
+#define to_register(x) ((lisp_object_t)(((uintptr_t)(x) << REG_BITS) | REG_TAG))
+#define register_index(x) ((int)(((intptr_t)(x)) >> REG_BITS))
 
 /* pointer on heap */
 #define POINTER_MASK 0x03
@@ -206,9 +322,14 @@ typedef struct hash_table_t {
 #define is_pointer(x) is_of_tag(x, POINTER_MASK, POINTER_TAG)
 #define is_pointer_tag(x, tag)\
   (is_pointer(x) && tag == (x)->type)
-/* STRING */
+/* STRING: UTF-8 bytes. The index holds the byte offsets of every
+   STRING_INDEX_STEP-th character, it is built on the first access. */
 #define is_string(x) is_pointer_tag(x, STRING)
 #define string_value(x) ((x)->values.string.value)
+#define string_length(x) ((x)->values.string.length)
+#define string_byte_length(x) ((x)->values.string.byte_length)
+#define string_is_ascii(x) ((x)->values.string.is_ascii)
+#define string_index(x) ((x)->values.string.index)
 /* PAIR */
 #define is_pair(x) is_pointer_tag(x, PAIR)
 #define pair_car(x) ((x)->values.pair.car)
@@ -256,22 +377,83 @@ typedef struct hash_table_t {
 #define compiled_proc_args(x) ((x)->values.compiled_proc.args)
 #define compiled_proc_code(x) ((x)->values.compiled_proc.code)
 #define compiled_proc_env(x) ((x)->values.compiled_proc.env)
+#define compiled_proc_bytecode(x) ((x)->values.compiled_proc.bytecode)
 /* RETURN_INFO */
 #define is_return_info(x) is_pointer_tag(x, RETURN_INFO)
 #define return_code(x) ((x)->values.return_info.code)
 #define return_pc(x) ((x)->values.return_info.pc)
 #define return_env(x) ((x)->values.return_info.env)
+#define return_fp(x) ((x)->values.return_info.fp)
 /* ENVIRONMENT */
 #define is_environment(x) is_pointer_tag(x, ENVIRONMENT)
 #define environment_bindings(x) ((x)->values.environment.bindings)
 #define environment_outer(x) ((x)->values.environment.outer_env)
-/* WCHAR */
-#define is_wchar(x) is_pointer_tag(x, WCHAR)
-#define wchar_value(x) ((x)->values.wchar.bytes)
-/* WSTRING */
-#define is_wstring(x) is_pointer_tag(x, WSTRING)
-#define wstring_value(x) ((x)->values.wstring.string)
-#define wstring_length(x) ((x)->values.wstring.length)
+/* FRAME: Lexical environment of a compiled procedure */
+#define is_frame(x) is_pointer_tag(x, FRAME)
+#define frame_slots(x) ((x)->values.frame.slots)
+#define frame_size(x) ((x)->values.frame.size)
+#define frame_outer(x) ((x)->values.frame.outer)
+#define frame_slot(x, i) (frame_slots(x)[i])
+#define frame_on_stack(x) ((x)->values.frame.is_on_stack)
+/* BOX: Cell of a variable both captured and assigned */
+#define is_box(x) is_pointer_tag(x, BOX)
+#define box_value(x) ((x)->values.box.value)
+/* BIGNUM: Integer out of the range of fixnum */
+#define is_bignum(x) is_pointer_tag(x, BIGNUM)
+#define bignum_digits(x) ((x)->values.bignum.digits)
+#define bignum_length(x) ((x)->values.bignum.length)
+#define bignum_sign(x) ((x)->values.bignum.sign)
+/* UVECTOR: Homogeneous vector of raw numbers, as in SRFI-4 */
+#define is_uvector(x) is_pointer_tag(x, UVECTOR)
+#define uvector_data(x) ((x)->values.uvector.data)
+#define uvector_length(x) ((x)->values.uvector.length)
+#define uvector_kind(x) ((x)->values.uvector.kind)
+#define uvector_parent(x) ((x)->values.uvector.parent)
+#define uvector_f64(x) ((double *)uvector_data(x))
+#define uvector_s32(x) ((int32_t *)uvector_data(x))
+#define uvector_u8(x) ((uint8_t *)uvector_data(x))
+/* HASH_TABLE */
+#define is_hash_table(x) is_pointer_tag(x, HASH_TABLE)
+#define table_slots(x) ((x)->values.table.slots)
+#define table_size(x) ((x)->values.table.size)
+#define table_count(x) ((x)->values.table.count)
+#define table_filled(x) ((x)->values.table.filled)
+#define table_kind(x) ((x)->values.table.kind)
+#define is_live_slot(s) ((s)->key != NULL && (s)->key != deleted_object)
+/* HAMT: Persistent hash array mapped trie, keyed by equal? */
+#define is_hamt(x) is_pointer_tag(x, HAMT)
+#define hamt_root(x) ((x)->values.hamt.root)
+#define hamt_count(x) ((x)->values.hamt.count)
+#define hamt_is_transient(x) ((x)->values.hamt.is_transient)
+#define hamt_edit(x) ((x)->values.hamt.edit)
+/* HAMT_NODE: A branch indexed by the popcount of its bitmap, or a list of
+   the keys whose hashes collide when the hash bits are used up */
+#define is_hamt_node(x) is_pointer_tag(x, HAMT_NODE)
+#define node_array(x) ((x)->values.hamt_node.array)
+#define node_bitmap(x) ((x)->values.hamt_node.bitmap)
+#define node_length(x) ((x)->values.hamt_node.length)
+#define node_edit(x) ((x)->values.hamt_node.edit)
+/* RECORD_TYPE: Descriptor of the records made by `define-record-type' */
+#define is_record_type(x) is_pointer_tag(x, RECORD_TYPE)
+#define record_type_name(x) ((x)->values.record_type.name)
+#define record_type_fields(x) ((x)->values.record_type.fields)
+#define record_type_size(x) ((x)->values.record_type.size)
+/* RECORD: The slots are laid out in the order of the fields of its type */
+#define is_record(x) is_pointer_tag(x, RECORD)
+#define record_type(x) ((x)->values.record.type)
+#define record_slots(x) ((x)->values.record.slots)
+#define record_slot(x, i) (record_slots(x)[i])
+#define is_record_of(x, t) (is_record(x) && record_type(x) == (t))
+/* GENERIC: Function dispatching on the class of its first argument */
+#define is_generic(x) is_pointer_tag(x, GENERIC)
+#define generic_name(x) ((x)->values.generic.name)
+#define generic_methods(x) ((x)->values.generic.methods)
+#define generic_resolved(x) ((x)->values.generic.resolved)
+#define generic_epoch(x) ((x)->values.generic.epoch)
+/* REGEXP: A compiled pattern of `regex-compile' */
+#define is_regexp(x) is_pointer_tag(x, REGEXP)
+#define regexp_program(x) ((x)->values.regexp.program)
+#define regexp_source(x) ((x)->values.regexp.source)
 
 /* utilities */
 /* PAIR */
@@ -300,5 +482,6 @@ typedef struct hash_table_t {
 #define proc1(x) ((proc1_t)primitive_C_proc(x))
 #define proc2(x) ((proc2_t)primitive_C_proc(x))
 #define proc3(x) ((proc3_t)primitive_C_proc(x))
+#define procv(x) ((procv_t)primitive_C_proc(x))
 
 #endif
@@ -0,0 +1,37 @@
+/*
+ * utf8.h
+ *
+ * Kernels on UTF-8 bytes
+ *
+ * Copyright (C) 2013-04-20 liutos <mat.liutos@gmail.com>
+ */
+#ifndef UTF8_H
+#define UTF8_H
+
+#include <stddef.h>
+
+enum simd_level {
+  SIMD_SCALAR,
+  SIMD_SSE2,
+  SIMD_AVX2,
+};
+
+/* The implementations for one instruction set */
+struct utf8_kernels_t {
+  char *name;
+  size_t (*count)(const char *, size_t);
+  int (*validate)(const char *, size_t);
+  int (*compare)(const char *, const char *, size_t);
+  const char *(*search)(const char *, size_t, const char *, size_t);
+};
+
+extern struct utf8_kernels_t utf8_kernels[];
+extern enum simd_level utf8_simd_level;
+
+extern void init_utf8(void);
+extern size_t utf8_count(const char *, size_t);
+extern int utf8_validate(const char *, size_t);
+extern int utf8_compare(const char *, const char *, size_t);
+extern const char *utf8_search(const char *, size_t, const char *, size_t);
+
+#endif
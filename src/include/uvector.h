@@ -0,0 +1,42 @@
+/*
+ * uvector.h
+ *
+ * Homogeneous vectors of raw numbers
+ *
+ * Copyright (C) 2013-04-22 liutos <mat.liutos@gmail.com>
+ */
+#ifndef UVECTOR_H
+#define UVECTOR_H
+
+#include "types.h"
+
+extern sexp make_f64vector_proc(sexp, sexp);
+extern sexp make_s32vector_proc(sexp, sexp);
+extern sexp make_u8vector_proc(sexp, sexp);
+extern sexp f64vector_proc(int, sexp *);
+extern sexp s32vector_proc(int, sexp *);
+extern sexp u8vector_proc(int, sexp *);
+extern sexp uvector_length_as(sexp, char *);
+extern sexp uvector_ref_as(sexp, sexp, char *);
+extern sexp uvector_set_as(sexp, sexp, sexp, char *);
+extern sexp f64vector_length_proc(sexp);
+extern sexp f64vector_ref_proc(sexp, sexp);
+extern sexp f64vector_set_proc(sexp, sexp, sexp);
+extern sexp s32vector_length_proc(sexp);
+extern sexp s32vector_ref_proc(sexp, sexp);
+extern sexp s32vector_set_proc(sexp, sexp, sexp);
+extern sexp u8vector_length_proc(sexp);
+extern sexp u8vector_ref_proc(sexp, sexp);
+extern sexp u8vector_set_proc(sexp, sexp, sexp);
+
+extern sexp uvector_add(sexp, sexp);
+extern sexp uvector_mul(sexp, sexp);
+extern sexp uvector_dot(sexp, sexp);
+extern sexp uvector_sum(sexp);
+extern sexp uvector_min(sexp);
+extern sexp uvector_max(sexp);
+extern sexp uvector_scale(sexp, sexp);
+extern sexp uvector_fill(sexp, sexp);
+extern sexp uvector_copy(sexp);
+
+#endif
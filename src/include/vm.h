@@ -1,7 +1,17 @@
 #ifndef VM_H
 #define VM_H
 
+/* Unboxed doubles of a flonum expression */
+#define FLOAT_STACK_SIZE 16
+
 extern sexp run_compiled_code(sexp, sexp, sexp);
 extern sexp assemble_code(sexp);
+extern void throw_object(sexp, sexp);
+extern sexp call_primitive(sexp, int, sexp *);
+extern sexp vm_apply(sexp, int, sexp *);
+extern sexp map_proc(int, sexp *);
+extern sexp for_each_proc(int, sexp *);
+extern sexp fold_proc(sexp, sexp, sexp);
+extern sexp filter_proc(sexp, sexp);
 
 #endif
@@ -10,6 +10,7 @@
 
 #include "types.h"
 
+extern void write_code_point(int, sexp);
 extern void write_object(lisp_object_t, lisp_object_t);
 extern void port_format(sexp, const char *, ...);
 
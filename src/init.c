@@ -7,9 +7,11 @@
  */
 #include <stdio.h>
 
+#include "class.h"
 #include "compiler.h"
 #include "object.h"
 #include "read.h"
+#include "utf8.h"
 #include "eval.h"
 #include "vm.h"
 #include "write.h"
@@ -39,6 +41,7 @@ void load_init_file(char *path) {
 }
 
 void init_impl(void) {
+  init_utf8();
   objects_heap = init_heap();
   symbol_table = make_symbol_table();
   /* Environment initialization */
@@ -48,7 +51,9 @@ void init_impl(void) {
   repl_environment = make_repl_environment();
 
   root = repl_environment;
-  vm_stack = make_vector(40);
+  vm_stack = make_vector(1024);
+  open_procedures = make_table(HASH_EQ, 8);
+  init_class_parents();
 
   /* input and output port */
   scm_in_port = make_file_in_port(stdin);
@@ -0,0 +1,659 @@
+/*
+ * number.c
+ *
+ * Generic arithmetic on the numeric tower
+ *
+ * Copyright (C) 2013-04-13 liutos <mat.liutos@gmail.com>
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "number.h"
+#include "object.h"
+#include "types.h"
+#include "write.h"
+
+#define DIGIT_BITS 32
+/* Operands shorter than these use the quadratic algorithms */
+#define KARATSUBA_THRESHOLD 32
+#define NEWTON_THRESHOLD 64
+#define CONVERSION_THRESHOLD 64
+/* The decimal digits of a chunk */
+#define CHUNK_BASE 1000000000
+#define CHUNK_DIGITS 9
+
+/* Natural numbers are arrays of digits, the least significant first */
+/* Returns the length of `a' without the leading zeros */
+int nat_length(const uint32_t *a, int n) {
+  while (n > 0 && a[n - 1] == 0) n--;
+  return n;
+}
+
+int nat_compare(const uint32_t *a, int an, const uint32_t *b, int bn) {
+  an = nat_length(a, an);
+  bn = nat_length(b, bn);
+  if (an != bn) return an < bn ? -1: 1;
+  for (int i = an - 1; i >= 0; i--)
+    if (a[i] != b[i]) return a[i] < b[i] ? -1: 1;
+  return 0;
+}
+
+/* r = a + b, where `r' has max(an, bn) + 1 digits */
+void nat_add(uint32_t *r, const uint32_t *a, int an, const uint32_t *b, int bn) {
+  if (an < bn) {
+    const uint32_t *t = a; a = b; b = t;
+    int n = an; an = bn; bn = n;
+  }
+  uint64_t carry = 0;
+  int i = 0;
+  for (; i < bn; i++) {
+    carry += (uint64_t)a[i] + b[i];
+    r[i] = carry;
+    carry >>= DIGIT_BITS;
+  }
+  for (; i < an; i++) {
+    carry += a[i];
+    r[i] = carry;
+    carry >>= DIGIT_BITS;
+  }
+  r[an] = carry;
+}
+
+/* r = a - b, where a >= b and `r' may be `a' */
+void nat_sub(uint32_t *r, const uint32_t *a, int an, const uint32_t *b, int bn) {
+  uint64_t borrow = 0;
+  int i = 0;
+  for (; i < bn; i++) {
+    uint64_t t = (uint64_t)a[i] - b[i] - borrow;
+    r[i] = t;
+    borrow = t >> 63;
+  }
+  for (; i < an; i++) {
+    uint64_t t = (uint64_t)a[i] - borrow;
+    r[i] = t;
+    borrow = t >> 63;
+  }
+}
+
+/* a += b, where the sum fits in the `an' digits */
+void nat_add_into(uint32_t *a, int an, const uint32_t *b, int bn) {
+  uint64_t carry = 0;
+  int i = 0;
+  bn = nat_length(b, bn);
+  for (; i < bn; i++) {
+    carry += (uint64_t)a[i] + b[i];
+    a[i] = carry;
+    carry >>= DIGIT_BITS;
+  }
+  for (; carry != 0 && i < an; i++) {
+    carry += a[i];
+    a[i] = carry;
+    carry >>= DIGIT_BITS;
+  }
+}
+
+/* r = a * b by the schoolbook method, `r' has an + bn digits */
+void nat_mul_school(uint32_t *r, const uint32_t *a, int an, const uint32_t *b, int bn) {
+  memset(r, 0, (an + bn) * sizeof(uint32_t));
+  for (int i = 0; i < an; i++) {
+    if (a[i] == 0) continue;
+    uint64_t carry = 0;
+    for (int j = 0; j < bn; j++) {
+      carry += (uint64_t)a[i] * b[j] + r[i + j];
+      r[i + j] = carry;
+      carry >>= DIGIT_BITS;
+    }
+    r[i + bn] = carry;
+  }
+}
+
+/* r = a * b, where `r' has an + bn digits. Above the threshold the
+   operands are split in halves and multiplied by Karatsuba's method. */
+void nat_mul(uint32_t *r, const uint32_t *a, int an, const uint32_t *b, int bn) {
+  if (an < bn) {
+    const uint32_t *t = a; a = b; b = t;
+    int n = an; an = bn; bn = n;
+  }
+  if (bn < KARATSUBA_THRESHOLD) {
+    nat_mul_school(r, a, an, b, bn);
+    return;
+  }
+  if (2 * bn <= an) {
+    /* Unbalanced: multiplies `b' by the slices of `a' */
+    uint32_t *t = malloc(2 * bn * sizeof(uint32_t));
+    memset(r, 0, (an + bn) * sizeof(uint32_t));
+    for (int i = 0; i < an; i += bn) {
+      int n = an - i < bn ? an - i: bn;
+      nat_mul(t, a + i, n, b, bn);
+      nat_add_into(r + i, an + bn - i, t, n + bn);
+    }
+    free(t);
+    return;
+  }
+  /* a = a1 B^h + a0 and b = b1 B^h + b0 */
+  int h = an / 2;
+  int sn = an - h + 1;
+  int tn = bn - h > h ? bn - h + 1: h + 1;
+  uint32_t *sa = malloc(sn * sizeof(uint32_t));
+  uint32_t *sb = malloc(tn * sizeof(uint32_t));
+  uint32_t *z1 = malloc((sn + tn) * sizeof(uint32_t));
+  nat_mul(r, a, h, b, h);
+  nat_mul(r + 2 * h, a + h, an - h, b + h, bn - h);
+  nat_add(sa, a + h, an - h, a, h);
+  nat_add(sb, b + h, bn - h, b, h);
+  /* z1 = (a0 + a1)(b0 + b1) - a0 b0 - a1 b1 */
+  nat_mul(z1, sa, sn, sb, tn);
+  int zn = nat_length(z1, sn + tn);
+  nat_sub(z1, z1, zn, r, nat_length(r, 2 * h));
+  nat_sub(z1, z1, zn, r + 2 * h, nat_length(r + 2 * h, an + bn - 2 * h));
+  nat_add_into(r + h, an + bn - h, z1, zn);
+  free(sa);
+  free(sb);
+  free(z1);
+}
+
+/* q = a / d, returns the remainder */
+uint32_t nat_divmod_digit(uint32_t *q, const uint32_t *a, int an, uint32_t d) {
+  uint64_t rem = 0;
+  for (int i = an - 1; i >= 0; i--) {
+    rem = (rem << DIGIT_BITS) | a[i];
+    q[i] = rem / d;
+    rem %= d;
+  }
+  return rem;
+}
+
+/* q = a / b and r = a % b by Knuth's algorithm D, where an >= bn > 1 and
+   the top digit of `b' is not zero. `q' has an - bn + 1 digits and `r' has bn. */
+void nat_divmod(uint32_t *q, uint32_t *r, const uint32_t *a, int an, const uint32_t *b, int bn) {
+  int s = __builtin_clz(b[bn - 1]);
+  uint32_t *vn = malloc(bn * sizeof(uint32_t));
+  uint32_t *un = malloc((an + 1) * sizeof(uint32_t));
+  /* Normalizes so that the top digit of the divisor has its high bit set */
+  for (int i = bn - 1; i > 0; i--)
+    vn[i] = (b[i] << s) | (uint32_t)((uint64_t)b[i - 1] >> (DIGIT_BITS - s));
+  vn[0] = b[0] << s;
+  un[an] = (uint64_t)a[an - 1] >> (DIGIT_BITS - s);
+  for (int i = an - 1; i > 0; i--)
+    un[i] = (a[i] << s) | (uint32_t)((uint64_t)a[i - 1] >> (DIGIT_BITS - s));
+  un[0] = a[0] << s;
+
+  for (int j = an - bn; j >= 0; j--) {
+    uint64_t num = ((uint64_t)un[j + bn] << DIGIT_BITS) | un[j + bn - 1];
+    uint64_t qhat = num / vn[bn - 1];
+    uint64_t rhat = num % vn[bn - 1];
+    while (qhat >> DIGIT_BITS ||
+           qhat * vn[bn - 2] > ((rhat << DIGIT_BITS) | un[j + bn - 2])) {
+      qhat--;
+      rhat += vn[bn - 1];
+      if (rhat >> DIGIT_BITS) break;
+    }
+    /* Multiplies and subtracts */
+    int64_t k = 0, t;
+    for (int i = 0; i < bn; i++) {
+      uint64_t p = qhat * vn[i];
+      t = un[i + j] - k - (p & 0xFFFFFFFF);
+      un[i + j] = t;
+      k = (p >> DIGIT_BITS) - (t >> DIGIT_BITS);
+    }
+    t = un[j + bn] - k;
+    un[j + bn] = t;
+    q[j] = qhat;
+    if (t < 0) {
+      /* Adds back */
+      q[j]--;
+      uint64_t c = 0;
+      for (int i = 0; i < bn; i++) {
+        c += (uint64_t)un[i + j] + vn[i];
+        un[i + j] = c;
+        c >>= DIGIT_BITS;
+      }
+      un[j + bn] += c;
+    }
+  }
+  for (int i = 0; i < bn - 1; i++)
+    r[i] = (un[i] >> s) | (uint32_t)((uint64_t)un[i + 1] << (DIGIT_BITS - s));
+  r[bn - 1] = un[bn - 1] >> s;
+  free(vn);
+  free(un);
+}
+
+/* Integers */
+/* Returns the number of digits enough for the magnitude of integer `n' */
+int integer_length(sexp n) {
+  return is_fixnum(n) ? 2: bignum_length(n);
+}
+
+/* Returns the length of the magnitude of integer `n' and sets `digits' and
+   `sign'. The digits of a fixnum are put in `buf'. No object is allocated
+   while `digits' is in use, because a collection may free it. */
+int integer_digits(sexp n, uint32_t *buf, uint32_t **digits, int *sign) {
+  if (is_fixnum(n)) {
+    long long v = fixnum_value(n);
+    unsigned long long m = v < 0 ? -(unsigned long long)v: v;
+    buf[0] = m;
+    buf[1] = m >> DIGIT_BITS;
+    *digits = buf;
+    *sign = v < 0 ? -1: 1;
+    return nat_length(buf, 2);
+  }
+  *digits = bignum_digits(n);
+  *sign = bignum_sign(n);
+  return bignum_length(n);
+}
+
+/* Strips the leading zeros of `n', which is a fixnum if it fits */
+sexp integer_normalize(sexp n) {
+  int length = nat_length(bignum_digits(n), bignum_length(n));
+  bignum_length(n) = length;
+  if (length <= 2) {
+    uint32_t *d = bignum_digits(n);
+    unsigned long long m = length == 0 ? 0: d[0];
+    if (length == 2) m |= (unsigned long long)d[1] << DIGIT_BITS;
+    if (m <= (unsigned long long)FIXNUM_MAX)
+      return make_fixnum(bignum_sign(n) * (long long)m);
+    if (bignum_sign(n) < 0 && m == (unsigned long long)FIXNUM_MAX + 1)
+      return make_fixnum(FIXNUM_MIN);
+  }
+  return n;
+}
+
+/* Makes an exact integer, which is a bignum if out of the range of fixnum */
+sexp make_integer(long long n) {
+  if (is_fixnum_range(n)) return make_fixnum(n);
+  sexp big = make_bignum(2);
+  unsigned long long m = n < 0 ? -(unsigned long long)n: n;
+  bignum_digits(big)[0] = m;
+  bignum_digits(big)[1] = m >> DIGIT_BITS;
+  bignum_sign(big) = n < 0 ? -1: 1;
+  return big;
+}
+
+int is_integer(sexp n) {
+  return is_fixnum(n) || is_bignum(n);
+}
+
+int integer_compare(sexp n1, sexp n2) {
+  uint32_t b1[2], b2[2], *d1, *d2;
+  int s1, s2;
+  int l1 = integer_digits(n1, b1, &d1, &s1);
+  int l2 = integer_digits(n2, b2, &d2, &s2);
+  if (l1 == 0) s1 = 1;
+  if (l2 == 0) s2 = 1;
+  if (s1 != s2) return s1 < s2 ? -1: 1;
+  return s1 * nat_compare(d1, l1, d2, l2);
+}
+
+/* n1 + n2 if `sign' is 1, n1 - n2 if it is -1 */
+sexp integer_add_sign(sexp n1, sexp n2, int sign) {
+  int l1 = integer_length(n1), l2 = integer_length(n2);
+  sexp r = make_bignum((l1 > l2 ? l1: l2) + 1);
+  uint32_t b1[2], b2[2], *d1, *d2;
+  int s1, s2;
+  l1 = integer_digits(n1, b1, &d1, &s1);
+  l2 = integer_digits(n2, b2, &d2, &s2);
+  s2 *= sign;
+  if (s1 == s2) {
+    nat_add(bignum_digits(r), d1, l1, d2, l2);
+    bignum_sign(r) = s1;
+  } else if (nat_compare(d1, l1, d2, l2) >= 0) {
+    nat_sub(bignum_digits(r), d1, l1, d2, l2);
+    bignum_sign(r) = s1;
+  } else {
+    nat_sub(bignum_digits(r), d2, l2, d1, l1);
+    bignum_sign(r) = s2;
+  }
+  return integer_normalize(r);
+}
+
+sexp integer_add(sexp n1, sexp n2) {
+  return integer_add_sign(n1, n2, 1);
+}
+
+sexp integer_sub(sexp n1, sexp n2) {
+  return integer_add_sign(n1, n2, -1);
+}
+
+sexp integer_mul(sexp n1, sexp n2) {
+  sexp r = make_bignum(integer_length(n1) + integer_length(n2));
+  uint32_t b1[2], b2[2], *d1, *d2;
+  int s1, s2;
+  int l1 = integer_digits(n1, b1, &d1, &s1);
+  int l2 = integer_digits(n2, b2, &d2, &s2);
+  if (l1 > 0 && l2 > 0)
+    nat_mul(bignum_digits(r), d1, l1, d2, l2);
+  bignum_sign(r) = s1 * s2;
+  return integer_normalize(r);
+}
+
+/* Truncating division: sets the quotient `q' and the remainder `r', whose
+   sign is the sign of the dividend */
+void integer_divmod(sexp n1, sexp n2, sexp *q, sexp *r) {
+  if (n2 == make_fixnum(0)) {
+    port_format(scm_err_port, "Division by zero\n");
+    exit(1);
+  }
+  if (are_fixnums(n1, n2)) {
+    *q = make_integer((long long)fixnum_value(n1) / fixnum_value(n2));
+    *r = make_fixnum(fixnum_value(n1) % fixnum_value(n2));
+    return;
+  }
+  uint32_t b1[2], b2[2], *d1, *d2;
+  int s1, s2;
+  int l1 = integer_digits(n1, b1, &d1, &s1);
+  int l2 = integer_digits(n2, b2, &d2, &s2);
+  if (l1 < l2) {
+    *q = make_fixnum(0);
+    *r = n1;
+    return;
+  }
+  sexp quo = make_bignum(l1 - l2 + 1);
+  sexp rem = make_bignum(l2);
+  /* Fetches the digits again, which keeps `n1' and `n2' referenced */
+  l1 = integer_digits(n1, b1, &d1, &s1);
+  l2 = integer_digits(n2, b2, &d2, &s2);
+  if (l2 == 1)
+    bignum_digits(rem)[0] = nat_divmod_digit(bignum_digits(quo), d1, l1, d2[0]);
+  else
+    nat_divmod(bignum_digits(quo), bignum_digits(rem), d1, l1, d2, l2);
+  bignum_sign(quo) = s1 * s2;
+  bignum_sign(rem) = s1;
+  *q = integer_normalize(quo);
+  *r = integer_normalize(rem);
+}
+
+/* n * B^k, or the quotient of n / B^-k if `k' is negative */
+sexp integer_shift(sexp n, int k) {
+  int length = integer_length(n) + k;
+  if (length <= 0) return make_fixnum(0);
+  sexp r = make_bignum(length);
+  uint32_t buf[2], *d;
+  int sign;
+  int l = integer_digits(n, buf, &d, &sign);
+  if (k >= 0)
+    memcpy(bignum_digits(r) + k, d, l * sizeof(uint32_t));
+  else if (l + k > 0)
+    memcpy(bignum_digits(r), d - k, (l + k) * sizeof(uint32_t));
+  bignum_sign(r) = sign;
+  return integer_normalize(r);
+}
+
+/* Returns the double nearest to integer `n' */
+double integer_to_double(sexp n) {
+  if (is_fixnum(n)) return fixnum_value(n);
+  double x = 0;
+  for (int i = bignum_length(n) - 1; i >= 0; i--)
+    x = x * 4294967296.0 + bignum_digits(n)[i];
+  return bignum_sign(n) * x;
+}
+
+/* Returns floor(B^2m / d), where `d' is a positive bignum of `m' digits.
+   The reciprocal of the upper half of `d' is improved by one step of
+   Newton's iteration and then corrected by a few units. */
+sexp integer_reciprocal(sexp d) {
+  int m = bignum_length(d);
+  sexp one = make_fixnum(1);
+  sexp q, r;
+  if (m <= NEWTON_THRESHOLD) {
+    integer_divmod(integer_shift(one, 2 * m), d, &q, &r);
+    return q;
+  }
+  int h = m / 2 + 2;
+  sexp x = integer_shift(integer_reciprocal(integer_shift(d, h - m)), m - h);
+  sexp e = integer_sub(integer_shift(one, 2 * m), integer_mul(d, x));
+  x = integer_add(x, integer_shift(integer_mul(x, e), -2 * m));
+  r = integer_sub(integer_shift(one, 2 * m), integer_mul(d, x));
+  while (integer_compare(r, make_fixnum(0)) < 0) {
+    x = integer_sub(x, one);
+    r = integer_add(r, d);
+  }
+  while (integer_compare(r, d) >= 0) {
+    x = integer_add(x, one);
+    r = integer_sub(r, d);
+  }
+  return x;
+}
+
+/* Barrett's division of `n' < B^2m by `d' of `m' digits, whose reciprocal is `recip' */
+void integer_divmod_barrett(sexp n, sexp d, sexp recip, sexp *q, sexp *r) {
+  int m = bignum_length(d);
+  sexp one = make_fixnum(1);
+  *q = integer_shift(integer_mul(n, recip), -2 * m);
+  *r = integer_sub(n, integer_mul(*q, d));
+  while (integer_compare(*r, d) >= 0) {
+    *q = integer_add(*q, one);
+    *r = integer_sub(*r, d);
+  }
+}
+
+/* Decimal conversion */
+struct decimal_t {
+  char *buffer;
+  int length;
+  sexp *powers;                         /* powers[k] = 10^(9 * 2^k) */
+  sexp *reciprocals;
+};
+
+/* Appends the digits of the natural `n', padded with zeros to `width' if it is not zero */
+void decimal_small(struct decimal_t *dec, sexp n, int width) {
+  uint32_t buf[2], *d;
+  int sign;
+  int l = integer_digits(n, buf, &d, &sign);
+  uint32_t *t = malloc((l + 1) * sizeof(uint32_t));
+  uint32_t *chunks = malloc((l * 10 / 9 + 2) * sizeof(uint32_t));
+  int nchunks = 0;
+  memcpy(t, d, l * sizeof(uint32_t));
+  while (l > 0) {
+    chunks[nchunks++] = nat_divmod_digit(t, t, l, CHUNK_BASE);
+    l = nat_length(t, l);
+  }
+  char *s = dec->buffer + dec->length;
+  int n_digits = 0;
+  if (nchunks > 0)
+    n_digits = sprintf(s, "%u", chunks[--nchunks]);
+  while (nchunks > 0)
+    n_digits += sprintf(s + n_digits, "%09u", chunks[--nchunks]);
+  if (n_digits < width) {
+    memmove(s + width - n_digits, s, n_digits);
+    memset(s, '0', width - n_digits);
+    n_digits = width;
+  }
+  dec->length += n_digits;
+  free(t);
+  free(chunks);
+}
+
+/* Appends the digits of the natural `n' < powers[k]^2 by splitting it at powers[k] */
+void decimal_split(struct decimal_t *dec, sexp n, int k, int width) {
+  if (k < 0 || integer_length(n) <= CONVERSION_THRESHOLD) {
+    decimal_small(dec, n, width);
+    return;
+  }
+  if (width == 0 && integer_compare(n, dec->powers[k]) < 0) {
+    decimal_split(dec, n, k - 1, 0);
+    return;
+  }
+  sexp q, r;
+  int low = CHUNK_DIGITS << k;
+  if (dec->reciprocals[k] == NULL)
+    dec->reciprocals[k] = integer_reciprocal(dec->powers[k]);
+  integer_divmod_barrett(n, dec->powers[k], dec->reciprocals[k], &q, &r);
+  decimal_split(dec, q, k - 1, width > 0 ? width - low: 0);
+  decimal_split(dec, r, k - 1, low);
+}
+
+/* Returns the decimal representation of integer `n' in a string to be freed */
+char *integer_to_string(sexp n) {
+  int length = integer_length(n);
+  /* A digit of base 2^32 is less than 10 decimal digits */
+  char *buffer = malloc(length * 10 + 2);
+  struct decimal_t dec = {buffer, 0, NULL, NULL};
+  if (integer_compare(n, make_fixnum(0)) < 0) {
+    buffer[dec.length++] = '-';
+    n = integer_sub(make_fixnum(0), n);
+  }
+  if (n == make_fixnum(0))
+    buffer[dec.length++] = '0';
+  else {
+    /* The powers are on the C stack, where the collector can find them */
+    sexp powers[32], reciprocals[32];
+    int k = 0;
+    powers[0] = make_integer(CHUNK_BASE);
+    reciprocals[0] = NULL;
+    while (integer_length(powers[k]) * 2 <= length + 1) {
+      powers[k + 1] = integer_mul(powers[k], powers[k]);
+      reciprocals[k + 1] = NULL;
+      k++;
+    }
+    dec.powers = powers;
+    dec.reciprocals = reciprocals;
+    decimal_split(&dec, n, k, 0);
+  }
+  buffer[dec.length] = '\0';
+  return buffer;
+}
+
+/* 10^e */
+sexp integer_power10(int e) {
+  sexp r = make_fixnum(1), b = make_fixnum(10);
+  for (; e > 0; e >>= 1) {
+    if (e & 1) r = integer_mul(r, b);
+    if (e > 1) b = integer_mul(b, b);
+  }
+  return r;
+}
+
+/* Returns the integer of the `n' decimal digits in `s'. The halves are
+   converted separately and combined by one multiplication. */
+sexp string_to_integer(char *s, int n) {
+  if (n <= CHUNK_DIGITS * CONVERSION_THRESHOLD) {
+    sexp r = make_bignum(n / CHUNK_DIGITS + 2);
+    uint32_t *d = bignum_digits(r);
+    int length = 0;
+    for (int i = 0; i < n;) {
+      uint32_t chunk = 0, scale = 1;
+      for (int j = 0; j < CHUNK_DIGITS && i < n; j++, i++) {
+        chunk = chunk * 10 + s[i] - '0';
+        scale *= 10;
+      }
+      /* d = d * scale + chunk */
+      uint64_t carry = chunk;
+      for (int j = 0; j < length; j++) {
+        carry += (uint64_t)d[j] * scale;
+        d[j] = carry;
+        carry >>= DIGIT_BITS;
+      }
+      if (carry != 0) d[length++] = carry;
+    }
+    return integer_normalize(r);
+  }
+  int low = n / 2;
+  sexp high = string_to_integer(s, n - low);
+  return integer_add(integer_mul(high, integer_power10(low)),
+                     string_to_integer(s + n - low, low));
+}
+
+/* Returns the value of the real `n' as a double, `op' is for reporting */
+double real_value(sexp n, char *op) {
+  if (is_fixnum(n)) return fixnum_value(n);
+  if (is_bignum(n)) return integer_to_double(n);
+  if (is_float(n)) return float_value(n);
+  port_format(scm_err_port, "%s: Wrong type argument %*\n", make_string(op), n);
+  exit(1);
+}
+
+/* Checks that `n' is an integer, `op' is for reporting */
+void check_integer(sexp n, char *op) {
+  if (is_integer(n)) return;
+  port_format(scm_err_port, "%s: Wrong type argument %*\n", make_string(op), n);
+  exit(1);
+}
+
+/* The following are the slow paths of the generic instructions, which
+   also handle the fixnums */
+sexp number_add(sexp n1, sexp n2) {
+  if (are_fixnums(n1, n2))
+    return make_integer((long long)fixnum_value(n1) + fixnum_value(n2));
+  if (is_integer(n1) && is_integer(n2))
+    return integer_add(n1, n2);
+  return make_flonum(real_value(n1, "+") + real_value(n2, "+"));
+}
+
+sexp number_sub(sexp n1, sexp n2) {
+  if (are_fixnums(n1, n2))
+    return make_integer((long long)fixnum_value(n1) - fixnum_value(n2));
+  if (is_integer(n1) && is_integer(n2))
+    return integer_sub(n1, n2);
+  return make_flonum(real_value(n1, "-") - real_value(n2, "-"));
+}
+
+sexp number_mul(sexp n1, sexp n2) {
+  long long r;
+  if (are_fixnums(n1, n2) &&
+      !__builtin_mul_overflow(fixnum_value(n1), fixnum_value(n2), &r))
+    return make_integer(r);
+  if (is_integer(n1) && is_integer(n2))
+    return integer_mul(n1, n2);
+  return make_flonum(real_value(n1, "*") * real_value(n2, "*"));
+}
+
+/* The quotient of two integers is exact only if it is an integer */
+sexp number_div(sexp n1, sexp n2) {
+  if (is_integer(n1) && is_integer(n2)) {
+    sexp q, r;
+    integer_divmod(n1, n2, &q, &r);
+    if (r == make_fixnum(0)) return q;
+  }
+  return make_flonum(real_value(n1, "/") / real_value(n2, "/"));
+}
+
+sexp number_quotient(sexp n1, sexp n2) {
+  sexp q, r;
+  check_integer(n1, "quotient");
+  check_integer(n2, "quotient");
+  integer_divmod(n1, n2, &q, &r);
+  return q;
+}
+
+sexp number_remainder(sexp n1, sexp n2) {
+  sexp q, r;
+  check_integer(n1, "remainder");
+  check_integer(n2, "remainder");
+  integer_divmod(n1, n2, &q, &r);
+  return r;
+}
+
+/* The sign of the modulo is the sign of the divisor */
+sexp number_modulo(sexp n1, sexp n2) {
+  sexp r = number_remainder(n1, n2);
+  sexp zero = make_fixnum(0);
+  if (r != zero && (integer_compare(r, zero) < 0) != (integer_compare(n2, zero) < 0))
+    r = integer_add(r, n2);
+  return r;
+}
+
+/* Returns -1, 0 or 1 as `n1' is less than, equal to or greater than `n2' */
+int number_compare(sexp n1, sexp n2, char *op) {
+  if (is_integer(n1) && is_integer(n2))
+    return integer_compare(n1, n2);
+  double x1 = real_value(n1, op), x2 = real_value(n2, op);
+  return x1 < x2 ? -1: x1 > x2;
+}
+
+sexp number_lt(sexp n1, sexp n2) {
+  return number_compare(n1, n2, "<") < 0 ? true_object: false_object;
+}
+
+sexp number_eq(sexp n1, sexp n2) {
+  return number_compare(n1, n2, "=") == 0 ? true_object: false_object;
+}
+
+sexp number_gt(sexp n1, sexp n2) {
+  return number_compare(n1, n2, ">") > 0 ? true_object: false_object;
+}
+
+sexp number_to_string(sexp n) {
+  check_integer(n, "number->string");
+  /* The string keeps the buffer */
+  return make_string(integer_to_string(n));
+}
@@ -6,23 +6,31 @@
  * Copyright (C) 2013-03-17 liutos <mat.liutos@gmail.com>
  */
 #include <assert.h>
+#include <limits.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "object.h"
+#include "regexp.h"
 #include "types.h"
+#include "utf8.h"
 #include "write.h"
 
 #define HEAP_SIZE 1000
+#define MAX_CHUNKS 32
+#define STACK_LIMIT (1 << 24)
 
 extern char port_read_char(sexp);
+extern void signal_stack_overflow(void);
+/* The highest address of the C stack, provided by glibc */
+extern void *__libc_stack_end;
 
 void mark(sexp);
 int nzero(char);
 
-int alloc_count;
+size_t alloc_count;
 int mark_count;
 hash_table_t symbol_table;
 /*
@@ -40,20 +48,35 @@ sexp scm_err_port;
 sexp scm_in_port;
 sexp scm_out_port;
 /*
- * objects_heap: A large consecutive memory for allocating Lisp objects
+ * objects_heap: The first chunk of the heap
+ * heap_chunks: Consecutive memories for allocating Lisp objects, each
+ * one is as large as all the previous ones
  * free_objects: A linked list contains all unused memory cell
- * used_objects: A linked list contains all allocated objects
  */
 struct lisp_object_t *objects_heap;
+struct lisp_object_t *heap_chunks[MAX_CHUNKS];
+size_t chunk_sizes[MAX_CHUNKS];
+int chunk_count;
+size_t heap_size;
 struct lisp_object_t *free_objects;
 sexp root;
 sexp vm_stack;
+/*
+ * open_procedures: The procedures whose calls the compiler opens, by name,
+ * which are record procedures and generic functions
+ * class_parents: The superclass of a class, `object' when absent
+ */
+sexp open_procedures;
+sexp class_parents;
+/* The maximum number of slots of the VM stack */
+unsigned int vm_stack_limit = STACK_LIMIT;
 
 /* Memory management */
 void mark_compiled_proc(sexp proc) {
   mark(compiled_proc_args(proc));
   mark(compiled_proc_code(proc));
   mark(compiled_proc_env(proc));
+  mark(compiled_proc_bytecode(proc));
 }
 
 void mark_compound_proc(sexp proc) {
@@ -67,60 +90,217 @@ void mark_env(sexp env) {
   mark(environment_outer(env));
 }
 
-void mark_pair(sexp pair) {
-  mark(pair_car(pair));
-  mark(pair_cdr(pair));
-}
-
 void mark_return_info(sexp ri) {
   mark(return_code(ri));
   mark(return_env(ri));
 }
 
+void mark_frame(sexp frame) {
+  for (int i = 0; i < frame_size(frame); i++)
+    mark(frame_slot(frame, i));
+  mark(frame_outer(frame));
+}
+
+void mark_table(sexp table) {
+  for (unsigned int i = 0; i < table_size(table); i++) {
+    struct hash_slot *slot = &table_slots(table)[i];
+    if (is_live_slot(slot)) {
+      mark(slot->key);
+      mark(slot->value);
+    }
+  }
+}
+
+void mark_hamt_node(sexp node) {
+  for (int i = 0; i < 2 * node_length(node); i++)
+    mark(node_array(node)[i]);
+  mark(node_edit(node));
+}
+
+/* Marks the slots of `record' but one, which is returned to be marked by
+   iteration. It is the last slot holding a record if any, so that a long
+   chain of records does not overflow the C stack. */
+sexp mark_record(sexp record) {
+  int n = record_type_size(record_type(record));
+  int next = n - 1;
+  for (int i = n - 1; i >= 0; i--)
+    if (is_record(record_slot(record, i))) {
+      next = i;
+      break;
+    }
+  mark(record_type(record));
+  for (int i = 0; i < n; i++)
+    if (i != next)
+      mark(record_slot(record, i));
+  return next < 0 ? NULL: record_slot(record, next);
+}
+
+void mark_generic(sexp generic) {
+  mark(generic_name(generic));
+  mark(generic_methods(generic));
+  mark(generic_resolved(generic));
+}
+
+void mark_vector(sexp vector) {
+  for (int i = 0; i < vector_pos(vector); i++)
+    mark(vector_data_at(vector, i));
+}
+
 /* Set an object's gc_mark as used. */
 void mark(sexp obj) {
+tail_loop:
   if (!obj || !is_pointer(obj) || obj->gc_mark == yes) return;
   obj->gc_mark = yes;
   mark_count++;
   if (is_compiled_proc(obj))
     mark_compiled_proc(obj);
-  else if (is_compound(obj))
+  else if (is_compound(obj) || is_macro(obj))
     mark_compound_proc(obj);
   else if (is_environment(obj))
     mark_env(obj);
-  else if (is_pair(obj))
-    mark_pair(obj);
-  else if (is_return_info(obj))
+  else if (is_pair(obj)) {
+    /* Iterates along the cdr so that a long list does not overflow the C stack */
+    mark(pair_car(obj));
+    obj = pair_cdr(obj);
+    goto tail_loop;
+  } else if (is_return_info(obj))
     mark_return_info(obj);
+  else if (is_vector(obj))
+    mark_vector(obj);
+  else if (is_hash_table(obj))
+    mark_table(obj);
+  else if (is_hamt_node(obj))
+    mark_hamt_node(obj);
+  else if (is_hamt(obj)) {
+    mark(hamt_edit(obj));
+    obj = hamt_root(obj);
+    goto tail_loop;
+  }
+  else if (is_frame(obj))
+    mark_frame(obj);
+  else if (is_record(obj)) {
+    obj = mark_record(obj);
+    goto tail_loop;
+  }
+  else if (is_generic(obj))
+    mark_generic(obj);
+  else if (is_regexp(obj))
+    mark(regexp_source(obj));
+  else if (is_record_type(obj)) {
+    mark(record_type_name(obj));
+    obj = record_type_fields(obj);
+    goto tail_loop;
+  }
+  else if (is_box(obj)) {
+    obj = box_value(obj);
+    goto tail_loop;
+  } else if (is_uvector(obj)) {
+    obj = uvector_parent(obj);
+    goto tail_loop;
+  }
 }
 
-void scan_heap(void) {
-  for (int i = 0; i < HEAP_SIZE; i++) {
-    sexp obj = &objects_heap[i];
-    /* Reclaim the object which is used but not marked. */
-    if (obj->is_used == yes && obj->gc_mark == no) {
-      port_format(scm_out_port, "Reclaiming %*\n", obj);
-      obj->next = free_objects;
-      free_objects = obj;
-      obj->is_used = no;
-      alloc_count--;
-    } else
-      obj->gc_mark = no;
+/* Is `p' the address of an allocated object? */
+int is_heap_object(void *p) {
+  for (int i = 0; i < chunk_count; i++) {
+    struct lisp_object_t *chunk = heap_chunks[i];
+    if ((void *)chunk <= p && p < (void *)(chunk + chunk_sizes[i]))
+      return ((char *)p - (char *)chunk) % sizeof(struct lisp_object_t) == 0 &&
+          ((sexp)p)->is_used == yes;
   }
-  printf("GC is Done!\n");
-  scm_in_port->gc_mark = yes;
-  scm_out_port->gc_mark = yes;
-  scm_err_port->gc_mark = yes;
+  return no;
+}
+
+void __attribute__((noinline, no_sanitize_address)) scan_C_stack(void) {
+  void *top = &top;
+  for (sexp *p = top; (void *)p < __libc_stack_end; p++)
+    if (is_heap_object(*p))
+      mark(*p);
+}
+
+/* The objects referenced only by the C local variables are kept conservatively */
+void mark_C_stack(void) {
+  /* Spills the callee-saved registers onto the stack */
+  __builtin_unwind_init();
+  scan_C_stack();
+}
+
+void mark_symbol_table(void) {
+  for (int i = 0; i < symbol_table->size; i++)
+    for (table_entry_t e = symbol_table->datum[i]; e != NULL; e = e->next)
+      mark(e->value);
+}
+
+void reclaim(sexp obj) {
+  if (is_vector(obj))
+    free(vector_datum(obj));
+  else if (is_string(obj))
+    free(string_index(obj));
+  else if (is_frame(obj) && frame_size(obj) > FRAME_INLINE_SLOTS)
+    free(frame_slots(obj));
+  else if (is_bignum(obj))
+    free(bignum_digits(obj));
+  else if (is_uvector(obj) && uvector_parent(obj) == NULL)
+    free(uvector_data(obj));
+  else if (is_hash_table(obj))
+    free(table_slots(obj));
+  else if (is_hamt_node(obj))
+    free(node_array(obj));
+  else if (is_record(obj) && record_slots(obj) != obj->values.record.inline_slots)
+    free(record_slots(obj));
+  else if (is_regexp(obj))
+    free_regexp(regexp_program(obj));
+  obj->next = free_objects;
+  free_objects = obj;
+  obj->is_used = no;
+  alloc_count--;
+}
+
+void scan_heap(void) {
+  for (int i = 0; i < chunk_count; i++)
+    for (size_t j = 0; j < chunk_sizes[i]; j++) {
+      sexp obj = &heap_chunks[i][j];
+      /* Reclaim the object which is used but not marked. */
+      if (obj->is_used == yes && obj->gc_mark == no)
+        reclaim(obj);
+      else
+        obj->gc_mark = no;
+    }
   mark_count = 0;
 }
 
+/* Links the objects of a new chunk into the free list */
+void add_heap_chunk(size_t size) {
+  if (chunk_count == MAX_CHUNKS) return;
+  struct lisp_object_t *chunk = calloc(size, sizeof(struct lisp_object_t));
+  if (chunk == NULL) return;
+  for (size_t i = 0; i < size - 1; i++)
+    chunk[i].next = &chunk[i + 1];
+  chunk[size - 1].next = free_objects;
+  free_objects = chunk;
+  heap_chunks[chunk_count] = chunk;
+  chunk_sizes[chunk_count] = size;
+  chunk_count++;
+  heap_size += size;
+}
+
 /* Mark and sweep */
 void trigger_gc(void) {
   mark(root);
-  printf("alloc_count: %d\n", alloc_count);
-  printf("mark_count: %d\n", mark_count);
-  /* exit(1); */
+  mark(global_env);
+  mark(startup_environment);
+  mark(vm_stack);
+  mark(open_procedures);
+  mark(class_parents);
+  mark(scm_in_port);
+  mark(scm_out_port);
+  mark(scm_err_port);
+  mark_symbol_table();
+  mark_C_stack();
   scan_heap();
+  /* Grows the heap when more than half of it is alive */
+  if (alloc_count > heap_size / 2)
+    add_heap_chunk(heap_size);
 }
 
 sexp alloc_object(enum object_type type) {
@@ -140,14 +320,8 @@ sexp alloc_object(enum object_type type) {
 }
 
 struct lisp_object_t *init_heap(void) {
-  struct lisp_object_t *heap =
-      calloc(HEAP_SIZE, sizeof(struct lisp_object_t));
-  /* memset(heap, '\0', HEAP_SIZE * sizeof(struct lisp_object_t)); */
-  for (int i = 0; i < HEAP_SIZE; i++)
-    heap[i].next = &(heap[i + 1]);
-  heap[HEAP_SIZE - 1].next = NULL;
-  free_objects = heap;
-  return heap;
+  add_heap_chunk(HEAP_SIZE);
+  return heap_chunks[0];
 }
 
 /* Constructors */
@@ -161,13 +335,23 @@ sexp make_true(void) { return true_object; }
 sexp make_undefined(void) { return undefined_object; }
 
 /* Tagged pointer data types with rule */
-sexp make_fixnum(int value) { return to_fixnum(value); }
-sexp make_character(char c) { return to_char(c); }
+sexp make_fixnum(intptr_t value) { return to_fixnum(value); }
+sexp make_character(int c) { return to_char(c); }
 
 /* Tagged union data types */
+/* Counts the characters of `s', which are all ASCII if there are as many
+   as bytes */
+void string_measure(sexp s) {
+  string_byte_length(s) = strlen(string_value(s));
+  string_length(s) = utf8_count(string_value(s), string_byte_length(s));
+  string_is_ascii(s) = string_length(s) == string_byte_length(s);
+}
+
 sexp make_string(char *str) {
   sexp string = alloc_object(STRING);
-  string->values.string.value = str;
+  string_value(string) = str;
+  string_measure(string);
+  string_index(string) = NULL;
   return string;
 }
 
@@ -197,12 +381,76 @@ sexp make_file_out_port(FILE *stream) {
   return port;
 }
 
-sexp make_flonum(float value) {
+sexp make_flonum(double value) {
   sexp object = alloc_object(FLONUM);
   float_value(object) = value;
   return object;
 }
 
+/* The `length' digits are zero */
+sexp make_bignum(int length) {
+  sexp object = alloc_object(BIGNUM);
+  bignum_digits(object) = calloc(length > 0 ? length: 1, sizeof(uint32_t));
+  bignum_length(object) = length;
+  bignum_sign(object) = 1;
+  return object;
+}
+
+size_t uvector_element_size(enum uvector_kind kind) {
+  static const size_t sizes[] = {sizeof(double), sizeof(int32_t), sizeof(uint8_t)};
+  return sizes[kind];
+}
+
+sexp make_uvector(enum uvector_kind kind, int length) {
+  sexp object = alloc_object(UVECTOR);
+  uvector_data(object) = calloc(length > 0 ? length: 1, uvector_element_size(kind));
+  uvector_length(object) = length;
+  uvector_kind(object) = kind;
+  uvector_parent(object) = NULL;
+  return object;
+}
+
+/* An empty table of `size' slots, which must be a power of two */
+sexp make_table(enum hash_kind kind, unsigned int size) {
+  sexp object = alloc_object(HASH_TABLE);
+  table_slots(object) = calloc(size, sizeof(struct hash_slot));
+  table_size(object) = size;
+  table_count(object) = 0;
+  table_filled(object) = 0;
+  table_kind(object) = kind;
+  return object;
+}
+
+sexp make_hamt(sexp root, int count, int is_transient) {
+  sexp object = alloc_object(HAMT);
+  hamt_root(object) = root;
+  hamt_count(object) = count;
+  hamt_is_transient(object) = is_transient;
+  hamt_edit(object) = is_transient ? object: NULL;
+  return object;
+}
+
+/* A node of `length' children, which are to be filled */
+sexp make_hamt_node(sexp edit, uint32_t bitmap, int length) {
+  sexp object = alloc_object(HAMT_NODE);
+  node_array(object) = calloc(length > 0 ? 2 * length: 1, sizeof(sexp));
+  node_bitmap(object) = bitmap;
+  node_length(object) = length;
+  node_edit(object) = edit;
+  return object;
+}
+
+/* A view of `length' elements of `v' from `start', sharing its buffer */
+sexp make_uvector_slice(sexp v, int start, int length) {
+  sexp object = alloc_object(UVECTOR);
+  uvector_data(object) =
+      (char *)uvector_data(v) + start * uvector_element_size(uvector_kind(v));
+  uvector_length(object) = length;
+  uvector_kind(object) = uvector_kind(v);
+  uvector_parent(object) = uvector_parent(v) ? uvector_parent(v): v;
+  return object;
+}
+
 sexp make_primitive_proc(C_proc_t C_proc) {
   sexp proc = alloc_object(PRIMITIVE_PROC);
   primitive_C_proc(proc) = C_proc;
@@ -222,22 +470,24 @@ sexp make_compiled_proc(sexp args, sexp code, sexp env) {
   compiled_proc_args(proc) = args;
   compiled_proc_env(proc) = env;
   compiled_proc_code(proc) = code;
+  compiled_proc_bytecode(proc) = NULL;
   return proc;
 }
 
 sexp make_vector(unsigned int length) {
   sexp vector = alloc_object(VECTOR);
   vector_length(vector) = length;
-  vector_datum(vector) = malloc(length * sizeof(struct lisp_object_t));
+  vector_datum(vector) = calloc(length, sizeof(sexp));
   vector_pos(vector) = 0;
   return vector;
 }
 
-sexp make_return_info(sexp code, int pc, sexp env) {
+sexp make_return_info(sexp code, int pc, sexp env, int fp) {
   sexp info = alloc_object(RETURN_INFO);
   return_code(info) = code;
   return_pc(info) = pc;
   return_env(info) = env;
+  return_fp(info) = fp;
   return info;
 }
 
@@ -256,10 +506,65 @@ sexp make_environment(sexp bindings, sexp outer_env) {
   return env;
 }
 
-sexp make_wchar(void) {
-  sexp wc = alloc_object(WCHAR);
-  wchar_value(wc)[WCHAR_LENGTH - 1] = '\0';
-  return wc;
+/* The slots of a small frame are kept in the object itself */
+sexp make_frame(int size, sexp outer) {
+  sexp frame = alloc_object(FRAME);
+  if (size > FRAME_INLINE_SLOTS)
+    frame_slots(frame) = malloc(size * sizeof(sexp));
+  else
+    frame_slots(frame) = frame->values.frame.inline_slots;
+  frame_size(frame) = size;
+  frame_outer(frame) = outer;
+  frame_on_stack(frame) = no;
+  for (int i = 0; i < size; i++)
+    frame_slot(frame, i) = EOL;
+  return frame;
+}
+
+sexp make_record_type(sexp name, sexp fields) {
+  sexp object = alloc_object(RECORD_TYPE);
+  record_type_name(object) = name;
+  record_type_fields(object) = fields;
+  record_type_size(object) = pair_length(fields);
+  return object;
+}
+
+/* A record of `type' whose slots are all false */
+sexp make_record(sexp type) {
+  sexp record = alloc_object(RECORD);
+  int size = record_type_size(type);
+  if (size > RECORD_INLINE_SLOTS)
+    record_slots(record) = malloc(size * sizeof(sexp));
+  else
+    record_slots(record) = record->values.record.inline_slots;
+  record_type(record) = type;
+  for (int i = 0; i < size; i++)
+    record_slot(record, i) = false_object;
+  return record;
+}
+
+sexp make_generic(sexp name) {
+  sexp generic = alloc_object(GENERIC);
+  generic_name(generic) = name;
+  generic_methods(generic) = NULL;
+  generic_resolved(generic) = NULL;
+  generic_methods(generic) = make_table(HASH_EQ, 8);
+  generic_resolved(generic) = make_table(HASH_EQ, 8);
+  generic_epoch(generic) = -1;
+  return generic;
+}
+
+sexp make_regexp(struct regexp_t *program, sexp source) {
+  sexp regexp = alloc_object(REGEXP);
+  regexp_program(regexp) = program;
+  regexp_source(regexp) = source;
+  return regexp;
+}
+
+sexp make_box(sexp value) {
+  sexp box = alloc_object(BOX);
+  box_value(box) = value;
+  return box;
 }
 
 int get_mask(int n) {
@@ -289,42 +594,57 @@ int get_mask(int n) {
 /*   } */
 /* } */
 
-int utf8_strlen(char *str) {
-  int ulen = 0;
-  while (*str) {
-    int n = nzero(*str);
-    if (n == 0) {
-      str++;
-      /* ulen++; */
-    } else {
-      /* ulen += n; */
-      str += n;
-    }
-    ulen++;
+/* Every byte except the continuation ones starts a character */
+#define is_utf8_continuation(c) (((c) & 0xc0) == 0x80)
+
+/* Skips the character at `str' */
+char *utf8_next(char *str) {
+  str++;
+  while (is_utf8_continuation(*str))
+    str++;
+  return str;
+}
+
+void build_string_index(sexp s) {
+  int *index = malloc((string_length(s) / STRING_INDEX_STEP + 1) * sizeof(int));
+  char *p = string_value(s);
+  for (int i = 0; i < string_length(s); i++, p = utf8_next(p))
+    if (i % STRING_INDEX_STEP == 0)
+      index[i / STRING_INDEX_STEP] = p - string_value(s);
+  string_index(s) = index;
+}
+
+/* Returns the address of the `i'-th character. It is found directly in an
+   ASCII string, or by decoding less than STRING_INDEX_STEP characters. */
+char *string_char_at(sexp s, int i) {
+  if (string_is_ascii(s))
+    return string_value(s) + i;
+  if (string_index(s) == NULL)
+    build_string_index(s);
+  char *p = string_value(s) + string_index(s)[i / STRING_INDEX_STEP];
+  for (i %= STRING_INDEX_STEP; i > 0; i--)
+    p = utf8_next(p);
+  return p;
+}
+
+/* Replaces the `old' bytes at `p' by the `n' bytes of `bytes'. The string is
+   copied if the number of bytes changes, so its index is rebuilt. */
+void string_splice(sexp s, char *p, int old, char *bytes, int n) {
+  if (n == old) {
+    memcpy(p, bytes, n);
+    return;
   }
-  return ulen;
-}
-
-sexp make_wstring(char *bytes) {
-  sexp init_wchar(char *);
-  sexp ws = alloc_object(WSTRING);
-  int len = utf8_strlen(bytes);
-  wstring_length(ws) = len;
-  wstring_value(ws) = calloc(len, sizeof(sexp));
-  /* wstring_value(ws)[len - 1] = '\0'; */
-  /* for (int i = 0; i < len; i++) */
-  /*   wstring_value(ws)[i] = make_character(bytes[i]); */
-  int i = 0;
-  while (*bytes) {
-    int n = nzero(*bytes);
-    if (n == 0)
-      wstring_value(ws)[i] = make_character(*bytes);
-    else
-      wstring_value(ws)[i] = init_wchar(bytes);
-    i++;
-    bytes += n == 0 ? 1: n;
-  }
-  return ws;
+  char *str = string_value(s);
+  int prefix = p - str;
+  int suffix = string_byte_length(s) - prefix - old;
+  char *new = malloc(prefix + n + suffix + 1);
+  memcpy(new, str, prefix);
+  memcpy(new + prefix, bytes, n);
+  memcpy(new + prefix + n, p + old, suffix + 1);
+  string_value(s) = new;
+  string_measure(s);
+  free(string_index(s));
+  string_index(s) = NULL;
 }
 
 /* utilities */
@@ -387,35 +707,52 @@ sexp read_byte(sexp port) {
   return make_fixnum(fgetc(stream));
 }
 
-/* Computes the number of prefix zero bits in a byte */
+/* Computes the number of leading one bits in a byte, which is the length of
+   the UTF-8 sequence it starts */
 int nzero(char c) {
-  char mask = 0x80;
-  int count = 0;
-  for (; (c & mask) != 0; c = c << 1)
-    count++;
-  return count;
+  return __builtin_clz(~((unsigned int)(unsigned char)c << 24));
 }
 
-sexp read_char(sexp port) {
-  char c = port_read_char(port);
-  if (nzero(c) == 0) return make_character(c);
-  assert(nzero(c) < 6);
-  sexp wc = make_wchar();
-  wchar_value(wc)[0] = c;
-  for (int i = 1; i < nzero(c); i++) {
-    char ch = port_read_char(port);
-    wchar_value(wc)[i] = ch;
+/* Decodes the UTF-8 sequence at `bytes' into `code', returns its length */
+int utf8_decode(char *bytes, int *code) {
+  int n = nzero(*bytes);
+  if (n == 0) {
+    *code = *bytes;
+    return 1;
   }
-  return wc;
+  int cp = *bytes & get_mask(n);
+  for (int i = 1; i < n; i++)
+    cp = (cp << 6) | (bytes[i] & 0x3f);
+  *code = cp;
+  return n;
+}
+
+/* Encodes `code' into `bytes', returns the number of bytes written */
+int utf8_encode(int code, char *bytes) {
+  if (code < 0x80) {
+    bytes[0] = code;
+    return 1;
+  }
+  int n = code < 0x800 ? 2: code < 0x10000 ? 3: 4;
+  for (int i = n - 1; i > 0; i--) {
+    bytes[i] = 0x80 | (code & 0x3f);
+    code >>= 6;
+  }
+  bytes[0] = (0xff << (8 - n)) | code;
+  return n;
 }
 
-/* WCHAR */
-sexp init_wchar(char *bytes) {
-  sexp wc = make_wchar();
-  int n = nzero(*bytes);
-  for (int i = 0; i < n; i++)
-    wchar_value(wc)[i] = bytes[i];
-  return wc;
+/* Characters are decoded when read, so none of them is on the heap */
+sexp read_char(sexp port) {
+  char bytes[UTF8_LENGTH];
+  bytes[0] = port_read_char(port);
+  int n = nzero(bytes[0]);
+  assert(n <= UTF8_LENGTH);
+  for (int i = 1; i < n; i++)
+    bytes[i] = port_read_char(port);
+  int code;
+  utf8_decode(bytes, &code);
+  return make_character(code);
 }
 
 /* VECTOR */
@@ -423,11 +760,30 @@ sexp is_vector_full(sexp v) {
   return vector_pos(v) >= vector_length(v) ? true_object: false_object;
 }
 
-sexp vector_push(sexp ele, sexp vector) {
-  if (is_vector_full(vector) == true_object) {
-    port_format(scm_err_port, "vector_push - The vector is full of elements\n");
+/* Makes room for at least `length' elements. The VM stack can not grow
+   beyond `vm_stack_limit' slots. */
+void vector_reserve(sexp vector, unsigned int length) {
+  unsigned int size = vector_length(vector);
+  if (length <= size) return;
+  unsigned int limit = vector == vm_stack ? vm_stack_limit: UINT_MAX;
+  if (length > limit) {
+    signal_stack_overflow();
+    return;
+  }
+  while (size < length)
+    size = size == 0 ? 1: size > UINT_MAX / 2 ? UINT_MAX: size * 2;
+  if (size > limit) size = limit;
+  vector_datum(vector) = realloc(vector_datum(vector), size * sizeof(sexp));
+  if (vector_datum(vector) == NULL) {
+    fprintf(stderr, "Memory exhausted\n");
     exit(1);
   }
+  vector_length(vector) = size;
+}
+
+sexp vector_push(sexp ele, sexp vector) {
+  if (is_vector_full(vector) == true_object)
+    vector_reserve(vector, vector_pos(vector) + 1);
   vector_data_at(vector, vector_pos(vector)) = ele;
   return make_fixnum(++vector_pos(vector));
 }
@@ -461,8 +817,8 @@ hash_table_t make_hash_table(hash_fn_t hash_function, comp_fn_t comparator, unsi
   table->hash_function = hash_function;
   table->comparator = comparator;
   table->size = size;
-  table->datum = malloc(size * sizeof(struct lisp_object_t));
-  memset(table->datum, '\0', size);
+  table->datum = malloc(size * sizeof(table_entry_t));
+  memset(table->datum, '\0', size * sizeof(table_entry_t));
   return table;
 }
 
@@ -541,6 +897,14 @@ sexp extend_environment(sexp vars, sexp vals, sexp env) {
   return make_environment(bindings, env);
 }
 
+/* The frame used by the compiler, whose slots are the names of variables */
+sexp extend_frame(sexp vars, sexp env) {
+  sexp frame = make_frame(pair_length(vars), env);
+  for (int i = 0; is_pair(vars); vars = pair_cdr(vars), i++)
+    frame_slot(frame, i) = pair_car(vars);
+  return frame;
+}
+
 sexp make_global_env(void) {
   if (global_env == NULL)
     global_env = extend_environment(EOL, EOL, startup_environment);
@@ -561,7 +925,15 @@ int is_empty_environment(sexp env) {
   return null_environment == env;
 }
 
+/* Skips the frames of compiled procedures, whose variables have no name */
+sexp global_environment(sexp env) {
+  while (is_frame(env))
+    env = frame_outer(env);
+  return env;
+}
+
 sexp search_binding(sexp var, sexp env) {
+  env = global_environment(env);
   while (!is_empty_environment(env)) {
     sexp bindings = environment_bindings(env);
     while (is_pair(bindings)) {
@@ -575,20 +947,16 @@ sexp search_binding(sexp var, sexp env) {
   return NULL;
 }
 
+/* Finds `var' in the frames made by `extend_frame', where the slot of a boxed variable holds a box of its name. A variable not found is a global one. */
 int search_binding_index(sexp var, sexp env, int *x, int *y) {
-  int i = 0;
-  while (!is_empty_environment(env)) {
-    sexp bindings = environment_bindings(env);
-    for (int j = 0; is_pair(bindings); bindings = pair_cdr(bindings), j++) {
-      sexp b = pair_car(bindings);
-      if (pair_car(b) != var) continue;
-      *x = i;
-      *y = j;
-      return yes;
-    }
-    env = enclosing_environment(env);
-    i++;
-  }
+  for (int i = 0; is_frame(env); env = frame_outer(env), i++)
+    for (int j = 0; j < frame_size(env); j++)
+      if (frame_slot(env, j) == var ||
+          (is_box(frame_slot(env, j)) && box_value(frame_slot(env, j)) == var)) {
+        *x = i;
+        *y = j;
+        return yes;
+      }
   return no;
 }
 
@@ -604,6 +972,7 @@ void add_binding(sexp var, sexp val, sexp env) {
 
 /* Change an existing binding or create a new binding */
 void set_binding(sexp var, sexp val, sexp environment) {
+  environment = global_environment(environment);
   sexp tmp = environment;
   while (!is_empty_environment(environment)) {
     sexp bindings = environment_bindings(environment);
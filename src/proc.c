@@ -6,14 +6,25 @@
  * Copyright (C) 2013-03-17 liutos <mat.liutos@gmail.com>
  */
 #include <assert.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "bytevector.h"
+#include "class.h"
 #include "compiler.h"
 #include "eval.h"
+#include "hamt.h"
+#include "hashtable.h"
+#include "number.h"
 #include "object.h"
 #include "read.h"
+#include "regexp.h"
+#include "register.h"
+#include "sort.h"
 #include "types.h"
+#include "utf8.h"
+#include "uvector.h"
 #include "vm.h"
 #include "write.h"
 
@@ -22,35 +33,26 @@
 /* #define PHEAD(C_proc) lisp_object_t C_proc(lisp_object_t args) */
 
 extern int nzero(char);
-extern int utf8_strlen(char *);
 
 /* FIXNUM */
 /* The following four is defined as instructions */
 /* Binary plus */
-sexp plus_proc(sexp args) {
-  sexp n1 = pair_car(args);
-  sexp n2 = pair_cadr(args);
+sexp plus_proc(sexp n1, sexp n2) {
   return make_fixnum(fixnum_value(n1) + fixnum_value(n2));
 }
 
 /* Binary minus */
-sexp minus_proc(sexp args) {
-  sexp n1 = pair_car(args);
-  sexp n2 = pair_cadr(args);
+sexp minus_proc(sexp n1, sexp n2) {
   return make_fixnum(fixnum_value(n1) - fixnum_value(n2));
 }
 
 /* Binary multiply */
-sexp multiply_proc(sexp args) {
-  sexp n1 = pair_car(args);
-  sexp n2 = pair_cadr(args);
+sexp multiply_proc(sexp n1, sexp n2) {
   return make_fixnum(fixnum_value(n1) * fixnum_value(n2));
 }
 
 /* Binary divide */
-sexp divide_proc(sexp args) {
-  sexp n1 = pair_car(args);
-  sexp n2 = pair_cadr(args);
+sexp divide_proc(sexp n1, sexp n2) {
   return make_fixnum(fixnum_value(n1) / fixnum_value(n2));
 }
 
@@ -59,10 +61,6 @@ sexp fixnum_equal_proc(sexp n1, sexp n2) {
   return fixnum_value(n1) == fixnum_value(n2) ? true_object: false_object;
 }
 
-sexp modulo_proc(sexp n1, sexp n2) {
-  return make_fixnum(fixnum_value(n1) % fixnum_value(n2));
-}
-
 sexp greater_than_proc(sexp n1, sexp n2) {
   return fixnum_value(n1) > fixnum_value(n2) ? true_object: false_object;
 }
@@ -94,90 +92,88 @@ sexp code2char_proc(sexp n) {
 }
 
 /* STRING */
+void check_string_index(sexp str, sexp index, char *op) {
+  if (!is_fixnum(index) ||
+      fixnum_value(index) < 0 || fixnum_value(index) >= string_length(str)) {
+    port_format(scm_err_port, "%s: Index out of range %*\n", make_string(op), index);
+    exit(1);
+  }
+}
+
 /* Get the specific character in a string */
-/* A O(n) string referencing function */
 sexp string_ref(sexp str, sexp index) {
-  assert(is_string(str) || is_wstring(str));
-  switch (str->type) {
-    case STRING: {
-      char *val = string_value(str);
-      for (int n = fixnum_value(index); n > 0; n--) {
-        int n = nzero(*val);
-        val += 1 + n;
-      }
-      if (nzero(*val) == 0)
-        return make_character(*val);
-      else {
-        sexp wc = make_wchar();
-        char c = *val;
-        for (int i = 0; i < nzero(c); i++) {
-          wchar_value(wc)[i] = *val;
-          val++;
-        }
-        return wc;
-      }
-    }
-    case WSTRING:
-      return wstring_value(str)[fixnum_value(index)];
-    default :
-      port_format(scm_err_port, "Impossible!\n");
-      exit(1);
-  }
+  assert(is_string(str));
+  check_string_index(str, index, "string-ref");
+  int code;
+  utf8_decode(string_char_at(str, fixnum_value(index)), &code);
+  return make_character(code);
 }
 /* sexp char_at_proc(sexp str, sexp n) { */
 /*   return make_character(string_value(str)[fixnum_value(n)]); */
 /* } */
 
-/* sexp string_length_proc(sexp str) { */
-/*   unsigned int len = strlen(string_value(str)); */
-/*   return make_fixnum(len); */
-/* } */
-sexp string_length(sexp str) {
-  assert(is_string(str) || is_wstring(str));
-  if (is_string(str))
-    return make_fixnum(utf8_strlen(string_value(str)));
-  else
-    return make_fixnum(wstring_length(str));
+sexp string_length_proc(sexp str) {
+  assert(is_string(str));
+  return make_fixnum(string_length(str));
 }
 
 /* sexp string_equal_proc(sexp s1, sexp s2) { */
 /*   return strcmp(string_value(s1), string_value(s2)) ? false_object: true_object; */
 /* } */
 sexp string_equalp(sexp s1, sexp s2) {
-  assert(s1->type == s2->type);
-  assert(is_string(s1));
-  return strcmp(string_value(s1), string_value(s2)) ? false_object: true_object;
+  assert(is_string(s1) && is_string(s2));
+  return string_byte_length(s1) == string_byte_length(s2) &&
+      utf8_compare(string_value(s1), string_value(s2), string_byte_length(s1)) == 0 ?
+      true_object: false_object;
+}
+
+/* The order of UTF-8 bytes is the order of the code points */
+sexp string_lessp(sexp s1, sexp s2) {
+  assert(is_string(s1) && is_string(s2));
+  int n1 = string_byte_length(s1), n2 = string_byte_length(s2);
+  int c = utf8_compare(string_value(s1), string_value(s2), n1 < n2 ? n1: n2);
+  return c < 0 || (c == 0 && n1 < n2) ? true_object: false_object;
+}
+
+/* Returns the index of the first occurrence of `s2' in `s1', or false */
+sexp string_contains_proc(sexp s1, sexp s2) {
+  assert(is_string(s1) && is_string(s2));
+  const char *p = utf8_search(string_value(s1), string_byte_length(s1),
+                              string_value(s2), string_byte_length(s2));
+  if (p == NULL) return false_object;
+  int offset = p - string_value(s1);
+  return make_fixnum(string_is_ascii(s1) ? offset: utf8_count(string_value(s1), offset));
 }
 
 sexp string_set(sexp s, sexp n, sexp c) {
-  assert(is_wstring(s) || is_string(s));
-  if (is_wstring(s))
-    wstring_value(s)[fixnum_value(n)] = c;
-  else {
-    /* char *seq = string_value(s); */
-    /* for (int i = 0; i < n; i++) { */
-    /*   char c = *seq; */
-    /*   if (nzero(c) == 0) seq++; */
-    /*   else seq += nzero(c); */
-    /* } */
-    port_format(scm_err_port, "Unsupported - I'm a lazy man...\n");
-    exit(1);
-  }
+  assert(is_string(s));
+  check_string_index(s, n, "string-set!");
+  char bytes[UTF8_LENGTH];
+  int code;
+  char *p = string_char_at(s, fixnum_value(n));
+  string_splice(s, p, utf8_decode(p, &code), bytes,
+                utf8_encode(char_value(c), bytes));
   return s;
 }
 
 /* PAIR */
 /* The two following primitives is also defined as instructions */
-lisp_object_t pair_car_proc(lisp_object_t args) {
-  lisp_object_t list = pair_car(args);
+lisp_object_t pair_car_proc(lisp_object_t list) {
   return pair_car(list);
 }
 
-lisp_object_t pair_cdr_proc(lisp_object_t args) {
-  lisp_object_t list = pair_car(args);
+lisp_object_t pair_cdr_proc(lisp_object_t list) {
   return pair_cdr(list);
 }
 
+/* Variadic primitive: the arguments are in `argv' */
+sexp list_proc(int argc, sexp *argv) {
+  sexp list = EOL;
+  for (int i = argc - 1; i >= 0; i--)
+    list = make_pair(argv[i], list);
+  return list;
+}
+
 sexp pair_set_car_proc(sexp pair, sexp val) {
   pair_car(pair) = val;
   return pair;
@@ -190,7 +186,7 @@ sexp pair_set_cdr_proc(sexp pair, sexp val) {
 
 /* SYMBOL */
 sexp symbol_name_proc(sexp sym) {
-  return make_string(symbol_name(sym));
+  return make_string(strdup(symbol_name(sym)));
 }
 
 /* Create a symbol looks the same as the string argument */
@@ -199,15 +195,119 @@ sexp string2symbol_proc(sexp str) {
 }
 
 /* VECTOR */
+/* The elements are the first `vector_pos' slots, the rest is the room for
+   `vector-push!' */
+void check_vector(sexp vector, char *op) {
+  if (is_vector(vector)) return;
+  port_format(scm_err_port, "%s: Wrong type argument %*\n", make_string(op), vector);
+  exit(1);
+}
+
+/* Returns `n', which must be a fixnum in [lo, hi] */
+int check_vector_bound(sexp n, int lo, int hi, char *op) {
+  if (!is_fixnum(n)) {
+    port_format(scm_err_port, "%s: Wrong type argument %*\n", make_string(op), n);
+    exit(1);
+  }
+  if (fixnum_value(n) < lo || fixnum_value(n) > hi) {
+    port_format(scm_err_port, "%s: Index out of range %*\n", make_string(op), n);
+    exit(1);
+  }
+  return fixnum_value(n);
+}
+
 sexp vector_ref_proc(sexp vector, sexp n) {
-  return vector_data_at(vector, fixnum_value(n));
+  check_vector(vector, "vector-ref");
+  int i = check_vector_bound(n, 0, vector_pos(vector) - 1, "vector-ref");
+  return vector_data_at(vector, i);
 }
 
 sexp vector_set_proc(sexp vector, sexp n, sexp value) {
-  vector_data_at(vector, fixnum_value(n)) = value;
+  check_vector(vector, "vector-set!");
+  int i = check_vector_bound(n, 0, vector_pos(vector) - 1, "vector-set!");
+  vector_data_at(vector, i) = value;
   return value;
 }
 
+/* A vector of the elements from `start' to `end' of `vector', with room
+   for `length' elements */
+sexp copy_vector_range(sexp vector, int start, int end, int length) {
+  sexp copy = make_vector(length);
+  memcpy(vector_datum(copy), vector_datum(vector) + start,
+         (end - start) * sizeof(sexp));
+  vector_pos(copy) = end - start;
+  return copy;
+}
+
+/* (make-vector n [fill]) */
+sexp make_vector_proc(int argc, sexp *argv) {
+  if (argc < 1 || argc > 2) {
+    port_format(scm_err_port, "make-vector: Wrong argument number: %*\n",
+                make_fixnum(argc));
+    exit(1);
+  }
+  int n = check_vector_bound(argv[0], 0, INT_MAX, "make-vector");
+  sexp fill = argc > 1 ? argv[1]: make_undefined();
+  sexp vector = make_vector(n);
+  for (int i = 0; i < n; i++)
+    vector_data_at(vector, i) = fill;
+  vector_pos(vector) = n;
+  return vector;
+}
+
+sexp vector_length_proc(sexp vector) {
+  check_vector(vector, "vector-length");
+  return make_fixnum(vector_pos(vector));
+}
+
+/* Appends `x' to `vector', whose room doubles when it is full. Returns the
+   new length. */
+sexp vector_push_proc(sexp vector, sexp x) {
+  check_vector(vector, "vector-push!");
+  return vector_push(x, vector);
+}
+
+sexp vector_pop_proc(sexp vector) {
+  check_vector(vector, "vector-pop!");
+  if (vector_pos(vector) == 0) {
+    port_format(scm_err_port, "vector-pop!: The vector is empty\n");
+    exit(1);
+  }
+  return vector_pop(vector);
+}
+
+/* The slots are pointers, so they are filled one by one rather than by
+   `memset' */
+sexp vector_fill_proc(sexp vector, sexp x) {
+  check_vector(vector, "vector-fill!");
+  for (int i = 0; i < vector_pos(vector); i++)
+    vector_data_at(vector, i) = x;
+  return vector;
+}
+
+sexp vector_copy_proc(sexp vector) {
+  check_vector(vector, "vector-copy");
+  return copy_vector_range(vector, 0, vector_pos(vector), vector_pos(vector));
+}
+
+/* A vector of length `n' whose first elements are those of `vector' */
+sexp vector_grow_proc(sexp vector, sexp n) {
+  check_vector(vector, "vector-grow");
+  int length = check_vector_bound(n, vector_pos(vector), INT_MAX, "vector-grow");
+  sexp grown = copy_vector_range(vector, 0, vector_pos(vector), length);
+  for (int i = vector_pos(vector); i < length; i++)
+    vector_data_at(grown, i) = make_undefined();
+  vector_pos(grown) = length;
+  return grown;
+}
+
+sexp subvector_proc(sexp vector, sexp start, sexp end) {
+  check_vector(vector, "subvector");
+  int s = check_vector_bound(start, 0, vector_pos(vector), "subvector");
+  int e = check_vector_bound(end, s, vector_pos(vector), "subvector");
+  return copy_vector_range(vector, s, e, e - s);
+}
+
 /* FILE_IN_PORT */
 sexp open_in_proc(sexp path) {
   FILE *fp = fopen(string_value(path), "r");
@@ -218,22 +318,6 @@ sexp open_in_proc(sexp path) {
   return make_file_in_port(fp);
 }
 
-sexp read_char_proc(sexp port) {
-  char c = port_read_char(port);
-  if (nzero(c) == 0)
-    return make_character(c);
-  else {
-    assert(nzero(c) < 6);
-    sexp wc = make_wchar();
-    wchar_value(wc)[0] = c;
-    for (int i = 1; i < nzero(c); i++) {
-      char ch = port_read_char(port);
-      wchar_value(wc)[i] = ch;
-    }
-    return wc;
-  }
-}
-
 sexp close_in_proc(sexp port) {
   fclose(in_port_stream(port));
   return make_undefined();
@@ -255,7 +339,7 @@ sexp open_out_proc(sexp path) {
 }
 
 sexp write_char_proc(sexp ch, sexp port) {
-  fputc(char_value(ch), out_port_stream(port));
+  write_code_point(char_value(ch), port);
   return make_undefined();
 }
 
@@ -272,23 +356,23 @@ sexp write_proc(sexp object) {
 
 /* FLONUM */
 sexp flonum_plus_proc(sexp n1, sexp n2) {
-  return make_flonum(float_value(n1) + float_value(n2));
+  return make_flonum(real_value(n1, "+.") + real_value(n2, "+."));
 }
 
 sexp flonum_minus_proc(sexp n1, sexp n2) {
-  return make_flonum(float_value(n1) - float_value(n2));
+  return make_flonum(real_value(n1, "-.") - real_value(n2, "-."));
 }
 
 sexp flonum_multiply_proc(sexp n1, sexp n2) {
-  return make_flonum(float_value(n1) * float_value(n2));
+  return make_flonum(real_value(n1, "*.") * real_value(n2, "*."));
 }
 
 sexp flonum_divide_proc(sexp n1, sexp n2) {
-  return make_flonum(float_value(n1) / float_value(n2));
+  return make_flonum(real_value(n1, "/.") / real_value(n2, "/."));
 }
 
 sexp integer_to_float_proc(sexp n) {
-  return make_flonum((float)(fixnum_value(n)));
+  return make_flonum((double)(fixnum_value(n)));
 }
 
 /* Others */
@@ -299,6 +383,65 @@ sexp eval_proc(sexp exp, sexp env) {
   return run_compiled_code(exp, env, vm_stack);
 }
 
+/* (apply f x ... list) calls `f' on the `x's followed by the elements of `list' */
+sexp apply_proc(int argc, sexp *argv) {
+  if (argc < 2) {
+    port_format(scm_err_port, "apply: Wrong argument number: %d\n", make_fixnum(argc));
+    exit(1);
+  }
+  sexp list = argv[argc - 1];
+  int n = argc - 2;
+  sexp l = list;
+  for (; is_pair(l); l = pair_cdr(l))
+    n++;
+  if (!is_null(l)) {
+    port_format(scm_err_port, "apply: Wrong type argument %*\n", list);
+    exit(1);
+  }
+  sexp args[n + 1];
+  for (int i = 0; i < argc - 2; i++)
+    args[i] = argv[i + 1];
+  for (int i = argc - 2; i < n; i++, list = pair_cdr(list))
+    args[i] = pair_car(list);
+  return vm_apply(argv[0], n, args);
+}
+
+/* Selects the tier used by the lambdas compiled from now on */
+sexp set_vm_tier_proc(sexp tier) {
+  sexp old = is_register_tier ? S("register"): S("stack");
+  is_register_tier = tier == S("register");
+  return old;
+}
+
+/* Moves a compiled procedure into the register tier, returns #f if it is not possible */
+sexp register_tier_proc(sexp proc) {
+  if (!is_compiled_proc(proc)) {
+    port_format(scm_err_port, "register-tier!: Wrong type argument %*\n", proc);
+    exit(1);
+  }
+  return use_register_tier(proc);
+}
+
+/* Sets the maximum number of slots of the VM stack, returns the previous one */
+sexp set_stack_limit_proc(sexp n) {
+  if (!is_fixnum(n) || fixnum_value(n) <= 0 || fixnum_value(n) > UINT_MAX) {
+    port_format(scm_err_port, "set-stack-limit!: Wrong type argument %*\n", n);
+    exit(1);
+  }
+  sexp old = make_fixnum(vm_stack_limit);
+  vm_stack_limit = fixnum_value(n);
+  /* The slots already allocated beyond the new limit are given up */
+  if (vector_length(vm_stack) > vm_stack_limit)
+    vector_length(vm_stack) = vector_pos(vm_stack) > vm_stack_limit ?
+        vector_pos(vm_stack): vm_stack_limit;
+  return old;
+}
+
+sexp throw_proc(sexp tag, sexp value) {
+  throw_object(tag, value);
+  return value;
+}
+
 /* Are the two arguments identical? */
 sexp is_identical_proc(sexp o1, sexp o2) {
   return o1 == o2 ? make_true(): make_false();
@@ -307,6 +450,7 @@ sexp is_identical_proc(sexp o1, sexp o2) {
 /* Return a symbol indicates the argument's type */
 sexp type_of_proc(sexp o) {
   if (is_fixnum(o)) return S("fixnum");
+  else if (is_bignum(o)) return S("bignum");
   else if (is_bool(o)) return S("boolean");
   else if (is_char(o)) return S("character");
   else if (is_null(o)) return S("empty-list");
@@ -314,6 +458,19 @@ sexp type_of_proc(sexp o) {
     switch (o->type) {
       case STRING: return S("string");
       case PAIR: return S("pair");
+      case VECTOR: return S("vector");
+      case HASH_TABLE: return S("hash-table");
+      case HAMT: return S("hamt");
+      case RECORD: return record_type_name(record_type(o));
+      case RECORD_TYPE: return S("record-type");
+      case FLONUM: return S("flonum");
+      case COMPILED_PROC: return S("function");
+      case GENERIC: return S("generic");
+      case REGEXP: return S("regex");
+      case UVECTOR: {
+        static char *names[] = {"f64vector", "s32vector", "u8vector"};
+        return S(names[uvector_kind(o)]);
+      }
       case SYMBOL: return S("symbol");
       case PRIMITIVE_PROC: return S("function");
       case FILE_IN_PORT: return S("file-in-port");
@@ -350,7 +507,17 @@ struct lisp_object_t primitive_procs[] = {
   DEFPROC("-i", minus_proc, no, "ISUB", 2),
   DEFPROC("*i", multiply_proc, no, "IMUL", 2),
   DEFPROC("/i", divide_proc, no, "IDIV", 2),
-  DEFPROC("remainder", modulo_proc, no, NULL, 2),
+  DEFPROC("+", number_add, no, "NADD", 2),
+  DEFPROC("-", number_sub, no, "NSUB", 2),
+  DEFPROC("*", number_mul, no, "NMUL", 2),
+  DEFPROC("/", number_div, no, "NDIV", 2),
+  DEFPROC("<", number_lt, no, "NLT", 2),
+  DEFPROC("=", number_eq, no, "NEQ", 2),
+  DEFPROC(">", number_gt, no, "NGT", 2),
+  DEFPROC("quotient", number_quotient, no, NULL, 2),
+  DEFPROC("remainder", number_remainder, no, NULL, 2),
+  DEFPROC("modulo", number_modulo, no, NULL, 2),
+  DEFPROC("number->string", number_to_string, no, NULL, 1),
   DEFPROC("=i", fixnum_equal_proc, no, NULL, 2),
   DEFPROC(">i", greater_than_proc, no, NULL, 2),
   DEFPROC("&", bit_and_proc, no, NULL, 2),
@@ -360,22 +527,27 @@ struct lisp_object_t primitive_procs[] = {
   DEFPROC("integer->char", code2char_proc, no, NULL, 1),
   /* DEFPROC("string-ref", char_at_proc, no, NULL, 2), */
   DEFPROC("string-ref", string_ref, no, NULL, 2),
-  /* DEFPROC("string-length", string_length_proc, no, NULL, 1), */
-  DEFPROC("string-length", string_length, no, NULL, 1),
+  DEFPROC("string-length", string_length_proc, no, NULL, 1),
   /* DEFPROC("string=?", string_equal_proc, no, NULL, 2), */
   DEFPROC("string=?", string_equalp, no, NULL, 2),
+  DEFPROC("string<?", string_lessp, no, NULL, 2),
+  DEFPROC("string-contains", string_contains_proc, no, NULL, 2),
   DEFPROC("string-set!", string_set, yes, NULL, 3),
   DEFPROC("car", pair_car_proc, no, "CAR", 1),
   DEFPROC("cdr", pair_cdr_proc, no, "CDR", 1),
   /* DEFPROC("cons", pair_cons_proc, no, NULL, 2), */
   DEFPROC("cons", make_pair, no, NULL, 2),
+  DEFPROC("list", list_proc, no, NULL, -1),
   DEFPROC("set-car!", pair_set_car_proc, yes, NULL, 2),
   DEFPROC("set-cdr!", pair_set_cdr_proc, yes, NULL, 2),
   DEFPROC("symbol-name", symbol_name_proc, no, NULL, 1),
   DEFPROC("string->symbol", string2symbol_proc, no, NULL, 1),
-  /* DEFPROC("apply", apply_proc, yes, NULL, -1), */
+  DEFPROC("apply", apply_proc, yes, NULL, -1),
+  DEFPROC("map", map_proc, yes, NULL, -1),
+  DEFPROC("for-each", for_each_proc, yes, NULL, -1),
+  DEFPROC("fold", fold_proc, yes, NULL, 3),
+  DEFPROC("filter", filter_proc, yes, NULL, 2),
   DEFPROC("open-in", open_in_proc, yes, NULL, 1),
-  /* DEFPROC("read-char", read_char_proc, yes, NULL, 1), */
   DEFPROC("read-char", read_char, yes, NULL, 1),
   DEFPROC("close-in", close_in_proc, yes, NULL, 1),
   DEFPROC("read", read_proc, yes, NULL, 0),
@@ -387,10 +559,97 @@ struct lisp_object_t primitive_procs[] = {
   DEFPROC("write", write_proc, yes, NULL, 1),
   DEFPROC("vector-ref", vector_ref_proc, no, NULL, 2),
   DEFPROC("vector-set!", vector_set_proc, yes, NULL, 3),
-  DEFPROC("+.", flonum_plus_proc, no, NULL, 2),
-  DEFPROC("-.", flonum_minus_proc, no, NULL, 2),
-  DEFPROC("*.", flonum_multiply_proc, no, NULL, 2),
-  DEFPROC("/.", flonum_divide_proc, no, NULL, 2),
+  DEFPROC("make-vector", make_vector_proc, no, NULL, -1),
+  DEFPROC("vector-length", vector_length_proc, no, NULL, 1),
+  DEFPROC("vector-push!", vector_push_proc, yes, NULL, 2),
+  DEFPROC("vector-pop!", vector_pop_proc, yes, NULL, 1),
+  DEFPROC("vector-fill!", vector_fill_proc, yes, NULL, 2),
+  DEFPROC("vector-copy", vector_copy_proc, no, NULL, 1),
+  DEFPROC("vector-grow", vector_grow_proc, no, NULL, 2),
+  DEFPROC("sort", sort_proc, no, NULL, 2),
+  DEFPROC("sort!", sort_x_proc, yes, NULL, 2),
+  DEFPROC("subvector", subvector_proc, no, NULL, 3),
+  DEFPROC("make-f64vector", make_f64vector_proc, no, NULL, 2),
+  DEFPROC("make-s32vector", make_s32vector_proc, no, NULL, 2),
+  DEFPROC("make-u8vector", make_u8vector_proc, no, NULL, 2),
+  DEFPROC("f64vector", f64vector_proc, no, NULL, -1),
+  DEFPROC("s32vector", s32vector_proc, no, NULL, -1),
+  DEFPROC("u8vector", u8vector_proc, no, NULL, -1),
+  DEFPROC("f64vector-length", f64vector_length_proc, no, NULL, 1),
+  DEFPROC("s32vector-length", s32vector_length_proc, no, NULL, 1),
+  DEFPROC("u8vector-length", u8vector_length_proc, no, NULL, 1),
+  DEFPROC("f64vector-ref", f64vector_ref_proc, no, NULL, 2),
+  DEFPROC("s32vector-ref", s32vector_ref_proc, no, NULL, 2),
+  DEFPROC("u8vector-ref", u8vector_ref_proc, no, NULL, 2),
+  DEFPROC("f64vector-set!", f64vector_set_proc, yes, NULL, 3),
+  DEFPROC("s32vector-set!", s32vector_set_proc, yes, NULL, 3),
+  DEFPROC("u8vector-set!", u8vector_set_proc, yes, NULL, 3),
+  DEFPROC("uvector-add", uvector_add, no, "VADD", 2),
+  DEFPROC("uvector-mul", uvector_mul, no, "VMUL", 2),
+  DEFPROC("uvector-dot", uvector_dot, no, "VDOT", 2),
+  DEFPROC("uvector-sum", uvector_sum, no, "VSUM", 1),
+  DEFPROC("uvector-min", uvector_min, no, "VMIN", 1),
+  DEFPROC("uvector-max", uvector_max, no, "VMAX", 1),
+  DEFPROC("uvector-scale", uvector_scale, no, "VSCALE", 2),
+  DEFPROC("uvector-fill!", uvector_fill, yes, "VFILL", 2),
+  DEFPROC("uvector-copy", uvector_copy, no, "VCOPY", 1),
+  DEFPROC("bytevector", u8vector_proc, no, NULL, -1),
+  DEFPROC("make-bytevector", make_u8vector_proc, no, NULL, 2),
+  DEFPROC("bytevector-length", bytevector_length_proc, no, NULL, 1),
+  DEFPROC("bytevector-u8-ref", bytevector_u8_ref, no, NULL, 2),
+  DEFPROC("bytevector-u8-set!", bytevector_u8_set, yes, NULL, 3),
+  DEFPROC("bytevector-slice", bytevector_slice, no, NULL, 3),
+  DEFPROC("bytevector-copy", bytevector_copy, no, NULL, -1),
+  DEFPROC("bytevector-copy!", bytevector_copy_to, yes, NULL, -1),
+  DEFPROC("bytevector-fill!", bytevector_fill, yes, NULL, 2),
+  DEFPROC("bytevector-u16-ref", bytevector_u16_ref, no, NULL, 3),
+  DEFPROC("bytevector-u16-set!", bytevector_u16_set, yes, NULL, -1),
+  DEFPROC("bytevector-s16-ref", bytevector_s16_ref, no, NULL, 3),
+  DEFPROC("bytevector-s16-set!", bytevector_s16_set, yes, NULL, -1),
+  DEFPROC("bytevector-u32-ref", bytevector_u32_ref, no, NULL, 3),
+  DEFPROC("bytevector-u32-set!", bytevector_u32_set, yes, NULL, -1),
+  DEFPROC("bytevector-s32-ref", bytevector_s32_ref, no, NULL, 3),
+  DEFPROC("bytevector-s32-set!", bytevector_s32_set, yes, NULL, -1),
+  DEFPROC("bytevector-s64-ref", bytevector_s64_ref, no, NULL, 3),
+  DEFPROC("bytevector-s64-set!", bytevector_s64_set, yes, NULL, -1),
+  DEFPROC("bytevector-ieee-single-ref", bytevector_f32_ref, no, NULL, 3),
+  DEFPROC("bytevector-ieee-single-set!", bytevector_f32_set, yes, NULL, -1),
+  DEFPROC("bytevector-ieee-double-ref", bytevector_f64_ref, no, NULL, 3),
+  DEFPROC("bytevector-ieee-double-set!", bytevector_f64_set, yes, NULL, -1),
+  DEFPROC("make-eq-hash-table", make_eq_table_proc, no, NULL, 0),
+  DEFPROC("make-eqv-hash-table", make_eqv_table_proc, no, NULL, 0),
+  DEFPROC("make-equal-hash-table", make_equal_table_proc, no, NULL, 0),
+  DEFPROC("make-string-hash-table", make_string_table_proc, no, NULL, 0),
+  DEFPROC("hash-table-ref/default", hash_table_ref, no, NULL, 3),
+  DEFPROC("hash-table-set!", hash_table_set, yes, NULL, 3),
+  DEFPROC("hash-table-delete!", hash_table_delete, yes, NULL, 2),
+  DEFPROC("hash-table-contains?", hash_table_contains, no, NULL, 2),
+  DEFPROC("hash-table-count", hash_table_count, no, NULL, 1),
+  DEFPROC("hash-table-keys", hash_table_keys, no, NULL, 1),
+  DEFPROC("hash-table-values", hash_table_values, no, NULL, 1),
+  DEFPROC("hash-table->alist", hash_table_to_alist, no, NULL, 1),
+  DEFPROC("hash-table-walk", hash_table_walk, yes, NULL, 2),
+  DEFPROC("make-hamt", make_hamt_proc, no, NULL, 0),
+  DEFPROC("hamt-ref", hamt_ref, no, NULL, 3),
+  DEFPROC("hamt-contains?", hamt_contains, no, NULL, 2),
+  DEFPROC("hamt-count", hamt_count_proc, no, NULL, 1),
+  DEFPROC("hamt-set", hamt_set, no, NULL, 3),
+  DEFPROC("hamt-delete", hamt_delete, no, NULL, 2),
+  DEFPROC("hamt->alist", hamt_to_alist, no, NULL, 1),
+  DEFPROC("hamt-transient", hamt_transient, no, NULL, 1),
+  DEFPROC("hamt-set!", hamt_set_x, yes, NULL, 3),
+  DEFPROC("hamt-delete!", hamt_delete_x, yes, NULL, 2),
+  DEFPROC("hamt-persistent!", hamt_persistent, yes, NULL, 1),
+  DEFPROC("regex-compile", regexp_compile, no, NULL, 1),
+  DEFPROC("regex-match", regexp_match, no, NULL, 2),
+  DEFPROC("regex-search", regexp_search, no, NULL, 2),
+  DEFPROC("regex-search-port", regexp_search_port, yes, NULL, 2),
+  DEFPROC("read-bytes!", read_bytes, yes, NULL, 2),
+  DEFPROC("write-bytes", write_bytes, yes, NULL, 2),
+  DEFPROC("+.", flonum_plus_proc, no, "FADD", 2),
+  DEFPROC("-.", flonum_minus_proc, no, "FSUB", 2),
+  DEFPROC("*.", flonum_multiply_proc, no, "FMUL", 2),
+  DEFPROC("/.", flonum_divide_proc, no, "FDIV", 2),
   DEFPROC("integer->float", integer_to_float_proc, no, NULL, 1),
   DEFPROC("repl-environment", get_repl_environment_proc, no, NULL, 0),
   /* STRING_IN_PORT */
@@ -398,8 +657,18 @@ struct lisp_object_t primitive_procs[] = {
   /* DEFPROC("read-string-in-port-char", read_sp_char_proc, yes, NULL, 1), */
   /* Others */
   DEFPROC("type-of", type_of_proc, no, NULL, 1),
+  DEFPROC("add-method!", add_method_proc, yes, NULL, 3),
+  DEFPROC("set-class-parent!", set_class_parent_proc, yes, NULL, 2),
+  DEFPROC("class-parent", class_parent_proc, no, NULL, 1),
+  DEFPROC("find-method", find_method_proc, no, NULL, 2),
   DEFPROC("eq?", is_identical_proc, no, "EQ", 2),
+  DEFPROC("eqv?", eqv_proc, no, NULL, 2),
+  DEFPROC("equal?", equal_proc, no, NULL, 2),
   DEFPROC("eval", eval_proc, yes, NULL, 2),
+  DEFPROC("set-vm-tier!", set_vm_tier_proc, yes, NULL, 1),
+  DEFPROC("register-tier!", register_tier_proc, yes, NULL, 1),
+  DEFPROC("set-stack-limit!", set_stack_limit_proc, yes, NULL, 1),
+  DEFPROC("throw", throw_proc, yes, "THROW", 2),
 };
 
 void init_environment(lisp_object_t environment) {
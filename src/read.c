@@ -13,11 +13,12 @@
 
 #include "types.h"
 #include "object.h"
+#include "number.h"
+#include "utf8.h"
 
 #define BUFFER_SIZE 100
 
 extern int nzero(char);
-extern sexp read_char_proc(sexp);
 
 sexp read_object(sexp);
 
@@ -50,29 +51,57 @@ void port_ungetc(char c, sexp port) {
 }
 
 /* object readers */
-sexp read_float(int integer, sexp port) {
-  int number = 0;
-  int digit, i = 1;
-  while (isdigit(digit = /* port_read_char */read_C_char(port))) {
-    number = number * 10 + digit - '0';
-    i = i * 10;
-  }
-  /* port_ungetc(digit, port); */
-  unget_C_char(digit, port);
-  return make_flonum(integer + number * 1.0 / i);
+/* Appends `c' to the buffer of `n' characters */
+void append_char(char **buffer, int *n, int *size, char c) {
+  if (*n + 1 >= *size)
+    *buffer = realloc(*buffer, *size *= 2);
+  (*buffer)[(*n)++] = c;
 }
 
+/* Appends the digits read from `port', returns the character after them */
+int read_digits(sexp port, char **buffer, int *n, int *size) {
+  int c;
+  while (isdigit(c = read_C_char(port)))
+    append_char(buffer, n, size, c);
+  return c;
+}
+
+/* An integer of more digits than a fixnum may have is read as a bignum. A
+   number with a fraction or an exponent is converted by `strtod', which
+   rounds correctly. */
 sexp read_number(char c, int sign, sexp port) {
-  int number = c - '0';
-  int digit;
-  while (isdigit(digit = read_C_char(port))) {
-    number = number * 10 + digit - '0';
+  int size = 16, n = 0;
+  char *digits = malloc(size);
+  append_char(&digits, &n, &size, c);
+  int next = read_digits(port, &digits, &n, &size);
+  int is_float = next == '.' || next == 'e' || next == 'E';
+  if (next == '.') {
+    append_char(&digits, &n, &size, next);
+    next = read_digits(port, &digits, &n, &size);
+  }
+  if (next == 'e' || next == 'E') {
+    append_char(&digits, &n, &size, next);
+    next = read_C_char(port);
+    if (next == '+' || next == '-')
+      append_char(&digits, &n, &size, next);
+    else
+      unget_C_char(next, port);
+    next = read_digits(port, &digits, &n, &size);
+  }
+  if (is_float) {
+    unget_C_char(next, port);
+    digits[n] = '\0';
+    sexp value = make_flonum(sign * strtod(digits, NULL));
+    free(digits);
+    return value;
   }
-  if (digit == '.')
-    return read_float(number, port);
   /* port_ungetc(digit, port); */
-  unget_C_char(digit, port);
-  return make_fixnum(number * sign);
+  unget_C_char(next, port);
+  digits[n] = '\0';
+  sexp value = n < 19 ? make_integer(strtoll(digits, NULL, 10)):
+      string_to_integer(digits, n);
+  free(digits);
+  return sign < 0 ? number_sub(make_fixnum(0), value): value;
 }
 
 void read_comment(sexp port) {
@@ -116,20 +145,21 @@ sexp read_character(sexp port) {
   }
 }
 
+/* The bytes are kept as they are read, the string owns the buffer */
 sexp read_string(sexp port) {
-  static char buffer[BUFFER_SIZE];
-  int i = 0;
-  int c = /* port_read_char */read_C_char(port);
-  while (i < BUFFER_SIZE - 2 && c != EOF && c != '"') {
-    buffer[i++] = c;
-    /* c = port_read_char(port); */
+  int size = 16, n = 0;
+  char *str = malloc(size);
+  int c = read_C_char(port);
+  while (c != EOF && c != '"') {
+    append_char(&str, &n, &size, c);
     c = read_C_char(port);
   }
-  char *str = malloc((i + 2) * sizeof(char));
-  strncpy(str, buffer, i + 1);
-  str[i + 1] = '\0';
-  /* return make_string(str); */
-  return make_wstring(str);
+  str[n] = '\0';
+  if (!utf8_validate(str, n)) {
+    fprintf(stderr, "invalid UTF-8 in string at line %d\n", in_port_linum(port));
+    exit(1);
+  }
+  return make_string(str);
 }
 
 sexp read_pair(sexp port) {
@@ -0,0 +1,1054 @@
+/*
+ * regexp.c
+ *
+ * Regular expressions. A pattern is compiled to a program of byte-level
+ * instructions over UTF-8, which is run as a lazily built DFA to find out
+ * whether it matches, and by a Pike VM for the captures of a match.
+ *
+ * Copyright (C) 2013-04-27 liutos <mat.liutos@gmail.com>
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "object.h"
+#include "regexp.h"
+#include "types.h"
+#include "utf8.h"
+#include "write.h"
+
+#define MAX_CODE_POINT 0x10ffff
+#define MAX_REPEAT 1000
+#define MAX_INSTS 100000
+#define MAX_PREFIX 32
+/* The cache of DFA states is flushed when it grows beyond this */
+#define DFA_MAX_STATES 2048
+#define DFA_BUCKETS 4096
+
+enum node_kind {
+  N_EMPTY,
+  N_CLASS,
+  N_CAT,
+  N_ALT,
+  N_REPEAT,
+  N_GROUP,
+  N_BOL,
+  N_EOL,
+};
+
+struct range {
+  int lo, hi;
+};
+
+/* Sorted and disjoint after `normalize_ranges' */
+struct ranges {
+  struct range *data;
+  int count, capacity;
+};
+
+struct node {
+  enum node_kind kind;
+  struct node *left, *right;    /* CAT and ALT, the operand of REPEAT and GROUP */
+  struct ranges ranges;         /* CLASS */
+  int min, max, is_greedy;      /* REPEAT, `max' is -1 when unbounded */
+  int group;                    /* GROUP */
+  struct node *next_made;       /* All the nodes of a parser, for freeing */
+};
+
+struct parser {
+  char *p, *end;
+  int groups;                   /* The capturing groups opened so far */
+  sexp pattern;
+  struct node *made;
+};
+
+enum inst_op {
+  I_BYTE,                       /* Consumes a byte in `set' */
+  I_SPLIT,                      /* Continues at `x', and at `y' with lower priority */
+  I_JMP,
+  I_SAVE,                       /* Records the position into capture slot `x' */
+  I_BOL,
+  I_EOL,
+  I_MATCH,
+};
+
+struct inst {
+  enum inst_op op;
+  int x, y;
+  uint32_t set[8];
+};
+
+/* Sparse set of pcs, cleared in constant time */
+struct pcset {
+  int *dense, *sparse;
+  int count;
+};
+
+struct dfa_state {
+  int *pcs;                     /* The BYTE, EOL and MATCH instructions, sorted */
+  int count;
+  unsigned int hash;
+  int chain;                    /* The next state in the same bucket */
+  int is_match;
+  int is_match_at_end;
+  int is_special;               /* Matching, dead, or where the prefix is searched */
+};
+
+/* `start' is the state at position 0, `restart' the state of an unanchored
+   search in which no match is in progress */
+struct dfa {
+  struct dfa_state *states;
+  /* The 256 transitions of every state. A transition to state s is stored as
+     s * 256, the row of s, and it is -1 until computed. */
+  int *table;
+  int count, capacity;
+  int buckets[DFA_BUCKETS];
+  int start, restart;
+  int is_unanchored;
+};
+
+/* The threads of the Pike VM, each with the capture slots of its own */
+struct threads {
+  struct pcset set;
+  int *caps;
+};
+
+struct regexp_t {
+  struct inst *insts;
+  int count, capacity;
+  int slots;                    /* Two per group, group 0 is the whole match */
+  char prefix[MAX_PREFIX];      /* The bytes every match starts with */
+  int prefix_length;
+  int is_anchored;
+  struct dfa dfas[2];
+  /* Scratch */
+  struct pcset step_set, start_set, end_set;
+  int *stack;
+  struct threads clist, nlist;
+  int *caps;
+};
+
+/* Errors */
+void re_error(struct parser *ps, char *message) {
+  port_format(scm_err_port, "regex-compile: %s in %*\n",
+              make_string(message), ps->pattern);
+  exit(1);
+}
+
+/* Character classes */
+void add_range(struct ranges *rs, int lo, int hi) {
+  if (rs->count == rs->capacity) {
+    rs->capacity = rs->capacity == 0 ? 4: 2 * rs->capacity;
+    rs->data = realloc(rs->data, rs->capacity * sizeof(struct range));
+  }
+  rs->data[rs->count].lo = lo;
+  rs->data[rs->count].hi = hi;
+  rs->count++;
+}
+
+int range_compare(const void *a, const void *b) {
+  return ((struct range *)a)->lo - ((struct range *)b)->lo;
+}
+
+void normalize_ranges(struct ranges *rs) {
+  if (rs->count == 0) return;
+  qsort(rs->data, rs->count, sizeof(struct range), range_compare);
+  int n = 0;
+  for (int i = 1; i < rs->count; i++)
+    if (rs->data[i].lo <= rs->data[n].hi + 1) {
+      if (rs->data[i].hi > rs->data[n].hi)
+        rs->data[n].hi = rs->data[i].hi;
+    } else
+      rs->data[++n] = rs->data[i];
+  rs->count = n + 1;
+}
+
+/* The complement of normalized ranges */
+void negate_ranges(struct ranges *rs) {
+  struct ranges out = {NULL, 0, 0};
+  int lo = 0;
+  for (int i = 0; i < rs->count; i++) {
+    if (rs->data[i].lo > lo)
+      add_range(&out, lo, rs->data[i].lo - 1);
+    lo = rs->data[i].hi + 1;
+  }
+  if (lo <= MAX_CODE_POINT)
+    add_range(&out, lo, MAX_CODE_POINT);
+  free(rs->data);
+  *rs = out;
+}
+
+/* The ranges of \d, \w and \s, negated by the uppercase letters */
+int add_class_escape(struct ranges *rs, char c) {
+  struct ranges class = {NULL, 0, 0};
+  switch (c) {
+    case 'd': case 'D':
+      add_range(&class, '0', '9');
+      break;
+    case 'w': case 'W':
+      add_range(&class, '0', '9');
+      add_range(&class, 'A', 'Z');
+      add_range(&class, '_', '_');
+      add_range(&class, 'a', 'z');
+      break;
+    case 's': case 'S':
+      add_range(&class, '\t', '\r');
+      add_range(&class, ' ', ' ');
+      break;
+    default :
+      return no;
+  }
+  if (c == 'D' || c == 'W' || c == 'S')
+    negate_ranges(&class);
+  for (int i = 0; i < class.count; i++)
+    add_range(rs, class.data[i].lo, class.data[i].hi);
+  free(class.data);
+  return yes;
+}
+
+/* Parser */
+struct node *make_node(struct parser *ps, enum node_kind kind,
+                       struct node *left, struct node *right) {
+  struct node *node = calloc(1, sizeof(struct node));
+  node->kind = kind;
+  node->left = left;
+  node->right = right;
+  node->next_made = ps->made;
+  ps->made = node;
+  return node;
+}
+
+struct node *make_class(struct parser *ps, struct ranges rs) {
+  struct node *node = make_node(ps, N_CLASS, NULL, NULL);
+  normalize_ranges(&rs);
+  node->ranges = rs;
+  return node;
+}
+
+void free_nodes(struct parser *ps) {
+  while (ps->made != NULL) {
+    struct node *node = ps->made;
+    ps->made = node->next_made;
+    free(node->ranges.data);
+    free(node);
+  }
+}
+
+int is_at(struct parser *ps, char c) {
+  return ps->p < ps->end && *ps->p == c;
+}
+
+int parse_code_point(struct parser *ps) {
+  int code;
+  int n = utf8_decode(ps->p, &code);
+  if (n > ps->end - ps->p)
+    re_error(ps, "Truncated character");
+  ps->p += n;
+  return code;
+}
+
+/* Consumes an escape. Returns its character, or -1 after adding the ranges of
+   a class escape to `rs'. */
+int parse_escape(struct parser *ps, struct ranges *rs) {
+  ps->p++;
+  if (ps->p == ps->end)
+    re_error(ps, "Trailing backslash");
+  char c = *ps->p;
+  if (add_class_escape(rs, c)) {
+    ps->p++;
+    return -1;
+  }
+  switch (c) {
+    case 'n': ps->p++; return '\n';
+    case 'r': ps->p++; return '\r';
+    case 't': ps->p++; return '\t';
+    case 'f': ps->p++; return '\f';
+    case 'v': ps->p++; return '\v';
+  }
+  if (('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z') || ('0' <= c && c <= '9'))
+    re_error(ps, "Unknown escape");
+  return parse_code_point(ps);
+}
+
+int parse_class_char(struct parser *ps, struct ranges *rs) {
+  if (is_at(ps, '\\'))
+    return parse_escape(ps, rs);
+  return parse_code_point(ps);
+}
+
+struct node *parse_class(struct parser *ps) {
+  struct ranges rs = {NULL, 0, 0};
+  ps->p++;
+  int is_negated = is_at(ps, '^');
+  if (is_negated) ps->p++;
+  for (int is_first = yes; ; is_first = no) {
+    if (ps->p == ps->end)
+      re_error(ps, "Missing ]");
+    if (*ps->p == ']' && !is_first) {
+      ps->p++;
+      break;
+    }
+    int lo = parse_class_char(ps, &rs);
+    if (lo < 0) continue;
+    if (is_at(ps, '-') && ps->p + 1 < ps->end && ps->p[1] != ']') {
+      ps->p++;
+      int hi = parse_class_char(ps, &rs);
+      if (hi < lo)
+        re_error(ps, "Bad range");
+      add_range(&rs, lo, hi);
+    } else
+      add_range(&rs, lo, lo);
+  }
+  if (is_negated) {
+    normalize_ranges(&rs);
+    negate_ranges(&rs);
+  }
+  return make_class(ps, rs);
+}
+
+struct node *parse_alternation(struct parser *);
+
+struct node *parse_atom(struct parser *ps) {
+  struct ranges rs = {NULL, 0, 0};
+  switch (*ps->p) {
+    case '(': {
+      ps->p++;
+      int group = -1;
+      if (is_at(ps, '?') && ps->p + 1 < ps->end && ps->p[1] == ':')
+        ps->p += 2;
+      else
+        group = ++ps->groups;
+      struct node *node = parse_alternation(ps);
+      if (!is_at(ps, ')'))
+        re_error(ps, "Missing )");
+      ps->p++;
+      if (group < 0) return node;
+      node = make_node(ps, N_GROUP, node, NULL);
+      node->group = group;
+      return node;
+    }
+    case '[':
+      return parse_class(ps);
+    case '.':
+      ps->p++;
+      add_range(&rs, 0, '\n' - 1);
+      add_range(&rs, '\n' + 1, MAX_CODE_POINT);
+      return make_class(ps, rs);
+    case '^':
+      ps->p++;
+      return make_node(ps, N_BOL, NULL, NULL);
+    case '$':
+      ps->p++;
+      return make_node(ps, N_EOL, NULL, NULL);
+    case '*': case '+': case '?':
+      re_error(ps, "Nothing to repeat");
+    case '\\': {
+      int c = parse_escape(ps, &rs);
+      if (c >= 0)
+        add_range(&rs, c, c);
+      return make_class(ps, rs);
+    }
+  }
+  int c = parse_code_point(ps);
+  add_range(&rs, c, c);
+  return make_class(ps, rs);
+}
+
+int parse_number(struct parser *ps, int *n) {
+  if (ps->p == ps->end || *ps->p < '0' || *ps->p > '9') return no;
+  *n = 0;
+  while (ps->p < ps->end && '0' <= *ps->p && *ps->p <= '9') {
+    *n = *n * 10 + *ps->p++ - '0';
+    if (*n > MAX_REPEAT)
+      re_error(ps, "Repetition count too large");
+  }
+  return yes;
+}
+
+/* Parses {m}, {m,} or {m,n}. Otherwise the brace is a literal and nothing is
+   consumed. */
+int parse_bounds(struct parser *ps, int *min, int *max) {
+  char *start = ps->p;
+  ps->p++;
+  if (!parse_number(ps, min)) goto literal;
+  *max = *min;
+  if (is_at(ps, ',')) {
+    ps->p++;
+    if (!parse_number(ps, max))
+      *max = -1;
+  }
+  if (!is_at(ps, '}')) goto literal;
+  ps->p++;
+  if (*max >= 0 && *max < *min)
+    re_error(ps, "Bad repetition bounds");
+  return yes;
+literal:
+  ps->p = start;
+  return no;
+}
+
+struct node *parse_repeat(struct parser *ps) {
+  struct node *node = parse_atom(ps);
+  while (ps->p < ps->end) {
+    int min, max;
+    char c = *ps->p;
+    if (c == '*') min = 0, max = -1;
+    else if (c == '+') min = 1, max = -1;
+    else if (c == '?') min = 0, max = 1;
+    else if (c != '{' || !parse_bounds(ps, &min, &max)) break;
+    if (c != '{') ps->p++;
+    if (node->kind == N_BOL || node->kind == N_EOL)
+      re_error(ps, "Nothing to repeat");
+    node = make_node(ps, N_REPEAT, node, NULL);
+    node->min = min;
+    node->max = max;
+    node->is_greedy = !is_at(ps, '?');
+    if (!node->is_greedy) ps->p++;
+  }
+  return node;
+}
+
+struct node *parse_concatenation(struct parser *ps) {
+  struct node *node = make_node(ps, N_EMPTY, NULL, NULL);
+  while (ps->p < ps->end && *ps->p != '|' && *ps->p != ')') {
+    struct node *next = parse_repeat(ps);
+    node = node->kind == N_EMPTY ? next: make_node(ps, N_CAT, node, next);
+  }
+  return node;
+}
+
+struct node *parse_alternation(struct parser *ps) {
+  struct node *node = parse_concatenation(ps);
+  while (is_at(ps, '|')) {
+    ps->p++;
+    node = make_node(ps, N_ALT, node, parse_concatenation(ps));
+  }
+  return node;
+}
+
+/* Analysis */
+/* Appends the bytes every match of `node' starts with to `re->prefix'.
+   Returns no if something else may follow them. */
+int add_prefix(struct regexp_t *re, struct node *node) {
+  switch (node->kind) {
+    case N_EMPTY: case N_BOL:
+      return yes;
+    case N_CLASS: {
+      struct range *r = node->ranges.data;
+      if (node->ranges.count != 1 || r->lo != r->hi ||
+          re->prefix_length + UTF8_LENGTH > MAX_PREFIX)
+        return no;
+      re->prefix_length += utf8_encode(r->lo, re->prefix + re->prefix_length);
+      return yes;
+    }
+    case N_CAT:
+      return add_prefix(re, node->left) && add_prefix(re, node->right);
+    case N_GROUP:
+      return add_prefix(re, node->left);
+    case N_REPEAT:
+      if (node->min > 0)
+        add_prefix(re, node->left);
+      return no;
+    default :
+      return no;
+  }
+}
+
+int starts_with_bol(struct node *node) {
+  while (node->kind == N_CAT || node->kind == N_GROUP)
+    node = node->left;
+  return node->kind == N_BOL;
+}
+
+/* Code generation */
+int re_emit(struct regexp_t *re, struct parser *ps, enum inst_op op, int x, int y) {
+  if (re->count == MAX_INSTS)
+    re_error(ps, "Pattern too large");
+  if (re->count == re->capacity) {
+    re->capacity = 2 * re->capacity;
+    re->insts = realloc(re->insts, re->capacity * sizeof(struct inst));
+  }
+  struct inst *ins = &re->insts[re->count];
+  memset(ins, 0, sizeof(struct inst));
+  ins->op = op;
+  ins->x = x;
+  ins->y = y;
+  return re->count++;
+}
+
+void set_bytes(struct inst *ins, int lo, int hi) {
+  for (int b = lo; b <= hi; b++)
+    ins->set[b >> 5] |= 1u << (b & 31);
+}
+
+/* A code point range whose UTF-8 encodings agree in length as byte ranges */
+struct sequence {
+  int length;
+  unsigned char lo[UTF8_LENGTH], hi[UTF8_LENGTH];
+};
+
+struct sequences {
+  struct sequence *data;
+  int count, capacity;
+};
+
+/* Splits [lo, hi] until every byte of the encodings ranges independently */
+void add_utf8_sequences(struct sequences *seqs, int lo, int hi) {
+  static const int boundaries[] = {0x7f, 0x7ff, 0xffff};
+  if (lo > hi) return;
+  for (int i = 0; i < 3; i++)
+    if (lo <= boundaries[i] && boundaries[i] < hi) {
+      add_utf8_sequences(seqs, lo, boundaries[i]);
+      add_utf8_sequences(seqs, boundaries[i] + 1, hi);
+      return;
+    }
+  for (int i = 1; i < UTF8_LENGTH; i++) {
+    int m = (1 << (6 * i)) - 1;
+    if ((lo & ~m) != (hi & ~m)) {
+      if ((lo & m) != 0) {
+        add_utf8_sequences(seqs, lo, lo | m);
+        add_utf8_sequences(seqs, (lo | m) + 1, hi);
+        return;
+      }
+      if ((hi & m) != m) {
+        add_utf8_sequences(seqs, lo, (hi & ~m) - 1);
+        add_utf8_sequences(seqs, hi & ~m, hi);
+        return;
+      }
+    }
+  }
+  if (seqs->count == seqs->capacity) {
+    seqs->capacity = seqs->capacity == 0 ? 8: 2 * seqs->capacity;
+    seqs->data = realloc(seqs->data, seqs->capacity * sizeof(struct sequence));
+  }
+  struct sequence *seq = &seqs->data[seqs->count++];
+  seq->length = utf8_encode(lo, (char *)seq->lo);
+  utf8_encode(hi, (char *)seq->hi);
+}
+
+/* The ASCII part of a class is a single byte set, every other sequence is an
+   alternative of its own */
+void compile_class_node(struct regexp_t *re, struct parser *ps, struct ranges *rs) {
+  struct sequences seqs = {NULL, 0, 0};
+  uint32_t ascii[8] = {0};
+  int has_ascii = no;
+  for (int i = 0; i < rs->count; i++) {
+    int lo = rs->data[i].lo, hi = rs->data[i].hi;
+    if (lo < 0x80) {
+      for (int b = lo; b <= hi && b < 0x80; b++)
+        ascii[b >> 5] |= 1u << (b & 31);
+      has_ascii = yes;
+      lo = 0x80;
+    }
+    add_utf8_sequences(&seqs, lo, hi);
+  }
+  int alternatives = has_ascii + seqs.count;
+  if (alternatives == 0) {
+    /* Matches nothing */
+    re_emit(re, ps, I_BYTE, 0, 0);
+    return;
+  }
+  int *jumps = malloc(alternatives * sizeof(int));
+  for (int k = 0; k < alternatives; k++) {
+    int split = -1;
+    if (k < alternatives - 1)
+      split = re_emit(re, ps, I_SPLIT, re->count + 1, 0);
+    if (has_ascii && k == 0) {
+      int pc = re_emit(re, ps, I_BYTE, 0, 0);
+      memcpy(re->insts[pc].set, ascii, sizeof(ascii));
+    } else {
+      struct sequence *seq = &seqs.data[k - has_ascii];
+      for (int i = 0; i < seq->length; i++) {
+        int pc = re_emit(re, ps, I_BYTE, 0, 0);
+        set_bytes(&re->insts[pc], seq->lo[i], seq->hi[i]);
+      }
+    }
+    if (split >= 0) {
+      jumps[k] = re_emit(re, ps, I_JMP, 0, 0);
+      re->insts[split].y = re->count;
+    }
+  }
+  for (int k = 0; k < alternatives - 1; k++)
+    re->insts[jumps[k]].x = re->count;
+  free(jumps);
+  free(seqs.data);
+}
+
+void compile_node(struct regexp_t *re, struct parser *ps, struct node *node) {
+  switch (node->kind) {
+    case N_EMPTY:
+      break;
+    case N_CLASS:
+      compile_class_node(re, ps, &node->ranges);
+      break;
+    case N_CAT:
+      compile_node(re, ps, node->left);
+      compile_node(re, ps, node->right);
+      break;
+    case N_ALT: {
+      int split = re_emit(re, ps, I_SPLIT, re->count + 1, 0);
+      compile_node(re, ps, node->left);
+      int jump = re_emit(re, ps, I_JMP, 0, 0);
+      re->insts[split].y = re->count;
+      compile_node(re, ps, node->right);
+      re->insts[jump].x = re->count;
+      break;
+    }
+    case N_GROUP:
+      re_emit(re, ps, I_SAVE, 2 * node->group, 0);
+      compile_node(re, ps, node->left);
+      re_emit(re, ps, I_SAVE, 2 * node->group + 1, 0);
+      break;
+    case N_BOL:
+      re_emit(re, ps, I_BOL, 0, 0);
+      break;
+    case N_EOL:
+      re_emit(re, ps, I_EOL, 0, 0);
+      break;
+    case N_REPEAT:
+      for (int i = 0; i < node->min; i++)
+        compile_node(re, ps, node->left);
+      if (node->max < 0) {
+        /* L: SPLIT body, end; body; JMP L */
+        int split = re_emit(re, ps, I_SPLIT, 0, 0);
+        compile_node(re, ps, node->left);
+        re_emit(re, ps, I_JMP, split, 0);
+        re->insts[split].x = split + 1;
+        re->insts[split].y = re->count;
+        if (!node->is_greedy) {
+          re->insts[split].x = re->count;
+          re->insts[split].y = split + 1;
+        }
+      } else {
+        /* Every optional copy may skip to the end */
+        int optional = node->max - node->min;
+        int *splits = malloc((optional + 1) * sizeof(int));
+        for (int i = 0; i < optional; i++) {
+          splits[i] = re_emit(re, ps, I_SPLIT, 0, 0);
+          compile_node(re, ps, node->left);
+        }
+        for (int i = 0; i < optional; i++) {
+          struct inst *split = &re->insts[splits[i]];
+          split->x = node->is_greedy ? splits[i] + 1: re->count;
+          split->y = node->is_greedy ? re->count: splits[i] + 1;
+        }
+        free(splits);
+      }
+      break;
+  }
+}
+
+/* Sparse sets */
+void init_pcset(struct pcset *set, int size) {
+  set->dense = malloc(size * sizeof(int));
+  set->sparse = calloc(size, sizeof(int));
+  set->count = 0;
+}
+
+int pcset_contains(struct pcset *set, int pc) {
+  unsigned int i = set->sparse[pc];
+  return i < (unsigned int)set->count && set->dense[i] == pc;
+}
+
+void pcset_add(struct pcset *set, int pc) {
+  set->sparse[pc] = set->count;
+  set->dense[set->count++] = pc;
+}
+
+void free_pcset(struct pcset *set) {
+  free(set->dense);
+  free(set->sparse);
+}
+
+int has_byte(struct inst *ins, unsigned char b) {
+  return (ins->set[b >> 5] >> (b & 31)) & 1;
+}
+
+/* Adds to `set' the instructions reachable from `pc' without consuming a
+   byte */
+void add_closure(struct regexp_t *re, struct pcset *set, int pc,
+                 int is_at_bol, int is_at_end) {
+  int top = 0;
+  re->stack[top++] = pc;
+  while (top > 0) {
+    pc = re->stack[--top];
+    while (!pcset_contains(set, pc)) {
+      pcset_add(set, pc);
+      struct inst *ins = &re->insts[pc];
+      if (ins->op == I_JMP)
+        pc = ins->x;
+      else if (ins->op == I_SPLIT) {
+        re->stack[top++] = ins->y;
+        pc = ins->x;
+      } else if (ins->op == I_SAVE ||
+                 (ins->op == I_BOL && is_at_bol) ||
+                 (ins->op == I_EOL && is_at_end))
+        pc++;
+      else
+        break;
+    }
+  }
+}
+
+/* Lazy DFA */
+int pc_compare(const void *a, const void *b) {
+  return *(int *)a - *(int *)b;
+}
+
+void dfa_flush(struct dfa *dfa) {
+  for (int i = 0; i < dfa->count; i++)
+    free(dfa->states[i].pcs);
+  dfa->count = 0;
+  for (int i = 0; i < DFA_BUCKETS; i++)
+    dfa->buckets[i] = -1;
+  dfa->start = dfa->restart = -1;
+}
+
+/* Returns the state of the instructions in `set', or -1 if the cache is full */
+int dfa_find_state(struct regexp_t *re, struct dfa *dfa, struct pcset *set) {
+  int *pcs = malloc((set->count + 1) * sizeof(int));
+  int count = 0;
+  for (int i = 0; i < set->count; i++) {
+    enum inst_op op = re->insts[set->dense[i]].op;
+    if (op == I_BYTE || op == I_EOL || op == I_MATCH)
+      pcs[count++] = set->dense[i];
+  }
+  qsort(pcs, count, sizeof(int), pc_compare);
+  unsigned int hash = count;
+  for (int i = 0; i < count; i++)
+    hash = hash * 31 + pcs[i];
+  for (int s = dfa->buckets[hash % DFA_BUCKETS]; s >= 0; s = dfa->states[s].chain) {
+    struct dfa_state *state = &dfa->states[s];
+    if (state->hash == hash && state->count == count &&
+        memcmp(state->pcs, pcs, count * sizeof(int)) == 0) {
+      free(pcs);
+      return s;
+    }
+  }
+  if (dfa->count == DFA_MAX_STATES) {
+    free(pcs);
+    return -1;
+  }
+  if (dfa->count == dfa->capacity) {
+    dfa->capacity = dfa->capacity == 0 ? 16: 2 * dfa->capacity;
+    dfa->states = realloc(dfa->states, dfa->capacity * sizeof(struct dfa_state));
+    dfa->table = realloc(dfa->table, dfa->capacity * 256 * sizeof(int));
+  }
+  int s = dfa->count++;
+  struct dfa_state *state = &dfa->states[s];
+  state->pcs = pcs;
+  state->count = count;
+  state->hash = hash;
+  state->chain = dfa->buckets[hash % DFA_BUCKETS];
+  dfa->buckets[hash % DFA_BUCKETS] = s;
+  state->is_match = no;
+  struct pcset *end = &re->end_set;
+  end->count = 0;
+  for (int i = 0; i < count; i++)
+    if (re->insts[pcs[i]].op == I_MATCH)
+      state->is_match = yes;
+    else if (re->insts[pcs[i]].op == I_EOL)
+      add_closure(re, end, pcs[i] + 1, no, yes);
+  state->is_match_at_end = state->is_match || pcset_contains(end, re->count - 1);
+  state->is_special = state->is_match || count == 0;
+  memset(dfa->table + s * 256, -1, 256 * sizeof(int));
+  return s;
+}
+
+/* The state of a search about to start at position 0 or later */
+int dfa_start_state(struct regexp_t *re, struct dfa *dfa, int is_at_bol) {
+  struct pcset *set = &re->start_set;
+  set->count = 0;
+  add_closure(re, set, 0, is_at_bol, no);
+  return dfa_find_state(re, dfa, set);
+}
+
+void dfa_add_starts(struct regexp_t *re, struct dfa *dfa) {
+  dfa->start = dfa_start_state(re, dfa, yes);
+  dfa->restart = dfa_start_state(re, dfa, no);
+  if (dfa->is_unanchored && re->prefix_length > 0)
+    dfa->states[dfa->restart].is_special = yes;
+}
+
+int dfa_step(struct regexp_t *re, struct dfa *dfa, int s, unsigned char b) {
+  struct pcset *set = &re->step_set;
+  set->count = 0;
+  struct dfa_state *state = &dfa->states[s];
+  for (int i = 0; i < state->count; i++) {
+    struct inst *ins = &re->insts[state->pcs[i]];
+    if (ins->op == I_BYTE && has_byte(ins, b))
+      add_closure(re, set, state->pcs[i] + 1, no, no);
+  }
+  if (dfa->is_unanchored)
+    add_closure(re, set, 0, no, no);
+  int next = dfa_find_state(re, dfa, set);
+  if (next < 0) {
+    dfa_flush(dfa);
+    dfa_add_starts(re, dfa);
+    return dfa_find_state(re, dfa, set);
+  }
+  dfa->table[s * 256 + b] = next * 256;
+  return next;
+}
+
+/* Where the literal prefix next occurs from `s', or NULL */
+char *find_prefix(struct regexp_t *re, char *s, int n) {
+  if (re->prefix_length == 1)
+    return memchr(s, re->prefix[0], n);
+  return (char *)utf8_search(s, n, re->prefix, re->prefix_length);
+}
+
+/* Does `s' match as a whole, or contain a match? */
+int dfa_run(struct regexp_t *re, char *s, int n, int is_whole) {
+  struct dfa *dfa = &re->dfas[!is_whole && !re->is_anchored];
+  if (dfa->start < 0)
+    dfa_add_starts(re, dfa);
+  int *table = dfa->table;
+  struct dfa_state *states = dfa->states;
+  int row = dfa->start * 256;
+  for (int pos = 0; pos < n; pos++) {
+    if (states[row >> 8].is_special) {
+      struct dfa_state *state = &states[row >> 8];
+      if (state->count == 0) return no;
+      if (!is_whole && state->is_match) return yes;
+      if (row >> 8 == dfa->restart) {
+        char *found = find_prefix(re, s + pos, n - pos);
+        if (found == NULL) return no;
+        pos = found - s;
+      }
+    }
+    unsigned char b = s[pos];
+    int next = table[row + b];
+    if (next < 0) {
+      next = dfa_step(re, dfa, row >> 8, b) * 256;
+      table = dfa->table;
+      states = dfa->states;
+    }
+    row = next;
+  }
+  return states[row >> 8].is_match_at_end;
+}
+
+/* Pike VM */
+void add_thread(struct regexp_t *re, struct threads *list, int pc, int *caps,
+                int pos, int n) {
+  /* The entries below -1 restore the capture slot -2 - entry */
+  int top = 0;
+  re->stack[top++] = pc;
+  while (top > 0) {
+    pc = re->stack[--top];
+    if (pc < -1) {
+      int slot = -2 - pc;
+      caps[slot] = re->stack[--top];
+      continue;
+    }
+    while (!pcset_contains(&list->set, pc)) {
+      int i = list->set.count;
+      pcset_add(&list->set, pc);
+      struct inst *ins = &re->insts[pc];
+      if (ins->op == I_JMP)
+        pc = ins->x;
+      else if (ins->op == I_SPLIT) {
+        re->stack[top++] = ins->y;
+        pc = ins->x;
+      } else if (ins->op == I_SAVE) {
+        re->stack[top++] = caps[ins->x];
+        re->stack[top++] = -2 - ins->x;
+        caps[ins->x] = pos;
+        pc++;
+      } else if ((ins->op == I_BOL && pos == 0) || (ins->op == I_EOL && pos == n))
+        pc++;
+      else {
+        if (ins->op == I_BYTE || ins->op == I_MATCH)
+          memcpy(list->caps + i * re->slots, caps, re->slots * sizeof(int));
+        break;
+      }
+    }
+  }
+}
+
+void add_start_thread(struct regexp_t *re, struct threads *list, int pos, int n) {
+  for (int i = 0; i < re->slots; i++)
+    re->caps[i] = -1;
+  add_thread(re, list, 0, re->caps, pos, n);
+}
+
+/* Leftmost-first search from `from', the captures are left in `re->caps' */
+int pike_run(struct regexp_t *re, char *s, int n, int from, int is_whole) {
+  int is_anchored = is_whole || re->is_anchored;
+  int found[re->slots];
+  int is_matched = no;
+  struct threads *clist = &re->clist, *nlist = &re->nlist;
+  clist->set.count = 0;
+  add_start_thread(re, clist, from, n);
+  for (int pos = from; ; pos++) {
+    /* With no thread left a match can only start at the prefix */
+    if (clist->set.count == 0) {
+      if (is_matched || is_anchored || re->prefix_length == 0) break;
+      char *next = find_prefix(re, s + pos, n - pos);
+      if (next == NULL) break;
+      pos = next - s;
+      add_start_thread(re, clist, pos, n);
+    }
+    nlist->set.count = 0;
+    for (int i = 0; i < clist->set.count; i++) {
+      int pc = clist->set.dense[i];
+      int *caps = clist->caps + i * re->slots;
+      struct inst *ins = &re->insts[pc];
+      if (ins->op == I_MATCH) {
+        if (is_whole && pos != n) continue;
+        /* The threads of lower priority are cut */
+        memcpy(found, caps, re->slots * sizeof(int));
+        is_matched = yes;
+        break;
+      }
+      if (ins->op == I_BYTE && pos < n && has_byte(ins, s[pos]))
+        add_thread(re, nlist, pc + 1, caps, pos + 1, n);
+    }
+    if (pos == n) break;
+    if (!is_matched && !is_anchored &&
+        (nlist->set.count > 0 || re->prefix_length == 0))
+      add_start_thread(re, nlist, pos + 1, n);
+    struct threads *t = clist;
+    clist = nlist;
+    nlist = t;
+  }
+  memcpy(re->caps, found, re->slots * sizeof(int));
+  return is_matched;
+}
+
+/* Programs */
+struct regexp_t *compile_regexp(sexp pattern) {
+  struct parser ps;
+  ps.p = string_value(pattern);
+  ps.end = ps.p + string_byte_length(pattern);
+  ps.groups = 0;
+  ps.pattern = pattern;
+  ps.made = NULL;
+  struct node *node = parse_alternation(&ps);
+  if (ps.p < ps.end)
+    re_error(&ps, "Unmatched )");
+
+  struct regexp_t *re = calloc(1, sizeof(struct regexp_t));
+  re->capacity = 16;
+  re->insts = malloc(re->capacity * sizeof(struct inst));
+  re->slots = 2 * (ps.groups + 1);
+  re_emit(re, &ps, I_SAVE, 0, 0);
+  compile_node(re, &ps, node);
+  re_emit(re, &ps, I_SAVE, 1, 0);
+  re_emit(re, &ps, I_MATCH, 0, 0);
+  add_prefix(re, node);
+  re->is_anchored = starts_with_bol(node);
+  free_nodes(&ps);
+
+  init_pcset(&re->step_set, re->count);
+  init_pcset(&re->start_set, re->count);
+  init_pcset(&re->end_set, re->count);
+  re->stack = malloc(2 * re->count * sizeof(int));
+  for (int i = 0; i < 2; i++) {
+    dfa_flush(&re->dfas[i]);
+    re->dfas[i].is_unanchored = i;
+  }
+  for (int i = 0; i < 2; i++) {
+    struct threads *list = i == 0 ? &re->clist: &re->nlist;
+    init_pcset(&list->set, re->count);
+    list->caps = malloc(re->count * re->slots * sizeof(int));
+  }
+  re->caps = malloc(re->slots * sizeof(int));
+  return re;
+}
+
+void free_regexp(struct regexp_t *re) {
+  for (int i = 0; i < 2; i++) {
+    dfa_flush(&re->dfas[i]);
+    free(re->dfas[i].states);
+    free(re->dfas[i].table);
+  }
+  free_pcset(&re->step_set);
+  free_pcset(&re->start_set);
+  free_pcset(&re->end_set);
+  free_pcset(&re->clist.set);
+  free_pcset(&re->nlist.set);
+  free(re->clist.caps);
+  free(re->nlist.caps);
+  free(re->stack);
+  free(re->caps);
+  free(re->insts);
+  free(re);
+}
+
+/* Checkers */
+void check_regexp(sexp regexp, char *op) {
+  if (is_regexp(regexp)) return;
+  port_format(scm_err_port, "%s: Wrong type argument %*\n", make_string(op), regexp);
+  exit(1);
+}
+
+void check_regexp_string(sexp string, char *op) {
+  if (is_string(string)) return;
+  port_format(scm_err_port, "%s: Wrong type argument %*\n", make_string(op), string);
+  exit(1);
+}
+
+/* The list of the matched strings, the whole match and then the groups, #f
+   for a group which did not participate */
+sexp match_groups(struct regexp_t *re, char *s) {
+  sexp groups = EOL;
+  for (int i = re->slots / 2 - 1; i >= 0; i--) {
+    int start = re->caps[2 * i], end = re->caps[2 * i + 1];
+    sexp group = start < 0 || end < 0 ? false_object:
+        make_string(strndup(s + start, end - start));
+    groups = make_pair(group, groups);
+  }
+  return groups;
+}
+
+/* Procedures */
+sexp regexp_compile(sexp pattern) {
+  check_regexp_string(pattern, "regex-compile");
+  return make_regexp(compile_regexp(pattern), pattern);
+}
+
+sexp regexp_match(sexp regexp, sexp string) {
+  check_regexp(regexp, "regex-match");
+  check_regexp_string(string, "regex-match");
+  struct regexp_t *re = regexp_program(regexp);
+  char *s = string_value(string);
+  int n = string_byte_length(string);
+  if (!dfa_run(re, s, n, yes) || !pike_run(re, s, n, 0, yes))
+    return false_object;
+  return match_groups(re, s);
+}
+
+sexp regexp_search(sexp regexp, sexp string) {
+  check_regexp(regexp, "regex-search");
+  check_regexp_string(string, "regex-search");
+  struct regexp_t *re = regexp_program(regexp);
+  char *s = string_value(string);
+  int n = string_byte_length(string);
+  if (!dfa_run(re, s, n, no) || !pike_run(re, s, n, 0, no))
+    return false_object;
+  return match_groups(re, s);
+}
+
+/* Reads lines from `port' until one contains a match, which is returned
+   without its newline. Only the DFA runs over the lines. */
+sexp regexp_search_port(sexp regexp, sexp port) {
+  static char *line = NULL;
+  static size_t size = 0;
+  check_regexp(regexp, "regex-search-port");
+  if (!is_in_port(port)) {
+    port_format(scm_err_port, "regex-search-port: Wrong type argument %*\n", port);
+    exit(1);
+  }
+  ssize_t n;
+  while ((n = getline(&line, &size, in_port_stream(port))) >= 0) {
+    if (n > 0 && line[n - 1] == '\n') {
+      line[--n] = '\0';
+      in_port_linum(port)++;
+    }
+    if (dfa_run(regexp_program(regexp), line, n, no))
+      return make_string(strndup(line, n));
+  }
+  return eof_object;
+}
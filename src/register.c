@@ -0,0 +1,426 @@
+/*
+ * register.c
+ *
+ * Translate the stack-based code into the register-based code
+ *
+ * Copyright (C) 2013-04-10 liutos <mat.liutos@gmail.com>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "object.h"
+#include "register.h"
+#include "types.h"
+
+#define op_is(op, name) (S(name) == (op))
+#define arg1(x) pair_cadr(x)
+#define arg2(x) pair_caddr(x)
+
+/*
+ * A procedure in the register tier keeps its arguments and temporaries
+ * in a window of slots on the VM stack, starting at the frame pointer. The
+ * first slots are the arguments, the rest hold the values which the stack
+ * tier would push. The translator simulates the operand stack, so an
+ * operand is folded into the instruction consuming it whenever possible.
+ */
+enum entry_type {
+  TEMP,                                 /* Value in its temporary register */
+  CONSTANT,                             /* Constant not loaded yet */
+  LOCAL,                                /* Argument register not copied yet */
+  CALL_FRAME,                           /* Call frame pushed by SAVE */
+};
+
+struct entry_t {
+  enum entry_type type;
+  sexp value;
+};
+
+/* The symbolic stack at the entry of a label */
+typedef struct label_state_t {
+  sexp label;
+  int depth;
+  int is_passed;
+  int is_return;
+  struct entry_t *entries;
+  struct label_state_t *next;
+} *label_state_t;
+
+struct translator_t {
+  struct entry_t *stack;
+  int depth;
+  int nlocals;
+  int nregs;
+  int is_reachable;
+  int is_failed;
+  label_state_t states;
+  sexp head;
+  sexp tail;
+};
+
+/* When true, every compiled lambda is translated if possible */
+int is_register_tier = no;
+
+/* Output */
+void emit(struct translator_t *t, sexp ins) {
+  sexp cell = make_pair(ins, EOL);
+  pair_cdr(t->tail) = cell;
+  t->tail = cell;
+}
+
+/* The symbolic stack */
+sexp temp_register(struct translator_t *t, int depth) {
+  int n = t->nlocals + depth;
+  if (n + 1 > t->nregs)
+    t->nregs = n + 1;
+  return to_register(n);
+}
+
+void push_entry(struct translator_t *t, enum entry_type type, sexp value) {
+  t->stack[t->depth].type = type;
+  t->stack[t->depth].value = value;
+  t->depth++;
+}
+
+/* Pushes a temporary and returns the register holding it */
+sexp push_temp(struct translator_t *t) {
+  sexp reg = temp_register(t, t->depth);
+  push_entry(t, TEMP, reg);
+  return reg;
+}
+
+sexp pop_operand(struct translator_t *t) {
+  if (t->depth == 0 || t->stack[t->depth - 1].type == CALL_FRAME) {
+    t->is_failed = yes;
+    return EOL;
+  }
+  t->depth--;
+  return t->stack[t->depth].value;
+}
+
+/* Copies the pending operand at `depth' into its temporary register */
+void materialize(struct translator_t *t, int depth) {
+  struct entry_t *e = &t->stack[depth];
+  if (e->type != CONSTANT && e->type != LOCAL) return;
+  sexp reg = temp_register(t, depth);
+  emit(t, LIST(S("RMOV"), reg, e->value));
+  e->type = TEMP;
+  e->value = reg;
+}
+
+void canonicalize(struct translator_t *t) {
+  for (int i = 0; i < t->depth; i++)
+    materialize(t, i);
+}
+
+/* The argument register `reg' is about to change */
+void spill_local(struct translator_t *t, sexp reg) {
+  for (int i = 0; i < t->depth; i++)
+    if (t->stack[i].type == LOCAL && t->stack[i].value == reg)
+      materialize(t, i);
+}
+
+/* Labels */
+label_state_t find_state(struct translator_t *t, sexp label) {
+  for (label_state_t s = t->states; s != NULL; s = s->next)
+    if (s->label == label) return s;
+  return NULL;
+}
+
+label_state_t make_state(struct translator_t *t, sexp label) {
+  label_state_t s = calloc(1, sizeof(struct label_state_t));
+  s->label = label;
+  s->depth = -1;
+  s->next = t->states;
+  t->states = s;
+  return s;
+}
+
+/* Records the canonical stack as the state at the entry of `label' */
+void save_state(struct translator_t *t, sexp label, int is_return) {
+  label_state_t s = find_state(t, label);
+  if (s == NULL) s = make_state(t, label);
+  if (s->is_passed) {
+    t->is_failed = yes;
+    return;
+  }
+  if (s->depth >= 0) {
+    if (s->depth != t->depth || s->is_return != is_return)
+      t->is_failed = yes;
+    return;
+  }
+  s->depth = t->depth;
+  s->is_return = is_return;
+  s->entries = malloc((t->depth + 1) * sizeof(struct entry_t));
+  memcpy(s->entries, t->stack, t->depth * sizeof(struct entry_t));
+  if (is_return) {
+    /* The value returned replaces the return information */
+    s->entries[t->depth - 1].type = TEMP;
+    s->entries[t->depth - 1].value = temp_register(t, t->depth - 1);
+  }
+}
+
+void enter_label(struct translator_t *t, sexp label) {
+  if (t->is_reachable) {
+    canonicalize(t);
+    save_state(t, label, no);
+  }
+  emit(t, label);
+  label_state_t s = find_state(t, label);
+  if (s == NULL) s = make_state(t, label);
+  s->is_passed = yes;
+  if (s->depth < 0) {
+    t->is_reachable = no;
+    return;
+  }
+  t->depth = s->depth;
+  memcpy(t->stack, s->entries, s->depth * sizeof(struct entry_t));
+  t->is_reachable = yes;
+  if (s->is_return)
+    emit(t, LIST(S("RPOP"), t->stack[t->depth - 1].value));
+}
+
+void free_states(label_state_t s) {
+  while (s != NULL) {
+    label_state_t next = s->next;
+    free(s->entries);
+    free(s);
+    s = next;
+  }
+}
+
+/* Instructions */
+/* Replaces the operands of a primitive instruction by a temporary */
+void translate_primitive(struct translator_t *t, char *name, int nargs) {
+  sexp a = pop_operand(t);
+  sexp b = nargs > 1 ? pop_operand(t): NULL;
+  sexp d = push_temp(t);
+  emit(t, LIST(S(name), d, a, b));
+}
+
+void translate_prim_call(struct translator_t *t, char *name, int nargs) {
+  sexp ins = LIST(S(name), EOL);
+  sexp tail = pair_cdr(ins);
+  for (int i = 0; i <= nargs; i++) {
+    pair_cdr(tail) = make_pair(pop_operand(t), EOL);
+    tail = pair_cdr(tail);
+  }
+  pair_cadr(ins) = push_temp(t);
+  emit(t, ins);
+}
+
+/* The record type and the slot index of `ins' stay immediate arguments */
+void translate_record(struct translator_t *t, char *name, int nargs, sexp ins) {
+  sexp a = pop_operand(t);
+  sexp b = nargs > 1 ? pop_operand(t): NULL;
+  sexp d = push_temp(t);
+  emit(t, nconc_pair(LIST(S(name), d, a, b), pair_cdr(ins)));
+}
+
+/* The record is made in the register above its operands, which are then
+   moved into its slots */
+void translate_record_make(struct translator_t *t, sexp type) {
+  sexp r = temp_register(t, t->depth);
+  emit(t, LIST(S("RRECNEW"), r, type));
+  for (int i = 0; i < record_type_size(type); i++)
+    emit(t, LIST(S("RRECINIT"), r, pop_operand(t), make_fixnum(i)));
+  emit(t, LIST(S("RMOV"), push_temp(t), r));
+}
+
+/* Pushes the method for the first argument, which stays for the call */
+void translate_method(struct translator_t *t, sexp ins) {
+  sexp x = pop_operand(t);
+  if (t->is_failed) return;
+  t->depth++;
+  sexp d = push_temp(t);
+  emit(t, nconc_pair(LIST(S("RGMETHOD"), d, x), pair_cdr(ins)));
+}
+
+void translate_call(struct translator_t *t, int nargs) {
+  int base = t->depth - nargs - 1;
+  if (base < 0) {
+    t->is_failed = yes;
+    return;
+  }
+  int is_tail = base == 0;
+  if (!is_tail && t->stack[base - 1].type != CALL_FRAME) {
+    t->is_failed = yes;
+    return;
+  }
+  for (int i = base; i < t->depth; i++) {
+    if (t->stack[i].type == CALL_FRAME) {
+      t->is_failed = yes;
+      return;
+    }
+    emit(t, LIST(S("RPUSH"), t->stack[i].value));
+  }
+  t->depth = base;
+  if (is_tail)
+    emit(t, LIST(S("RCALLJ"), make_fixnum(nargs)));
+  else
+    emit(t, LIST(S("CALLJ"), make_fixnum(nargs)));
+  t->is_reachable = no;
+}
+
+void translate_instruction(struct translator_t *t, sexp ins) {
+  sexp op = pair_car(ins);
+  if (op_is(op, "CONST"))
+    push_entry(t, CONSTANT, arg1(ins));
+  else if (op_is(op, "SVAR"))
+    push_entry(t, LOCAL, to_register(fixnum_value(arg1(ins))));
+  else if (op_is(op, "LVAR")) {
+    sexp d = push_temp(t);
+    emit(t, LIST(S("RLVAR"), d, arg1(ins), arg2(ins)));
+  } else if (op_is(op, "GVAR")) {
+    sexp d = push_temp(t);
+    emit(t, LIST(S("RGVAR"), d, arg1(ins)));
+  } else if (op_is(op, "SSET")) {
+    sexp reg = to_register(fixnum_value(arg1(ins)));
+    spill_local(t, reg);
+    emit(t, LIST(S("RMOV"), reg, t->stack[t->depth - 1].value));
+  } else if (op_is(op, "LSET"))
+    emit(t, LIST(S("RLSET"), arg1(ins), arg2(ins), t->stack[t->depth - 1].value));
+  else if (op_is(op, "GSET"))
+    emit(t, LIST(S("RGSET"), arg1(ins), t->stack[t->depth - 1].value));
+  else if (op_is(op, "POP"))
+    pop_operand(t);
+  else if (op_is(op, "SAVE")) {
+    canonicalize(t);
+    push_entry(t, CALL_FRAME, EOL);
+    save_state(t, arg1(ins), yes);
+    emit(t, ins);
+  } else if (op_is(op, "CALLJ") || op_is(op, "SCALLJ"))
+    translate_call(t, fixnum_value(arg1(ins)));
+  else if (op_is(op, "RETURN")) {
+    emit(t, LIST(S("RRET"), pop_operand(t)));
+    t->is_reachable = no;
+  } else if (op_is(op, "FJUMP") || op_is(op, "TJUMP")) {
+    sexp a = pop_operand(t);
+    canonicalize(t);
+    save_state(t, arg1(ins), no);
+    emit(t, LIST(S(op_is(op, "FJUMP") ? "RFJUMP": "RTJUMP"), a, arg1(ins)));
+  } else if (op_is(op, "JUMP")) {
+    canonicalize(t);
+    save_state(t, arg1(ins), no);
+    emit(t, ins);
+    t->is_reachable = no;
+  } else if (op_is(op, "PRIM0"))
+    translate_prim_call(t, "RPRIM0", 0);
+  else if (op_is(op, "PRIM1"))
+    translate_prim_call(t, "RPRIM1", 1);
+  else if (op_is(op, "PRIM2"))
+    translate_prim_call(t, "RPRIM2", 2);
+  else if (op_is(op, "PRIM3"))
+    translate_prim_call(t, "RPRIM3", 3);
+  else if (op_is(op, "IADD"))
+    translate_primitive(t, "RADD", 2);
+  else if (op_is(op, "ISUB"))
+    translate_primitive(t, "RSUB", 2);
+  else if (op_is(op, "IMUL"))
+    translate_primitive(t, "RMUL", 2);
+  else if (op_is(op, "IDIV"))
+    translate_primitive(t, "RDIV", 2);
+  else if (op_is(op, "EQ"))
+    translate_primitive(t, "REQ", 2);
+  else if (op_is(op, "NADD"))
+    translate_primitive(t, "RNADD", 2);
+  else if (op_is(op, "NSUB"))
+    translate_primitive(t, "RNSUB", 2);
+  else if (op_is(op, "NMUL"))
+    translate_primitive(t, "RNMUL", 2);
+  else if (op_is(op, "NDIV"))
+    translate_primitive(t, "RNDIV", 2);
+  else if (op_is(op, "NLT"))
+    translate_primitive(t, "RNLT", 2);
+  else if (op_is(op, "NEQ"))
+    translate_primitive(t, "RNEQ", 2);
+  else if (op_is(op, "NGT"))
+    translate_primitive(t, "RNGT", 2);
+  else if (op_is(op, "FLOAD"))
+    emit(t, LIST(S("RFLOAD"), pop_operand(t)));
+  else if (op_is(op, "FADD") || op_is(op, "FSUB") || op_is(op, "FMUL") ||
+           op_is(op, "FDIV"))
+    emit(t, ins);
+  else if (op_is(op, "FBOX"))
+    emit(t, LIST(S("RFBOX"), push_temp(t)));
+  else if (op_is(op, "VADD"))
+    translate_primitive(t, "RVADD", 2);
+  else if (op_is(op, "VMUL"))
+    translate_primitive(t, "RVMUL", 2);
+  else if (op_is(op, "VDOT"))
+    translate_primitive(t, "RVDOT", 2);
+  else if (op_is(op, "VSUM"))
+    translate_primitive(t, "RVSUM", 1);
+  else if (op_is(op, "VMIN"))
+    translate_primitive(t, "RVMIN", 1);
+  else if (op_is(op, "VMAX"))
+    translate_primitive(t, "RVMAX", 1);
+  else if (op_is(op, "VSCALE"))
+    translate_primitive(t, "RVSCALE", 2);
+  else if (op_is(op, "VFILL"))
+    translate_primitive(t, "RVFILL", 2);
+  else if (op_is(op, "VCOPY"))
+    translate_primitive(t, "RVCOPY", 1);
+  else if (op_is(op, "CAR"))
+    translate_primitive(t, "RCAR", 1);
+  else if (op_is(op, "CDR"))
+    translate_primitive(t, "RCDR", 1);
+  else if (op_is(op, "GMETHOD"))
+    translate_method(t, ins);
+  else if (op_is(op, "RECMAKE"))
+    translate_record_make(t, arg1(ins));
+  else if (op_is(op, "RECP"))
+    translate_record(t, "RRECP", 1, ins);
+  else if (op_is(op, "RECREF"))
+    translate_record(t, "RRECREF", 1, ins);
+  else if (op_is(op, "RECSET"))
+    translate_record(t, "RRECSET", 2, ins);
+  else
+    /* FN, MC and PRIM need an environment frame or a list of arguments */
+    t->is_failed = yes;
+}
+
+/* Returns the register-based code equivalent to the stack-based `code' of a lambda, or NULL if it can not be run in the register tier. */
+sexp translate_to_register(sexp code) {
+  if (!is_pair(code) || !is_pair(pair_car(code))) return NULL;
+  sexp entry = pair_car(code);
+  /* Only a frame on the VM stack can be kept in registers */
+  int is_dotted = op_is(pair_car(entry), "SARGSD");
+  if (!is_dotted && !op_is(pair_car(entry), "SARGS")) return NULL;
+
+  struct translator_t t;
+  int length = pair_length(code);
+  t.stack = malloc((length + 1) * sizeof(struct entry_t));
+  t.depth = 0;
+  /* The whole frame, including the internal definitions, is in registers */
+  t.nlocals = fixnum_value(arg2(entry));
+  t.nregs = t.nlocals;
+  t.is_reachable = yes;
+  t.is_failed = no;
+  t.states = NULL;
+  /* The number of registers is known after the whole body is translated */
+  sexp head = LIST(S(is_dotted ? "RARGSD": "RARGS"), arg1(entry), EOL);
+  t.head = t.tail = make_pair(head, EOL);
+
+  for (code = pair_cdr(code); is_pair(code) && !t.is_failed; code = pair_cdr(code)) {
+    sexp ins = pair_car(code);
+    if (is_label(ins))
+      enter_label(&t, ins);
+    else if (t.is_reachable)
+      translate_instruction(&t, ins);
+  }
+  free(t.stack);
+  free_states(t.states);
+  if (t.is_failed) return NULL;
+  arg2(head) = make_fixnum(t.nregs);
+  return t.head;
+}
+
+/* Switches a compiled procedure into the register tier if possible */
+sexp use_register_tier(sexp proc) {
+  sexp code = translate_to_register(compiled_proc_code(proc));
+  if (code == NULL) return false_object;
+  compiled_proc_code(proc) = code;
+  compiled_proc_bytecode(proc) = NULL;
+  return true_object;
+}
@@ -0,0 +1,268 @@
+/*
+ * sort.c
+ *
+ * Sorting of lists and vectors. A vector is sorted in place by introsort, a
+ * list by a stable merge sort which relinks its pairs.
+ *
+ * Copyright (C) 2013-04-28 liutos <mat.liutos@gmail.com>
+ */
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "number.h"
+#include "object.h"
+#include "sort.h"
+#include "types.h"
+#include "vm.h"
+#include "write.h"
+
+/* Shorter ranges are left to the insertion sort */
+#define INSERTION_THRESHOLD 16
+/* Enough lists of 2^i pairs for any list in memory */
+#define MERGE_BINS 64
+
+enum comparator_kind {
+  FIXNUM_LESS,                  /* `<' on fixnums, by their representations */
+  FIXNUM_GREATER,
+  PRIMITIVE_LESS,               /* Called without the VM */
+  PROCEDURE_LESS,               /* Called through `vm_apply' */
+};
+
+struct comparator {
+  enum comparator_kind kind;
+  sexp proc;
+  /* The vector sorted in place and its elements, which a compiled procedure
+     must leave where they are */
+  sexp vector;
+  sexp *data;
+};
+
+void signal_modified_vector(sexp vector) {
+  port_format(scm_err_port, "sort!: Vector modified while sorted %*\n", vector);
+  exit(1);
+}
+
+static inline int is_less(struct comparator *cmp, sexp x, sexp y) {
+  sexp argv[2] = {x, y};
+  switch (cmp->kind) {
+    case FIXNUM_LESS: return (intptr_t)x < (intptr_t)y;
+    case FIXNUM_GREATER: return (intptr_t)x > (intptr_t)y;
+    case PRIMITIVE_LESS: return call_primitive(cmp->proc, 2, argv) != false_object;
+    default : {
+      sexp result = vm_apply(cmp->proc, 2, argv);
+      if (cmp->vector != NULL && vector_datum(cmp->vector) != cmp->data)
+        signal_modified_vector(cmp->vector);
+      return result != false_object;
+    }
+  }
+}
+
+void check_less(sexp proc, char *op) {
+  if (is_primitive(proc) || is_compiled_proc(proc) || is_compound(proc) ||
+      is_generic(proc))
+    return;
+  port_format(scm_err_port, "%s: Wrong type argument %*\n", make_string(op), proc);
+  exit(1);
+}
+
+/* `<' and `>' are compared inline when all the elements are fixnums */
+struct comparator make_comparator(sexp proc, int are_fixnums) {
+  struct comparator cmp = {PROCEDURE_LESS, proc, NULL, NULL};
+  if (is_primitive(proc)) {
+    cmp.kind = PRIMITIVE_LESS;
+    if (are_fixnums && primitive_C_proc(proc) == (C_proc_t)number_lt)
+      cmp.kind = FIXNUM_LESS;
+    else if (are_fixnums && primitive_C_proc(proc) == (C_proc_t)number_gt)
+      cmp.kind = FIXNUM_GREATER;
+  }
+  return cmp;
+}
+
+/* Vectors */
+#define swap(a, i, j) do { sexp t = a[i]; a[i] = a[j]; a[j] = t; } while (0)
+
+void insertion_sort(sexp *a, int n, struct comparator *cmp) {
+  for (int i = 1; i < n; i++) {
+    sexp x = a[i];
+    int j = i;
+    for (; j > 0 && is_less(cmp, x, a[j - 1]); j--)
+      a[j] = a[j - 1];
+    a[j] = x;
+  }
+}
+
+void sift_down(sexp *a, int root, int n, struct comparator *cmp) {
+  for (;;) {
+    int child = 2 * root + 1;
+    if (child >= n) return;
+    if (child + 1 < n && is_less(cmp, a[child], a[child + 1]))
+      child++;
+    if (!is_less(cmp, a[root], a[child])) return;
+    swap(a, root, child);
+    root = child;
+  }
+}
+
+void heap_sort(sexp *a, int n, struct comparator *cmp) {
+  for (int i = n / 2 - 1; i >= 0; i--)
+    sift_down(a, i, n, cmp);
+  for (int i = n - 1; i > 0; i--) {
+    swap(a, 0, i);
+    sift_down(a, 0, i, cmp);
+  }
+}
+
+/* Partitions around the median of the first, middle and last elements.
+   Returns the position of the pivot, with no greater element before it and
+   no less one after it. The bounds keep an inconsistent `less' inside. */
+int partition(sexp *a, int n, struct comparator *cmp) {
+  int mid = n / 2;
+  if (is_less(cmp, a[mid], a[0])) swap(a, mid, 0);
+  if (is_less(cmp, a[n - 1], a[mid])) {
+    swap(a, n - 1, mid);
+    if (is_less(cmp, a[mid], a[0])) swap(a, mid, 0);
+  }
+  swap(a, 0, mid);
+  sexp pivot = a[0];
+  int i = 0, j = n;
+  for (;;) {
+    do i++; while (i < n && is_less(cmp, a[i], pivot));
+    do j--; while (j > 0 && is_less(cmp, pivot, a[j]));
+    if (i >= j) break;
+    swap(a, i, j);
+  }
+  swap(a, 0, j);
+  return j;
+}
+
+/* Quicksort on the larger part, which turns into a heap sort once `depth'
+   partitions did not shrink it enough */
+void introsort(sexp *a, int n, int depth, struct comparator *cmp) {
+  while (n > INSERTION_THRESHOLD) {
+    if (depth-- == 0) {
+      heap_sort(a, n, cmp);
+      return;
+    }
+    int p = partition(a, n, cmp);
+    if (p < n - p - 1) {
+      introsort(a, p, depth, cmp);
+      a += p + 1;
+      n -= p + 1;
+    } else {
+      introsort(a + p + 1, n - p - 1, depth, cmp);
+      n = p;
+    }
+  }
+  insertion_sort(a, n, cmp);
+}
+
+void sort_vector(sexp vector, sexp less) {
+  int n = vector_pos(vector);
+  sexp *a = vector_datum(vector);
+  int are_fixnums = yes;
+  for (int i = 0; i < n && are_fixnums; i++)
+    are_fixnums = is_fixnum(a[i]);
+  struct comparator cmp = make_comparator(less, are_fixnums);
+  cmp.vector = vector;
+  cmp.data = a;
+  int depth = 0;
+  for (int m = n; m > 1; m >>= 1)
+    depth += 2;
+  introsort(a, n, depth, &cmp);
+}
+
+/* Lists */
+/* Relinks the sorted lists `a' and `b' into one, the pairs of `a' come first
+   among equal elements */
+sexp merge_lists(sexp a, sexp b, struct comparator *cmp) {
+  sexp head = EOL;
+  sexp *tail = &head;
+  while (!is_null(a) && !is_null(b))
+    if (is_less(cmp, pair_car(b), pair_car(a))) {
+      *tail = b;
+      tail = &pair_cdr(b);
+      b = pair_cdr(b);
+    } else {
+      *tail = a;
+      tail = &pair_cdr(a);
+      a = pair_cdr(a);
+    }
+  *tail = is_null(a) ? b: a;
+  return head;
+}
+
+/* Bottom-up: `bins[i]' is empty or holds a sorted list of 2^i pairs, all of
+   them taken before the pairs of the lower bins */
+sexp sort_list(sexp list, sexp less) {
+  int are_fixnums = yes;
+  for (sexp l = list; is_pair(l) && are_fixnums; l = pair_cdr(l))
+    are_fixnums = is_fixnum(pair_car(l));
+  struct comparator cmp = make_comparator(less, are_fixnums);
+  sexp bins[MERGE_BINS];
+  int count = 0;
+  while (!is_null(list)) {
+    sexp run = list;
+    list = pair_cdr(list);
+    pair_cdr(run) = EOL;
+    int i = 0;
+    for (; i < count && !is_null(bins[i]); i++) {
+      run = merge_lists(bins[i], run, &cmp);
+      bins[i] = EOL;
+    }
+    if (i == count)
+      count++;
+    bins[i] = run;
+  }
+  sexp sorted = EOL;
+  for (int i = 0; i < count; i++)
+    if (!is_null(bins[i]))
+      sorted = merge_lists(bins[i], sorted, &cmp);
+  return sorted;
+}
+
+void check_sequence(sexp seq, char *op) {
+  if (is_vector(seq)) return;
+  sexp l = seq;
+  while (is_pair(l))
+    l = pair_cdr(l);
+  if (is_null(l)) return;
+  port_format(scm_err_port, "%s: Wrong type argument %*\n", make_string(op), seq);
+  exit(1);
+}
+
+sexp copy_list(sexp list) {
+  sexp head = EOL;
+  sexp *tail = &head;
+  for (; is_pair(list); list = pair_cdr(list)) {
+    *tail = make_pair(pair_car(list), EOL);
+    tail = &pair_cdr(*tail);
+  }
+  return head;
+}
+
+/* Procedures */
+/* Sorts `seq' in place. The pairs of a list are relinked and the first of
+   them may change, the result is the sorted list. */
+sexp sort_x_proc(sexp seq, sexp less) {
+  check_sequence(seq, "sort!");
+  check_less(less, "sort!");
+  if (is_vector(seq)) {
+    sort_vector(seq, less);
+    return seq;
+  }
+  return sort_list(seq, less);
+}
+
+sexp sort_proc(sexp seq, sexp less) {
+  check_sequence(seq, "sort");
+  check_less(less, "sort");
+  if (is_vector(seq)) {
+    sexp copy = make_vector(vector_pos(seq));
+    for (int i = 0; i < vector_pos(seq); i++)
+      vector_data_at(copy, i) = vector_data_at(seq, i);
+    vector_pos(copy) = vector_pos(seq);
+    sort_vector(copy, less);
+    return copy;
+  }
+  return sort_list(copy_list(seq), less);
+}
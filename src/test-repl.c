@@ -49,6 +49,18 @@ int main(int argc, char *argv[])
     /* "#\\汉", */
     /* "(set! a 123)", */
     "(string-ref \"汉字\" 0)",
+    "((lambda (x) (catch 'a (throw 'a x))) 5)",
+    "(define-record-type point (make-point x y) point? (x point-x) (y point-y set-point-y!))",
+    "((lambda (p) (set-point-y! p 3) (list (point? p) (point-x p) (point-y p))) (make-point 1 2))",
+    "(define-generic kind)",
+    "(define-method (kind (x fixnum)) 'fixnum)",
+    "(define-method (kind x) 'object)",
+    "(list (kind 1) (kind 'a))",
+    "(define (twice x) (list x x))",
+    "(define-method (kind (x string)) (twice x))",
+    "(list (catch 'a (twice 1)) (catch 'a (throw 'a (twice 2))) (kind \"s\"))",
+    "(sort (list 3 1 2) (lambda (a b) (< a b)))",
+    "(sort (list 3 1 2) (lambda (a b) (> a b)))",
   };
   init_impl();
   /* printf("Address of `-': %p\n", &primitive_procs[1]); */
@@ -54,6 +54,39 @@ int main(int argc, char *argv[])
     /* "(*i 1 2)", */
     /* "(/i 1 2)", */
     "not",
+    "(set-vm-tier! 'register)",
+    "((lambda (n) (if (eq? n 0) 1 (*i n (-i n 1)))) 3)",
+    "((lambda (x . y) (cons y x)) 1 2 3 4)",
+    "(set-vm-tier! 'stack)",
+    "(catch 'foo (+i 1 (throw 'foo 42)))",
+    "((lambda (x) (define (g y) (+i x y)) (g 2)) 1)",
+    "((lambda (n) ((lambda (inc) (inc) (inc)) (lambda () (set! n (+i n 1)) n))) 0)",
+    "((lambda x x) 1 2)",
+    "(list 1 (+i 1 1) 3)",
+    "((lambda (g) (g 1 2)) +i)",
+    "(< (+ 1 2) (* 2 (- 3 1)))",
+    "(/ (+ 536870911 1) 4)",
+    "(* 99999999999999999999 -99999999999999999999)",
+    "(quotient 100000000000000000000000 7)",
+    "(-. (*. 1.5 (+. 2 0.5)) (/. 1 4))",
+    "(list (+ 2305843009213693951 1) (* 3037000499 3037000499))",
+    "(list (string-ref \"中文\" 1) (char->integer #\\中))",
+    "(string-set! \"abc\" 1 #\\中)",
+    "(list (string-contains \"日志: 错误 error\" \"error\") (string<? \"中\" \"文\") (string=? \"中文\" \"中文\"))",
+    "(list (uvector-dot (f64vector 1 2 3) (f64vector 4 5 6)) (uvector-sum (s32vector 1 -2 3)) (uvector-max (u8vector 3 9 4)) (uvector-add (u8vector 200 1) (u8vector 100 2)))",
+    "(list 1e300 2E-3 -1e2 1.5e1 0.1 12345678901234567890 7)",
+    "((lambda (b) (bytevector-u16-set! (bytevector-slice b 1 3) 0 258 'big) (list b (bytevector-u32-ref b 0 'little) (bytevector-copy b 2))) (make-bytevector 4 0))",
+    "((lambda (v) (vector-push! v 1) (vector-push! v 2) (vector-push! v 3) (list (vector-pop! v) v (subvector (vector-grow v 4) 1 3) (vector-length (make-vector 5 0)))) (make-vector 0))",
+    "((lambda (t) (hash-table-set! t (list 1 \"a\") 1) (hash-table-set! t 2.5 2) (hash-table-delete! t 2.5) (list (hash-table-ref/default t (list 1 \"a\") #f) (hash-table-contains? t 2.5) (hash-table-count t))) (make-equal-hash-table))",
+    "((lambda (m) ((lambda (m2 t) (hamt-set! t \"b\" 3) (hamt-delete! t 'a) (list (hamt-ref m 'a #f) (hamt-ref m2 'a #f) (hamt-count m2) (hamt->alist (hamt-persistent! t)))) (hamt-set m 'a 2) (hamt-transient m))) (hamt-set (make-hamt) 'a 1))",
+    "(begin (define-record-type node (make-node value) node? (value node-value) (next node-next set-node-next!)) ((lambda (n) (set-node-next! n (make-node 2)) (list (node? n) (node? 1) (node-value (node-next n)) (node-next (node-next n)) (type-of n) n)) (make-node 1)))",
+    "(begin (define-record-type link (make-link value next) link? (value link-value) (next link-next)) (define (chain n l) (if (eq? n 0) l (chain (-i n 1) (make-link n l)))) (define (chain-length l n) (if (link? l) (chain-length (link-next l) (+i n 1)) n)) ((lambda (l) (make-vector 100000 0) (chain-length l 0)) (chain 500000 '())))",
+    "(begin (define-generic describe) (define-method (describe (x number)) 'number) (define-method (describe (x fixnum)) 'fixnum) (define-method (describe x) 'object) (set-class-parent! 'node 'number) (list (describe 1) (describe 2.5) (describe (make-node 1)) (describe \"s\")))",
+    "(begin (define-generic kind) (define-method (kind (v f64vector)) 'f64) (define-method (kind (v u8vector)) 'u8) (define-method (kind v) 'other) (define (k o) (kind o)) (list (k (make-f64vector 2 0.0)) (k (make-u8vector 2 0)) (k (make-bytevector 2 0)) (k (make-s32vector 2 0)) (kind (make-f64vector 1 0.0)) (kind (make-u8vector 1 0)) ((find-method kind 's32vector) 0)))",
+    "((lambda (r) (list (regex-search r \"tel: 010-5555 or\") (regex-match r \"010-5555\") (regex-match r \"tel: 010-5555\") (regex-search (regex-compile \"^b|c(x)?$\") \"abc\") (type-of r))) (regex-compile \"(\\d+)-(\\d+)\"))",
+    "(list (sort (list 3 1 2) <) (sort! (list 3 1 2) (lambda (a b) (> a b))) (sort (list (cons 1 'a) (cons 0 'b) (cons 1 'c)) (lambda (x y) (< (car x) (car y)))) ((lambda (v) (vector-push! v 2.5) (vector-push! v 1) (vector-push! v 3) (sort! v <)) (make-vector 0)))",
+    "((lambda (t) (hash-table-set! t 'a 1) (hash-table-set! t 'b 2) (hash-table-walk t (lambda (k v) (hash-table-set! t v k))) (list (apply list 1 2 (list 3 4)) (apply + (list 1 2)) (apply list '()) (hash-table-ref/default t 2 #f) (catch 'out (apply (lambda (x) (hash-table-walk t (lambda (k v) (throw 'out x)))) (list 'thrown))))) (make-eq-hash-table))",
+    "((lambda (v) (vector-push! v 1) (vector-push! v 2) (list (map car (list (list 1 2) (list 3 4))) (map + (list 1 2 3) (list 10 20)) (map (lambda (x y) (cons x y)) v v) (fold cons '() (list 1 2 3)) (fold + 0 v) (filter (lambda (x) (< x 2)) (list 1 2 0 3)) (filter (lambda (x) (< x 2)) v) (catch 'done (for-each (lambda (x) (if (eq? x 2) (throw 'done x) x)) (list 1 2 3))))) (make-vector 0))",
   };
   for (int i = 0; i < sizeof(cases) / sizeof(char *); i++) {
     FILE *fp = fmemopen(cases[i], strlen(cases[i]), "r");
@@ -68,5 +101,10 @@ int main(int argc, char *argv[])
     fclose(fp);
   }
   port_format(scm_out_port, "%*\n", vm_stack);
-  return 0;
+  /* A pushed vector doubles its room */
+  sexp v = make_vector(0);
+  for (int i = 0; i < 10; i++)
+    vector_push(make_fixnum(i), v);
+  printf("capacity after 10 pushes: %u\n", vector_length(v));
+  return vector_length(v) == 16 ? 0: 1;
 }
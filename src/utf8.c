@@ -0,0 +1,354 @@
+/*
+ * utf8.c
+ *
+ * Kernels on UTF-8 bytes, with SSE2 and AVX2 versions chosen at startup
+ *
+ * Copyright (C) 2013-04-20 liutos <mat.liutos@gmail.com>
+ */
+#include <string.h>
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
+
+#include "types.h"
+#include "utf8.h"
+
+/* SSE2 is always present on x86-64, AVX2 is checked at startup */
+#ifdef __x86_64__
+#define HAVE_X86_SIMD
+#endif
+
+/* The bytes 0x80..0xbf continue a character, the others start one */
+#define is_continuation(c) (((c) & 0xc0) == 0x80)
+/* Which are the bytes below -64 when signed */
+#define CONTINUATION_LIMIT -65
+/* A byte counter of 8 bits is summed before it wraps */
+#define COUNT_ROUNDS 255
+
+/* Scalar */
+size_t count_scalar(const char *s, size_t n) {
+  size_t count = 0;
+  for (size_t i = 0; i < n; i++)
+    if (!is_continuation(s[i]))
+      count++;
+  return count;
+}
+
+/* Returns the length of the well-formed character at `s', or 0. Overlong
+   encodings, surrogates and code points beyond U+10FFFF are ill-formed. */
+int char_length(const unsigned char *s, size_t n) {
+  unsigned char c = s[0], lo = 0x80, hi = 0xbf;
+  size_t len;
+  if (c < 0x80) return 1;
+  if (c >= 0xc2 && c <= 0xdf)
+    len = 2;
+  else if (c >= 0xe0 && c <= 0xef) {
+    len = 3;
+    if (c == 0xe0) lo = 0xa0;
+    if (c == 0xed) hi = 0x9f;
+  } else if (c >= 0xf0 && c <= 0xf4) {
+    len = 4;
+    if (c == 0xf0) lo = 0x90;
+    if (c == 0xf4) hi = 0x8f;
+  } else
+    return 0;
+  if (n < len || s[1] < lo || s[1] > hi) return 0;
+  for (size_t i = 2; i < len; i++)
+    if (!is_continuation(s[i]))
+      return 0;
+  return len;
+}
+
+/* Validates the characters from `*i' until the position `end' is passed */
+int validate_until(const char *s, size_t *i, size_t end, size_t n) {
+  while (*i < end) {
+    int len = char_length((const unsigned char *)s + *i, n - *i);
+    if (len == 0) return no;
+    *i += len;
+  }
+  return yes;
+}
+
+int validate_scalar(const char *s, size_t n) {
+  size_t i = 0;
+  return validate_until(s, &i, n, n);
+}
+
+/* Compares as unsigned bytes, which is the order of the code points */
+int compare_scalar(const char *a, const char *b, size_t n) {
+  for (size_t i = 0; i < n; i++)
+    if (a[i] != b[i])
+      return (unsigned char)a[i] - (unsigned char)b[i];
+  return 0;
+}
+
+const char *search_scalar(const char *h, size_t n, const char *needle, size_t m) {
+  if (m == 0) return h;
+  for (size_t i = 0; i + m <= n; i++)
+    if (h[i] == needle[0] && compare_scalar(h + i + 1, needle + 1, m - 1) == 0)
+      return h + i;
+  return NULL;
+}
+
+#ifdef HAVE_X86_SIMD
+/* SSE2: 16 bytes at a time */
+#define load128(p) _mm_loadu_si128((const __m128i *)(p))
+
+/* The starting bytes are counted in 8-bit lanes, which are summed by
+   `_mm_sad_epu8' before they can wrap */
+size_t count_sse2(const char *s, size_t n) {
+  const __m128i limit = _mm_set1_epi8(CONTINUATION_LIMIT);
+  size_t count = 0, i = 0;
+  while (i + 16 <= n) {
+    __m128i acc = _mm_setzero_si128();
+    for (int k = 0; k < COUNT_ROUNDS && i + 16 <= n; k++, i += 16)
+      acc = _mm_sub_epi8(acc, _mm_cmpgt_epi8(load128(s + i), limit));
+    __m128i sums = _mm_sad_epu8(acc, _mm_setzero_si128());
+    count += _mm_extract_epi16(sums, 0) + _mm_extract_epi16(sums, 4);
+  }
+  return count + count_scalar(s + i, n - i);
+}
+
+/* Blocks of ASCII are skipped, the others are checked character by
+   character */
+int validate_sse2(const char *s, size_t n) {
+  size_t i = 0;
+  while (i + 16 <= n)
+    if (_mm_movemask_epi8(load128(s + i)) == 0)
+      i += 16;
+    else if (!validate_until(s, &i, i + 16, n))
+      return no;
+  return validate_until(s, &i, n, n);
+}
+
+int compare_sse2(const char *a, const char *b, size_t n) {
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(load128(a + i), load128(b + i)));
+    if (mask != 0xffff) {
+      i += __builtin_ctz(~mask);
+      return (unsigned char)a[i] - (unsigned char)b[i];
+    }
+  }
+  return compare_scalar(a + i, b + i, n - i);
+}
+
+/* The positions where both the first and the last bytes of `needle' match
+   are found for a block at once, only these are compared */
+const char *search_sse2(const char *h, size_t n, const char *needle, size_t m) {
+  if (m == 0) return h;
+  if (m > n) return NULL;
+  const __m128i first = _mm_set1_epi8(needle[0]);
+  const __m128i last = _mm_set1_epi8(needle[m - 1]);
+  size_t i = 0;
+  for (; i + m - 1 + 16 <= n; i += 16) {
+    __m128i f = _mm_cmpeq_epi8(first, load128(h + i));
+    __m128i l = _mm_cmpeq_epi8(last, load128(h + i + m - 1));
+    unsigned mask = _mm_movemask_epi8(_mm_and_si128(f, l));
+    for (; mask != 0; mask &= mask - 1) {
+      int bit = __builtin_ctz(mask);
+      if (compare_sse2(h + i + bit + 1, needle + 1, m - 1) == 0)
+        return h + i + bit;
+    }
+  }
+  return search_scalar(h + i, n - i, needle, m);
+}
+
+/* AVX2: 32 bytes at a time */
+#define AVX2 __attribute__((target("avx2")))
+#define load256(p) _mm256_loadu_si256((const __m256i *)(p))
+
+AVX2 size_t count_avx2(const char *s, size_t n) {
+  const __m256i limit = _mm256_set1_epi8(CONTINUATION_LIMIT);
+  size_t count = 0, i = 0;
+  while (i + 32 <= n) {
+    __m256i acc = _mm256_setzero_si256();
+    for (int k = 0; k < COUNT_ROUNDS && i + 32 <= n; k++, i += 32)
+      acc = _mm256_sub_epi8(acc, _mm256_cmpgt_epi8(load256(s + i), limit));
+    __m256i sums = _mm256_sad_epu8(acc, _mm256_setzero_si256());
+    count += _mm256_extract_epi16(sums, 0) + _mm256_extract_epi16(sums, 4) +
+        _mm256_extract_epi16(sums, 8) + _mm256_extract_epi16(sums, 12);
+  }
+  return count + count_sse2(s + i, n - i);
+}
+
+/* The errors of two consecutive bytes are found by looking up the high
+   nibble of the first, its low nibble and the high nibble of the second
+   (the algorithm of Keiser and Lemire). Each table gives the errors that
+   are possible for a nibble, so an error happens when all of them agree. */
+enum {
+  TOO_SHORT = 1 << 0,             /* 11______ 0_______ or 11______ 11______ */
+  TOO_LONG = 1 << 1,              /* 0_______ 10______ */
+  OVERLONG_3 = 1 << 2,            /* 11100000 100_____ */
+  TOO_LARGE = 1 << 3,             /* 11110100 1001____ and above */
+  SURROGATE = 1 << 4,             /* 11101101 101_____ */
+  OVERLONG_2 = 1 << 5,            /* 1100000_ 10______ */
+  TOO_LARGE_1000 = 1 << 6,        /* 11110101 1000____ and above */
+  OVERLONG_4 = 1 << 6,            /* 11110000 1000____ */
+  TWO_CONTS = 1 << 7,             /* 10______ 10______ */
+  CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS,
+};
+
+const unsigned char byte_1_high[16] = {
+  TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+  TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+  TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+  TOO_SHORT | OVERLONG_2,
+  TOO_SHORT,
+  TOO_SHORT | OVERLONG_3 | SURROGATE,
+  TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4,
+};
+
+const unsigned char byte_1_low[16] = {
+  CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+  CARRY | OVERLONG_2,
+  CARRY,
+  CARRY,
+  CARRY | TOO_LARGE,
+  CARRY | TOO_LARGE | TOO_LARGE_1000,
+  CARRY | TOO_LARGE | TOO_LARGE_1000,
+  CARRY | TOO_LARGE | TOO_LARGE_1000,
+  CARRY | TOO_LARGE | TOO_LARGE_1000,
+  CARRY | TOO_LARGE | TOO_LARGE_1000,
+  CARRY | TOO_LARGE | TOO_LARGE_1000,
+  CARRY | TOO_LARGE | TOO_LARGE_1000,
+  CARRY | TOO_LARGE | TOO_LARGE_1000,
+  CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+  CARRY | TOO_LARGE | TOO_LARGE_1000,
+  CARRY | TOO_LARGE | TOO_LARGE_1000,
+};
+
+const unsigned char byte_2_high[16] = {
+  TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+  TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+  TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+  TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+  TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+  TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+  TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+};
+
+/* A block ending with the lead byte of an unfinished character has a
+   byte above these */
+const unsigned char incomplete_limits[32] = {
+  255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+  255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+  0xf0 - 1, 0xe0 - 1, 0xc0 - 1,
+};
+
+#define table256(t) _mm256_broadcastsi128_si256(load128(t))
+/* The bytes of `input' shifted by `n', those of `prev' coming in */
+#define prev_bytes(input, prev, n)                                      \
+  _mm256_alignr_epi8(input, _mm256_permute2x128_si256(prev, input, 0x21), 16 - (n))
+#define high_nibbles(v) _mm256_and_si256(_mm256_srli_epi16(v, 4), _mm256_set1_epi8(0x0f))
+
+AVX2 __m256i block_errors(__m256i input, __m256i prev) {
+  __m256i prev1 = prev_bytes(input, prev, 1);
+  __m256i special = _mm256_and_si256(
+      _mm256_and_si256(
+          _mm256_shuffle_epi8(table256(byte_1_high), high_nibbles(prev1)),
+          _mm256_shuffle_epi8(table256(byte_1_low),
+                              _mm256_and_si256(prev1, _mm256_set1_epi8(0x0f)))),
+      _mm256_shuffle_epi8(table256(byte_2_high), high_nibbles(input)));
+  /* The third and fourth bytes must be continuations, which the pairs do not
+     tell */
+  __m256i is_third = _mm256_subs_epu8(prev_bytes(input, prev, 2), _mm256_set1_epi8(0xe0 - 0x80));
+  __m256i is_fourth = _mm256_subs_epu8(prev_bytes(input, prev, 3), _mm256_set1_epi8(0xf0 - 0x80));
+  __m256i must_continue = _mm256_and_si256(_mm256_or_si256(is_third, is_fourth),
+                                           _mm256_set1_epi8(0x80));
+  return _mm256_xor_si256(must_continue, special);
+}
+
+AVX2 int validate_avx2(const char *s, size_t n) {
+  const __m256i limits = load256(incomplete_limits);
+  __m256i error = _mm256_setzero_si256();
+  __m256i prev = _mm256_setzero_si256();
+  __m256i incomplete = _mm256_setzero_si256();
+  char tail[32] = {0};
+  for (size_t i = 0; i < n; i += 32) {
+    __m256i input;
+    if (i + 32 <= n)
+      input = load256(s + i);
+    else {
+      memcpy(tail, s + i, n - i);
+      input = load256(tail);
+    }
+    if (_mm256_movemask_epi8(input) == 0)
+      error = _mm256_or_si256(error, incomplete);
+    else {
+      error = _mm256_or_si256(error, block_errors(input, prev));
+      incomplete = _mm256_subs_epu8(input, limits);
+    }
+    prev = input;
+  }
+  error = _mm256_or_si256(error, incomplete);
+  return _mm256_testz_si256(error, error) ? yes: no;
+}
+
+AVX2 int compare_avx2(const char *a, const char *b, size_t n) {
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(load256(a + i), load256(b + i)));
+    if (mask != 0xffffffff) {
+      i += __builtin_ctz(~mask);
+      return (unsigned char)a[i] - (unsigned char)b[i];
+    }
+  }
+  return compare_sse2(a + i, b + i, n - i);
+}
+
+AVX2 const char *search_avx2(const char *h, size_t n, const char *needle, size_t m) {
+  if (m == 0) return h;
+  if (m > n) return NULL;
+  const __m256i first = _mm256_set1_epi8(needle[0]);
+  const __m256i last = _mm256_set1_epi8(needle[m - 1]);
+  size_t i = 0;
+  for (; i + m - 1 + 32 <= n; i += 32) {
+    __m256i f = _mm256_cmpeq_epi8(first, load256(h + i));
+    __m256i l = _mm256_cmpeq_epi8(last, load256(h + i + m - 1));
+    unsigned mask = _mm256_movemask_epi8(_mm256_and_si256(f, l));
+    for (; mask != 0; mask &= mask - 1) {
+      int bit = __builtin_ctz(mask);
+      if (compare_avx2(h + i + bit + 1, needle + 1, m - 1) == 0)
+        return h + i + bit;
+    }
+  }
+  return search_sse2(h + i, n - i, needle, m);
+}
+#endif
+
+/* Indexed by `enum simd_level' */
+struct utf8_kernels_t utf8_kernels[] = {
+  {"scalar", count_scalar, validate_scalar, compare_scalar, search_scalar},
+#ifdef HAVE_X86_SIMD
+  {"sse2", count_sse2, validate_sse2, compare_sse2, search_sse2},
+  {"avx2", count_avx2, validate_avx2, compare_avx2, search_avx2},
+#endif
+};
+enum simd_level utf8_simd_level = SIMD_SCALAR;
+
+/* Chooses the widest instruction set of the CPU */
+void init_utf8(void) {
+#ifdef HAVE_X86_SIMD
+  __builtin_cpu_init();
+  utf8_simd_level = __builtin_cpu_supports("avx2") ? SIMD_AVX2: SIMD_SSE2;
+#endif
+}
+
+/* Returns the number of characters in the `n' bytes of `s' */
+size_t utf8_count(const char *s, size_t n) {
+  return utf8_kernels[utf8_simd_level].count(s, n);
+}
+
+int utf8_validate(const char *s, size_t n) {
+  return utf8_kernels[utf8_simd_level].validate(s, n);
+}
+
+int utf8_compare(const char *a, const char *b, size_t n) {
+  return utf8_kernels[utf8_simd_level].compare(a, b, n);
+}
+
+/* Returns the first occurrence of `needle' in `h', or NULL */
+const char *utf8_search(const char *h, size_t n, const char *needle, size_t m) {
+  return utf8_kernels[utf8_simd_level].search(h, n, needle, m);
+}
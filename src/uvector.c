@@ -0,0 +1,398 @@
+/*
+ * uvector.c
+ *
+ * Homogeneous vectors of raw numbers and their bulk operations
+ *
+ * Copyright (C) 2013-04-22 liutos <mat.liutos@gmail.com>
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "number.h"
+#include "object.h"
+#include "types.h"
+#include "uvector.h"
+#include "write.h"
+
+/* Each kernel is compiled for AVX2 and for the baseline, the loader picks
+   one of them according to the CPU */
+#define CLONES __attribute__((target_clones("avx2", "default")))
+#define F64_LANES 4
+
+typedef double f64x4 __attribute__((vector_size(F64_LANES * sizeof(double))));
+typedef int64_t i64x4 __attribute__((vector_size(F64_LANES * sizeof(int64_t))));
+
+/* An element of any kind */
+union element {
+  double f64;
+  int32_t s32;
+  uint8_t u8;
+};
+
+/* Kernels */
+/* The element-wise loops are vectorized by the compiler. The integers wrap
+   around like the machine types. */
+#define ELEMENTWISE_KERNELS(T, U, name)                                 \
+  CLONES void name##_add(T *restrict d, const T *restrict a,            \
+                         const T *restrict b, size_t n) {               \
+    for (size_t i = 0; i < n; i++)                                      \
+      d[i] = (U)a[i] + (U)b[i];                                         \
+  }                                                                     \
+  CLONES void name##_mul(T *restrict d, const T *restrict a,            \
+                         const T *restrict b, size_t n) {               \
+    for (size_t i = 0; i < n; i++)                                      \
+      d[i] = (U)a[i] * (U)b[i];                                         \
+  }                                                                     \
+  CLONES void name##_scale(T *restrict d, const T *restrict a, T k,     \
+                           size_t n) {                                  \
+    for (size_t i = 0; i < n; i++)                                      \
+      d[i] = (U)a[i] * (U)k;                                            \
+  }                                                                     \
+  CLONES void name##_fill(T *restrict d, T x, size_t n) {               \
+    for (size_t i = 0; i < n; i++)                                      \
+      d[i] = x;                                                         \
+  }
+
+ELEMENTWISE_KERNELS(double, double, f64)
+ELEMENTWISE_KERNELS(int32_t, uint32_t, s32)
+ELEMENTWISE_KERNELS(uint8_t, uint8_t, u8)
+
+/* Integer reductions are associative, so the compiler vectorizes them */
+#define INTEGER_REDUCTIONS(T, name)                                     \
+  CLONES long long name##_sum(const T *a, size_t n) {                   \
+    long long s = 0;                                                    \
+    for (size_t i = 0; i < n; i++)                                      \
+      s += a[i];                                                        \
+    return s;                                                           \
+  }                                                                     \
+  CLONES long long name##_dot(const T *a, const T *b, size_t n) {       \
+    long long s = 0;                                                    \
+    for (size_t i = 0; i < n; i++)                                      \
+      s += (long long)a[i] * b[i];                                      \
+    return s;                                                           \
+  }                                                                     \
+  CLONES T name##_min(const T *a, size_t n) {                           \
+    T m = a[0];                                                         \
+    for (size_t i = 1; i < n; i++)                                      \
+      m = a[i] < m ? a[i]: m;                                           \
+    return m;                                                           \
+  }                                                                     \
+  CLONES T name##_max(const T *a, size_t n) {                           \
+    T m = a[0];                                                         \
+    for (size_t i = 1; i < n; i++)                                      \
+      m = a[i] > m ? a[i]: m;                                           \
+    return m;                                                           \
+  }
+
+INTEGER_REDUCTIONS(int32_t, s32)
+INTEGER_REDUCTIONS(uint8_t, u8)
+
+/* The reductions of doubles are not reordered by the compiler, so they keep
+   F64_LANES partial results explicitly */
+CLONES double f64_sum(const double *a, size_t n) {
+  f64x4 acc = {0, 0, 0, 0};
+  size_t i = 0;
+  for (; i + F64_LANES <= n; i += F64_LANES) {
+    f64x4 v;
+    memcpy(&v, a + i, sizeof(v));
+    acc += v;
+  }
+  double s = (acc[0] + acc[1]) + (acc[2] + acc[3]);
+  for (; i < n; i++)
+    s += a[i];
+  return s;
+}
+
+CLONES double f64_dot(const double *a, const double *b, size_t n) {
+  f64x4 acc = {0, 0, 0, 0};
+  size_t i = 0;
+  for (; i + F64_LANES <= n; i += F64_LANES) {
+    f64x4 u, v;
+    memcpy(&u, a + i, sizeof(u));
+    memcpy(&v, b + i, sizeof(v));
+    acc += u * v;
+  }
+  double s = (acc[0] + acc[1]) + (acc[2] + acc[3]);
+  for (; i < n; i++)
+    s += a[i] * b[i];
+  return s;
+}
+
+/* The lanes where `v op acc' holds are taken from `v' */
+#define F64_EXTREMUM(name, op)                                          \
+  CLONES double name(const double *a, size_t n) {                       \
+    double m = a[0];                                                    \
+    size_t i = 0;                                                       \
+    if (n >= F64_LANES) {                                               \
+      f64x4 acc;                                                        \
+      memcpy(&acc, a, sizeof(acc));                                     \
+      for (i = F64_LANES; i + F64_LANES <= n; i += F64_LANES) {         \
+        f64x4 v;                                                        \
+        memcpy(&v, a + i, sizeof(v));                                   \
+        i64x4 mask = v op acc;                                          \
+        acc = (f64x4)(((i64x4)v & mask) | ((i64x4)acc & ~mask));        \
+      }                                                                 \
+      m = acc[0];                                                       \
+      for (int k = 1; k < F64_LANES; k++)                               \
+        m = acc[k] op m ? acc[k]: m;                                    \
+    }                                                                   \
+    for (; i < n; i++)                                                  \
+      m = a[i] op m ? a[i]: m;                                          \
+    return m;                                                           \
+  }
+
+F64_EXTREMUM(f64_min, <)
+F64_EXTREMUM(f64_max, >)
+
+/* Checkers */
+void check_uvector(sexp v, char *op) {
+  if (is_uvector(v)) return;
+  port_format(scm_err_port, "%s: Wrong type argument %*\n", make_string(op), v);
+  exit(1);
+}
+
+void check_same_shape(sexp a, sexp b, char *op) {
+  check_uvector(a, op);
+  check_uvector(b, op);
+  if (uvector_kind(a) == uvector_kind(b) && uvector_length(a) == uvector_length(b))
+    return;
+  port_format(scm_err_port, "%s: Vectors of different types or lengths\n",
+              make_string(op));
+  exit(1);
+}
+
+void check_not_empty(sexp v, char *op) {
+  check_uvector(v, op);
+  if (uvector_length(v) > 0) return;
+  port_format(scm_err_port, "%s: Empty vector\n", make_string(op));
+  exit(1);
+}
+
+/* Converts `x' to an element of `kind', the integers must fit */
+union element to_element(enum uvector_kind kind, sexp x, char *op) {
+  union element e;
+  if (kind == UVECTOR_F64) {
+    e.f64 = real_value(x, op);
+    return e;
+  }
+  intptr_t lo = kind == UVECTOR_S32 ? INT32_MIN: 0;
+  intptr_t hi = kind == UVECTOR_S32 ? INT32_MAX: UINT8_MAX;
+  if (!is_fixnum(x) || fixnum_value(x) < lo || fixnum_value(x) > hi) {
+    port_format(scm_err_port, "%s: Wrong type argument %*\n", make_string(op), x);
+    exit(1);
+  }
+  if (kind == UVECTOR_S32)
+    e.s32 = fixnum_value(x);
+  else
+    e.u8 = fixnum_value(x);
+  return e;
+}
+
+void store_element(sexp v, int i, union element e) {
+  switch (uvector_kind(v)) {
+    case UVECTOR_F64: uvector_f64(v)[i] = e.f64; break;
+    case UVECTOR_S32: uvector_s32(v)[i] = e.s32; break;
+    case UVECTOR_U8: uvector_u8(v)[i] = e.u8; break;
+  }
+}
+
+sexp load_element(sexp v, int i) {
+  switch (uvector_kind(v)) {
+    case UVECTOR_F64: return make_flonum(uvector_f64(v)[i]);
+    case UVECTOR_S32: return make_fixnum(uvector_s32(v)[i]);
+    default: return make_fixnum(uvector_u8(v)[i]);
+  }
+}
+
+void fill_elements(sexp v, union element e) {
+  size_t n = uvector_length(v);
+  switch (uvector_kind(v)) {
+    case UVECTOR_F64: f64_fill(uvector_f64(v), e.f64, n); break;
+    case UVECTOR_S32: s32_fill(uvector_s32(v), e.s32, n); break;
+    case UVECTOR_U8: u8_fill(uvector_u8(v), e.u8, n); break;
+  }
+}
+
+/* Constructors */
+sexp make_filled_uvector(enum uvector_kind kind, sexp n, sexp fill, char *op) {
+  if (!is_fixnum(n) || fixnum_value(n) < 0) {
+    port_format(scm_err_port, "%s: Wrong type argument %*\n", make_string(op), n);
+    exit(1);
+  }
+  union element e = to_element(kind, fill, op);
+  sexp v = make_uvector(kind, fixnum_value(n));
+  fill_elements(v, e);
+  return v;
+}
+
+sexp make_f64vector_proc(sexp n, sexp fill) {
+  return make_filled_uvector(UVECTOR_F64, n, fill, "make-f64vector");
+}
+
+sexp make_s32vector_proc(sexp n, sexp fill) {
+  return make_filled_uvector(UVECTOR_S32, n, fill, "make-s32vector");
+}
+
+sexp make_u8vector_proc(sexp n, sexp fill) {
+  return make_filled_uvector(UVECTOR_U8, n, fill, "make-u8vector");
+}
+
+/* A vector of the arguments */
+sexp list_to_uvector(enum uvector_kind kind, int argc, sexp *argv, char *op) {
+  sexp v = make_uvector(kind, argc);
+  for (int i = 0; i < argc; i++)
+    store_element(v, i, to_element(kind, argv[i], op));
+  return v;
+}
+
+sexp f64vector_proc(int argc, sexp *argv) {
+  return list_to_uvector(UVECTOR_F64, argc, argv, "f64vector");
+}
+
+sexp s32vector_proc(int argc, sexp *argv) {
+  return list_to_uvector(UVECTOR_S32, argc, argv, "s32vector");
+}
+
+sexp u8vector_proc(int argc, sexp *argv) {
+  return list_to_uvector(UVECTOR_U8, argc, argv, "u8vector");
+}
+
+/* Accessors, shared by the three kinds and the bytevectors. `op' is the
+   name of the primitive. */
+sexp uvector_length_as(sexp v, char *op) {
+  check_uvector(v, op);
+  return make_fixnum(uvector_length(v));
+}
+
+void check_uvector_index(sexp v, sexp i, char *op) {
+  check_uvector(v, op);
+  if (!is_fixnum(i)) {
+    port_format(scm_err_port, "%s: Wrong type argument %*\n", make_string(op), i);
+    exit(1);
+  }
+  if (fixnum_value(i) >= 0 && fixnum_value(i) < uvector_length(v))
+    return;
+  port_format(scm_err_port, "%s: Index out of range %*\n", make_string(op), i);
+  exit(1);
+}
+
+sexp uvector_ref_as(sexp v, sexp i, char *op) {
+  check_uvector_index(v, i, op);
+  return load_element(v, fixnum_value(i));
+}
+
+sexp uvector_set_as(sexp v, sexp i, sexp x, char *op) {
+  check_uvector_index(v, i, op);
+  store_element(v, fixnum_value(i), to_element(uvector_kind(v), x, op));
+  return v;
+}
+
+#define UVECTOR_ACCESSORS(name, lisp_name)                              \
+  sexp name##_length_proc(sexp v) {                                     \
+    return uvector_length_as(v, lisp_name "-length");                   \
+  }                                                                     \
+  sexp name##_ref_proc(sexp v, sexp i) {                                \
+    return uvector_ref_as(v, i, lisp_name "-ref");                      \
+  }                                                                     \
+  sexp name##_set_proc(sexp v, sexp i, sexp x) {                        \
+    return uvector_set_as(v, i, x, lisp_name "-set!");                  \
+  }
+
+UVECTOR_ACCESSORS(f64vector, "f64vector")
+UVECTOR_ACCESSORS(s32vector, "s32vector")
+UVECTOR_ACCESSORS(u8vector, "u8vector")
+
+/* Bulk operations, which are also instructions */
+sexp uvector_add(sexp a, sexp b) {
+  check_same_shape(a, b, "uvector-add");
+  size_t n = uvector_length(a);
+  sexp d = make_uvector(uvector_kind(a), n);
+  switch (uvector_kind(a)) {
+    case UVECTOR_F64: f64_add(uvector_f64(d), uvector_f64(a), uvector_f64(b), n); break;
+    case UVECTOR_S32: s32_add(uvector_s32(d), uvector_s32(a), uvector_s32(b), n); break;
+    case UVECTOR_U8: u8_add(uvector_u8(d), uvector_u8(a), uvector_u8(b), n); break;
+  }
+  return d;
+}
+
+sexp uvector_mul(sexp a, sexp b) {
+  check_same_shape(a, b, "uvector-mul");
+  size_t n = uvector_length(a);
+  sexp d = make_uvector(uvector_kind(a), n);
+  switch (uvector_kind(a)) {
+    case UVECTOR_F64: f64_mul(uvector_f64(d), uvector_f64(a), uvector_f64(b), n); break;
+    case UVECTOR_S32: s32_mul(uvector_s32(d), uvector_s32(a), uvector_s32(b), n); break;
+    case UVECTOR_U8: u8_mul(uvector_u8(d), uvector_u8(a), uvector_u8(b), n); break;
+  }
+  return d;
+}
+
+/* The integers are summed in 64 bits */
+sexp uvector_dot(sexp a, sexp b) {
+  check_same_shape(a, b, "uvector-dot");
+  size_t n = uvector_length(a);
+  switch (uvector_kind(a)) {
+    case UVECTOR_F64: return make_flonum(f64_dot(uvector_f64(a), uvector_f64(b), n));
+    case UVECTOR_S32: return make_integer(s32_dot(uvector_s32(a), uvector_s32(b), n));
+    default: return make_integer(u8_dot(uvector_u8(a), uvector_u8(b), n));
+  }
+}
+
+sexp uvector_sum(sexp v) {
+  check_uvector(v, "uvector-sum");
+  size_t n = uvector_length(v);
+  switch (uvector_kind(v)) {
+    case UVECTOR_F64: return make_flonum(f64_sum(uvector_f64(v), n));
+    case UVECTOR_S32: return make_integer(s32_sum(uvector_s32(v), n));
+    default: return make_integer(u8_sum(uvector_u8(v), n));
+  }
+}
+
+sexp uvector_min(sexp v) {
+  check_not_empty(v, "uvector-min");
+  size_t n = uvector_length(v);
+  switch (uvector_kind(v)) {
+    case UVECTOR_F64: return make_flonum(f64_min(uvector_f64(v), n));
+    case UVECTOR_S32: return make_fixnum(s32_min(uvector_s32(v), n));
+    default: return make_fixnum(u8_min(uvector_u8(v), n));
+  }
+}
+
+sexp uvector_max(sexp v) {
+  check_not_empty(v, "uvector-max");
+  size_t n = uvector_length(v);
+  switch (uvector_kind(v)) {
+    case UVECTOR_F64: return make_flonum(f64_max(uvector_f64(v), n));
+    case UVECTOR_S32: return make_fixnum(s32_max(uvector_s32(v), n));
+    default: return make_fixnum(u8_max(uvector_u8(v), n));
+  }
+}
+
+/* A new vector of the elements of `v' multiplied by `k' */
+sexp uvector_scale(sexp v, sexp k) {
+  check_uvector(v, "uvector-scale");
+  union element e = to_element(uvector_kind(v), k, "uvector-scale");
+  size_t n = uvector_length(v);
+  sexp d = make_uvector(uvector_kind(v), n);
+  switch (uvector_kind(v)) {
+    case UVECTOR_F64: f64_scale(uvector_f64(d), uvector_f64(v), e.f64, n); break;
+    case UVECTOR_S32: s32_scale(uvector_s32(d), uvector_s32(v), e.s32, n); break;
+    case UVECTOR_U8: u8_scale(uvector_u8(d), uvector_u8(v), e.u8, n); break;
+  }
+  return d;
+}
+
+sexp uvector_fill(sexp v, sexp x) {
+  check_uvector(v, "uvector-fill!");
+  fill_elements(v, to_element(uvector_kind(v), x, "uvector-fill!"));
+  return v;
+}
+
+sexp uvector_copy(sexp v) {
+  check_uvector(v, "uvector-copy");
+  sexp d = make_uvector(uvector_kind(v), uvector_length(v));
+  memcpy(uvector_data(d), uvector_data(v),
+         uvector_length(v) * uvector_element_size(uvector_kind(v)));
+  return d;
+}
@@ -6,13 +6,19 @@
  * Copyright (C) 2013-03-18 liutos <mat.liutos@gmail.com>
  */
 #include <assert.h>
+#include <setjmp.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "assembler.h"
+#include "class.h"
 #include "eval.h"
+#include "number.h"
 #include "object.h"
 #include "types.h"
+#include "uvector.h"
+#include "vm.h"
 #include "write.h"
 
 #define SR(x) if (S(#x) == name) return x
@@ -25,23 +31,46 @@
 #define pop_to(stack, var) sexp var = vector_pop(stack)
 
 #define push(e, stack) stack = make_pair(e, stack)
+/* Registers of the register tier live on the stack above the frame pointer */
+#define REG(i) vector_data_at(stack, fp + (i))
+
+/*
+ * A call frame pushed by SAVE takes FRAME_SIZE slots of the VM stack: the
+ * code, the pc to return to, the environment, the frame pointer of the
+ * register tier and the position of the enclosing call frame. Register `bp'
+ * holds the position of the innermost call frame, -1 if none.
+ *
+ * A catch frame is the tag and the position of the enclosing catch frame,
+ * followed by a call frame which continues after the `catch' form. A throw
+ * unwinds the stack to the frame and continues there.
+ *
+ * vm_catcher: Position of the innermost catch frame, -1 if none
+ * vm_jmp_buf: The innermost running `run_machine', nested by `vm_apply'
+ */
+#define FRAME_SIZE 5
+/* The C stack used by the nested machines, half of the usual 8MB */
+#define C_STACK_LIMIT (4 << 20)
+
+/* The highest address of the C stack, provided by glibc */
+extern void *__libc_stack_end;
+
+int vm_catcher = -1;
+jmp_buf *vm_jmp_buf = NULL;
+int thrown_catcher;
+sexp thrown_value;
 
 enum code_type code_name(lisp_object_t code) {
   return fixnum_value(code);
 }
 
 sexp get_variable_by_index(int i, int j, sexp env) {
-  for (; i > 0; i--) env = environment_outer(env);
-  sexp bindings = environment_bindings(env);
-  for (; j > 0; j--) bindings = pair_cdr(bindings);
-  return pair_cdar(bindings);
+  for (; i > 0; i--) env = frame_outer(env);
+  return frame_slot(env, j);
 }
 
 void set_variable_by_index(int i, int j, sexp new_value, sexp env) {
-  for (; i > 0; i--) env = environment_outer(env);
-  sexp bindings = environment_bindings(env);
-  for (; j > 0; j--) bindings = pair_cdr(bindings);
-  pair_cdar(bindings) = new_value;
+  for (; i > 0; i--) env = frame_outer(env);
+  frame_slot(env, j) = new_value;
 }
 
 lisp_object_t make_arguments(lisp_object_t stack, int n) {
@@ -82,29 +111,20 @@ void nth_insert_pair(int n, lisp_object_t object, lisp_object_t pair) {
   pair_cdr(pair) = new_cdr;
 }
 
-/* Moves n elements from top of `stack' into `env' */
-void move_args(int n, sexp stack, sexp *env) {
-  *env = extend_environment(EOL, EOL, *env);
-  sexp bindings = environment_bindings(*env);
-  for (; n > 0; n--) {
-    pop_to(stack, arg);
-    push(make_pair(EOL, arg), bindings);
-  }
-  environment_bindings(*env) = bindings;
+/* Moves n elements from top of `stack' into a new frame of `size' slots */
+void move_args(int n, int size, sexp stack, sexp *env) {
+  sexp frame = make_frame(size, *env);
+  for (int i = 0; i < n; i++)
+    frame_slot(frame, i) = vector_pop(stack);
+  *env = frame;
 }
 
-void move_argsd(int nargs, int n, sexp stack, sexp *env) {
-  sexp bindings, cur, pre;
-  pre = bindings = make_pair(EOL, EOL);
-  for (int i = 0; i < n; i++) {
-    cur = make_pair(make_pair(EOL, vector_pop(stack)), EOL);
-    pair_cdr(pre) = cur;
-    pre = cur;
-  }
-  sexp rest = make_arguments(stack, nargs - n);
-  pair_cdr(cur) = make_pair(make_pair(EOL, rest), EOL);
-  /* *env = extend_environment(EOL, pair_cdr(bindings), *env); */
-  *env = make_environment(pair_cdr(bindings), *env);
+void move_argsd(int nargs, int n, int size, sexp stack, sexp *env) {
+  sexp frame = make_frame(size, *env);
+  for (int i = 0; i < n; i++)
+    frame_slot(frame, i) = vector_pop(stack);
+  frame_slot(frame, n) = make_arguments(stack, nargs - n);
+  *env = frame;
 }
 
 sexp top(sexp stack) {
@@ -117,14 +137,169 @@ sexp next_arg(sexp code_vector, int *index) {
   return vector_data_at(code_vector, *index);
 }
 
-/* Run the code generated from compiling an S-exp by function `assemble_code'. */
-sexp run_compiled_code(sexp obj, sexp env, sexp stack) {
-  assert(is_vector(stack));
-  assert(is_compiled_proc(obj));
-  sexp code = compiled_proc_code(obj);
-  int nargs = 0;
-  code = assemble_code(code);
-  int pc = 0;
+/* Reads the next argument, which is either a register or a constant */
+sexp next_operand(sexp code_vector, int *index, int fp, sexp stack) {
+  sexp x = next_arg(code_vector, index);
+  return is_register(x) ? REG(register_index(x)): x;
+}
+
+/* Returns the assembled code of a compiled procedure, assembles it at most once */
+sexp proc_bytecode(sexp proc) {
+  if (compiled_proc_bytecode(proc) == NULL)
+    compiled_proc_bytecode(proc) = assemble_code(compiled_proc_code(proc));
+  return compiled_proc_bytecode(proc);
+}
+
+/* Generic arithmetic: two fixnums are computed inline unless the result
+   overflows, the other cases go to the slow paths in `number.c' */
+static inline sexp generic_add(sexp n1, sexp n2) {
+  intptr_t r;
+  if (are_fixnums(n1, n2) &&
+      !__builtin_add_overflow(fixnum_value(n1), fixnum_value(n2), &r) &&
+      is_fixnum_range(r))
+    return make_fixnum(r);
+  return number_add(n1, n2);
+}
+
+static inline sexp generic_sub(sexp n1, sexp n2) {
+  intptr_t r;
+  if (are_fixnums(n1, n2) &&
+      !__builtin_sub_overflow(fixnum_value(n1), fixnum_value(n2), &r) &&
+      is_fixnum_range(r))
+    return make_fixnum(r);
+  return number_sub(n1, n2);
+}
+
+static inline sexp generic_mul(sexp n1, sexp n2) {
+  intptr_t r;
+  if (are_fixnums(n1, n2) &&
+      !__builtin_mul_overflow(fixnum_value(n1), fixnum_value(n2), &r) &&
+      is_fixnum_range(r))
+    return make_fixnum(r);
+  return number_mul(n1, n2);
+}
+
+/* The order of fixnums is the order of their tagged representations */
+#define generic_compare(n1, n2, op, slow)                               \
+  (are_fixnums(n1, n2) ?                                                \
+   ((intptr_t)(n1) op (intptr_t)(n2) ? true_object: false_object):     \
+   slow(n1, n2))
+
+/* Pops `n' arguments from `stack' into `argv', the first argument goes to `argv[0]' */
+void pop_arguments(int n, sexp *argv, sexp stack) {
+  for (int i = 0; i < n; i++)
+    argv[i] = vector_pop(stack);
+}
+
+/* Calls the primitive `op' with `argc' arguments without consing a list */
+sexp call_primitive(sexp op, int argc, sexp *argv) {
+  if (!is_arity_exist(op))
+    return procv(op)(argc, argv);
+  if (argc != fixnum_value(primitive_arity(op))) {
+    port_format(scm_out_port,
+                "Wrong argument number: %d but expecting %d\n",
+                make_fixnum(argc), primitive_arity(op));
+    exit(1);
+  }
+  switch (argc) {
+    case 0: return proc0(op)();
+    case 1: return proc1(op)(argv[0]);
+    case 2: return proc2(op)(argv[0], argv[1]);
+    default: return proc3(op)(argv[0], argv[1], argv[2]);
+  }
+}
+
+/* Moves `nargs' arguments from top of `stack' into the registers starting at `fp', the first argument goes to register 0. */
+void move_args2registers(int nargs, int fp, sexp stack) {
+  int top = vector_pos(stack);
+  sexp args[nargs + 1];
+  for (int i = 0; i < nargs; i++)
+    args[i] = vector_data_at(stack, top - 1 - i);
+  for (int i = 0; i < nargs; i++)
+    REG(i) = args[i];
+}
+
+/* Reserves the slots for temporary registers */
+void reserve_registers(int fp, int nregs, sexp stack) {
+  vector_reserve(stack, fp + nregs);
+  for (int i = vector_pos(stack); i < fp + nregs; i++)
+    vector_data_at(stack, i) = EOL;
+  vector_pos(stack) = fp + nregs;
+}
+
+/* Returns the position of the innermost catch frame of `tag', or -1 */
+int find_catcher(sexp tag) {
+  int i = vm_catcher;
+  while (i >= 0 && vector_data_at(vm_stack, i) != tag)
+    i = fixnum_value(vector_data_at(vm_stack, i + 1));
+  return i;
+}
+
+/* Transfers `value' to the innermost catch frame of `tag' */
+void throw_object(sexp tag, sexp value) {
+  int i = find_catcher(tag);
+  if (i < 0 || vm_jmp_buf == NULL) {
+    port_format(scm_err_port, "No catch for tag %*\n", tag);
+    exit(1);
+  }
+  thrown_catcher = i;
+  thrown_value = value;
+  longjmp(*vm_jmp_buf, 1);
+}
+
+/* Called when the VM stack reaches `vm_stack_limit' */
+void signal_stack_overflow(void) {
+  sexp tag = S("stack-overflow");
+  if (find_catcher(tag) < 0) {
+    port_format(scm_err_port, "Stack overflow: more than %d slots\n",
+                make_fixnum(vm_stack_limit));
+    exit(1);
+  }
+  throw_object(tag, tag);
+}
+
+/* Called when the nested machines use more than `C_STACK_LIMIT' of the C stack */
+void signal_nesting_overflow(void) {
+  sexp tag = S("stack-overflow");
+  if (find_catcher(tag) < 0) {
+    port_format(scm_err_port, "Stack overflow: calls from C nested too deeply\n");
+    exit(1);
+  }
+  throw_object(tag, tag);
+}
+
+/* The slow path of an access to a record of `type' */
+void signal_record_type(sexp x, sexp type) {
+  port_format(scm_err_port, "%*: Wrong type argument %*\n", record_type_name(type), x);
+  exit(1);
+}
+
+/* Pushes a call frame and returns its position */
+int push_frame(sexp code, int pc, sexp env, int fp, int bp, sexp stack) {
+  int frame = vector_pos(stack);
+  vector_reserve(stack, frame + FRAME_SIZE);
+  vector_data_at(stack, frame) = code;
+  vector_data_at(stack, frame + 1) = make_fixnum(pc);
+  vector_data_at(stack, frame + 2) = env;
+  vector_data_at(stack, frame + 3) = make_fixnum(fp);
+  vector_data_at(stack, frame + 4) = make_fixnum(bp);
+  vector_pos(stack) = frame + FRAME_SIZE;
+  return frame;
+}
+
+/* Restores the machine context saved in the call frame at `frame' */
+#define restore_frame(frame)                                    \
+  do {                                                          \
+    code = vector_data_at(stack, (frame));                      \
+    pc = fixnum_value(vector_data_at(stack, (frame) + 1));      \
+    env = vector_data_at(stack, (frame) + 2);                   \
+    fp = fixnum_value(vector_data_at(stack, (frame) + 3));      \
+    bp = fixnum_value(vector_data_at(stack, (frame) + 4));      \
+  } while (0)
+
+sexp execute_code(sexp code, int pc, sexp env, int fp, int bp, int nargs, sexp stack) {
+  double fstack[FLOAT_STACK_SIZE];
+  int fsp = 0;
   while (pc < vector_length(code)) {
     assert(is_vector(code));
     sexp ins = vector_data_at(code, pc);
@@ -134,22 +309,24 @@ sexp run_compiled_code(sexp obj, sexp env, sexp stack) {
       /* Function call/return instructions */
       case ARGS: {
         sexp n = next_arg(code, &pc);
+        int size = fixnum_value(next_arg(code, &pc));
         if (nargs != fixnum_value(n)) {
           port_format(scm_out_port,
                       "Wrong argument number: %d but expecting %d\n",
                       n, make_fixnum(nargs));
           exit(1);
         }
-        move_args(fixnum_value(n), stack, &env);
+        move_args(fixnum_value(n), size, stack, &env);
         pc++;
       } break;
       case ARGSD: {
-        int n = fixnum_value(vector_data_at(code, ++pc));
+        int n = fixnum_value(next_arg(code, &pc));
+        int size = fixnum_value(next_arg(code, &pc));
         if (nargs < n) {
           port_format(scm_out_port, "Unscientific!\n");
           exit(1);
         }
-        move_argsd(nargs, n, stack, &env);
+        move_argsd(nargs, n, size, stack, &env);
         /* port_format(scm_out_port, "%*\n", environment_bindings(env)); */
         /* exit(0); */
         /* int top = vector_pos(stack); */
@@ -172,18 +349,61 @@ sexp run_compiled_code(sexp obj, sexp env, sexp stack) {
         /* environment_bindings(env) = bindings; */
         pc++;
       } break;
+      case SCALLJ:
+      case RCALLJ: {
+        /* Tail call: Replaces the registers by the arguments and the callee */
+        int n = fixnum_value(vector_data_at(code, pc + 1)) + 1;
+        int top = vector_pos(stack);
+        for (int i = 0; i < n; i++)
+          REG(i) = vector_data_at(stack, top - n + i);
+        vector_pos(stack) = fp + n;
+      }
       case CALLJ: {
         nargs = fixnum_value(vector_data_at(code, ++pc));
         pop_to(stack, proc);
-        code = assemble_code(compiled_proc_code(proc));
+        /* A generic function called without a cache */
+        if (is_generic(proc) && nargs > 0)
+          proc = generic_method(proc, vector_top(stack));
+        if (is_primitive(proc)) {
+          /* Returns at once with the value of the primitive */
+          sexp argv[nargs + 1];
+          pop_arguments(nargs, argv, stack);
+          vector_push(call_primitive(proc, nargs, argv), stack);
+          goto return_value;
+        }
+        if (is_compound(proc)) {
+          /* A procedure of the interpreter, defined in the REPL */
+          sexp argv[nargs + 1];
+          pop_arguments(nargs, argv, stack);
+          sexp operands = EOL;
+          for (int i = nargs - 1; i >= 0; i--)
+            operands = make_pair(argv[i], operands);
+          vector_push(eval_application(proc, operands), stack);
+          goto return_value;
+        }
+        if (!is_compiled_proc(proc)) {
+          port_format(scm_out_port, "Not applicable: %*\n", proc);
+          exit(1);
+        }
+        code = proc_bytecode(proc);
         env = compiled_proc_env(proc);
         pc = 0;
       } break;
       case FN: {
-        sexp fn = vector_data_at(code, ++pc);
+        /* Builds a flat closure of the `n' captured values on the stack */
+        sexp fn = next_arg(code, &pc);
+        int n = fixnum_value(next_arg(code, &pc));
+        sexp closure = global_environment(env);
+        if (n > 0) {
+          closure = make_frame(n, closure);
+          for (int i = 0; i < n; i++)
+            frame_slot(closure, i) = vector_pop(stack);
+        }
         sexp pars = compiled_proc_args(fn);
         sexp code = compiled_proc_code(fn);
-        vector_push(make_compiled_proc(pars, code, env), stack);
+        sexp proc = make_compiled_proc(pars, code, closure);
+        compiled_proc_bytecode(proc) = proc_bytecode(fn);
+        vector_push(proc, stack);
         pc++;
       } break;
       case MC: {
@@ -194,13 +414,12 @@ sexp run_compiled_code(sexp obj, sexp env, sexp stack) {
         pc++;
       } break;
       case PRIM: {
+        /* Variadic primitive: the arguments are passed as an array */
         pop_to(stack, op);
-        sexp n = vector_data_at(code, ++pc);
-        sexp args = make_arguments(stack, fixnum_value(n));
-        /* nth_pop(stack, fixnum_value(n)); */
-        port_format(scm_err_port, "This shouldn't happen!\n");
-        exit(1);
-        vector_push(eval_application(op, args), stack);
+        int n = fixnum_value(next_arg(code, &pc));
+        sexp argv[n + 1];
+        pop_arguments(n, argv, stack);
+        vector_push(call_primitive(op, n, argv), stack);
         pc++;
       } break;
       case PRIM0: {
@@ -230,24 +449,28 @@ sexp run_compiled_code(sexp obj, sexp env, sexp stack) {
         vector_push(proc3(op)(arg1, arg2, arg3), stack);
         pc++;
       } break;
-      case RETURN: {                    /* No vector operations */
+      case RRET: {
+        /* Discards the registers and returns the value on the stack */
+        sexp value = next_operand(code, &pc, fp, stack);
+        vector_pos(stack) = fp;
+        vector_push(value, stack);
+      }
+      case RETURN: return_value: {      /* No vector operations */
         pop_to(stack, value);
-        if (is_return_info(vector_top(stack))) {
+        if (bp >= 0) {
           /* Restores the stack-based machine context */
-          pop_to(stack, info);
-          code = return_code(info);
-          env = return_env(info);
-          pc = return_pc(info);
+          int frame = bp;
+          restore_frame(frame);
+          vector_pos(stack) = frame;
           vector_push(value, stack);
         } else {
           vector_push(value, stack);
           goto halt;
         }
-        pc++;
       } break;
       case SAVE: {
         sexp l = next_arg(code, &pc);
-        vector_push(make_return_info(code, fixnum_value(l), env), stack);
+        bp = push_frame(code, fixnum_value(l), env, fp, bp, stack);
         pc++;
       } break;
 
@@ -286,6 +509,49 @@ sexp run_compiled_code(sexp obj, sexp env, sexp stack) {
         pc++;
       } break;
       case POP: vector_pop(stack); pc++; break;
+      case LBOX: {
+        int j = fixnum_value(next_arg(code, &pc));
+        frame_slot(env, j) = make_box(frame_slot(env, j));
+        pc++;
+      } break;
+      case BVAR: {
+        int i = fixnum_value(next_arg(code, &pc));
+        int j = fixnum_value(next_arg(code, &pc));
+        vector_push(box_value(get_variable_by_index(i, j, env)), stack);
+        pc++;
+      } break;
+      case BSET: {
+        int i = fixnum_value(next_arg(code, &pc));
+        int j = fixnum_value(next_arg(code, &pc));
+        box_value(get_variable_by_index(i, j, env)) = vector_top(stack);
+        pc++;
+      } break;
+        /* The frame on the VM stack is the registers of the register tier */
+      case SVAR: {
+        int j = fixnum_value(next_arg(code, &pc));
+        vector_push(REG(j), stack);
+        pc++;
+      } break;
+      case SSET: {
+        int j = fixnum_value(next_arg(code, &pc));
+        REG(j) = vector_top(stack);
+        pc++;
+      } break;
+      case SBOX: {
+        int j = fixnum_value(next_arg(code, &pc));
+        REG(j) = make_box(REG(j));
+        pc++;
+      } break;
+      case SBVAR: {
+        int j = fixnum_value(next_arg(code, &pc));
+        vector_push(box_value(REG(j)), stack);
+        pc++;
+      } break;
+      case SBSET: {
+        int j = fixnum_value(next_arg(code, &pc));
+        box_value(REG(j)) = vector_top(stack);
+        pc++;
+      } break;
 
         /* Branching instructions */
       case FJUMP: {
@@ -344,6 +610,513 @@ sexp run_compiled_code(sexp obj, sexp env, sexp stack) {
         vector_push(o2 == o1 ? true_object: false_object, stack);
         pc++;
       } break;
+      case NADD: {
+        pop_to(stack, n1);
+        pop_to(stack, n2);
+        vector_push(generic_add(n1, n2), stack);
+        pc++;
+      } break;
+      case NSUB: {
+        pop_to(stack, n1);
+        pop_to(stack, n2);
+        vector_push(generic_sub(n1, n2), stack);
+        pc++;
+      } break;
+      case NMUL: {
+        pop_to(stack, n1);
+        pop_to(stack, n2);
+        vector_push(generic_mul(n1, n2), stack);
+        pc++;
+      } break;
+      case NDIV: {
+        pop_to(stack, n1);
+        pop_to(stack, n2);
+        vector_push(number_div(n1, n2), stack);
+        pc++;
+      } break;
+      case NLT: {
+        pop_to(stack, n1);
+        pop_to(stack, n2);
+        vector_push(generic_compare(n1, n2, <, number_lt), stack);
+        pc++;
+      } break;
+      case NEQ: {
+        pop_to(stack, n1);
+        pop_to(stack, n2);
+        vector_push(generic_compare(n1, n2, ==, number_eq), stack);
+        pc++;
+      } break;
+      case NGT: {
+        pop_to(stack, n1);
+        pop_to(stack, n2);
+        vector_push(generic_compare(n1, n2, >, number_gt), stack);
+        pc++;
+      } break;
+      case CATCH: {
+        sexp l = next_arg(code, &pc);
+        pop_to(stack, tag);
+        int index = vector_pos(stack);
+        vector_push(tag, stack);
+        vector_push(make_fixnum(vm_catcher), stack);
+        push_frame(code, fixnum_value(l), env, fp, bp, stack);
+        vm_catcher = index;
+        pc++;
+      } break;
+      case UNCATCH: {
+        pop_to(stack, value);
+        vector_pos(stack) -= FRAME_SIZE;
+        vm_catcher = fixnum_value(vector_pop(stack));
+        vector_pop(stack);
+        vector_push(value, stack);
+        pc++;
+      } break;
+      case THROW: {
+        pop_to(stack, tag);
+        pop_to(stack, value);
+        throw_object(tag, value);
+      } break;
+
+
+        /* Register tier */
+      case SARGS:
+      case RARGS: {
+        int n = fixnum_value(next_arg(code, &pc));
+        int nregs = fixnum_value(next_arg(code, &pc));
+        if (nargs != n) {
+          port_format(scm_out_port,
+                      "Wrong argument number: %d but expecting %d\n",
+                      make_fixnum(nargs), make_fixnum(n));
+          exit(1);
+        }
+        fp = vector_pos(stack) - n;
+        move_args2registers(n, fp, stack);
+        reserve_registers(fp, nregs, stack);
+        pc++;
+      } break;
+      case SARGSD:
+      case RARGSD: {
+        int n = fixnum_value(next_arg(code, &pc));
+        int nregs = fixnum_value(next_arg(code, &pc));
+        if (nargs < n) {
+          port_format(scm_out_port, "Unscientific!\n");
+          exit(1);
+        }
+        fp = vector_pos(stack) - nargs;
+        sexp rest = EOL;
+        for (int i = fp; i < vector_pos(stack) - n; i++)
+          rest = make_pair(vector_data_at(stack, i), rest);
+        move_args2registers(n, fp, stack);
+        vector_pos(stack) = fp + n;
+        reserve_registers(fp, nregs, stack);
+        REG(n) = rest;
+        pc++;
+      } break;
+      case RMOV: {
+        sexp d = next_arg(code, &pc);
+        REG(register_index(d)) = next_operand(code, &pc, fp, stack);
+        pc++;
+      } break;
+      case RPUSH: {
+        vector_push(next_operand(code, &pc, fp, stack), stack);
+        pc++;
+      } break;
+      case RPOP: {
+        sexp d = next_arg(code, &pc);
+        REG(register_index(d)) = vector_pop(stack);
+        pc++;
+      } break;
+      case RGVAR: {
+        sexp d = next_arg(code, &pc);
+        sexp var = next_arg(code, &pc);
+        sexp value = get_variable_value(var, env);
+        if (is_undefined(value)) {
+          port_format(scm_out_port, "Unbound variable: %*\n", var);
+          exit(1);
+        }
+        REG(register_index(d)) = value;
+        pc++;
+      } break;
+      case RGSET: {
+        sexp var = next_arg(code, &pc);
+        set_binding(var, next_operand(code, &pc, fp, stack), env);
+        pc++;
+      } break;
+      case RLVAR: {
+        sexp d = next_arg(code, &pc);
+        int i = fixnum_value(next_arg(code, &pc));
+        int j = fixnum_value(next_arg(code, &pc));
+        REG(register_index(d)) = get_variable_by_index(i, j, env);
+        pc++;
+      } break;
+      case RLSET: {
+        int i = fixnum_value(next_arg(code, &pc));
+        int j = fixnum_value(next_arg(code, &pc));
+        sexp value = next_operand(code, &pc, fp, stack);
+        set_variable_by_index(i, j, value, env);
+        pc++;
+      } break;
+      case RFJUMP: {
+        sexp e = next_operand(code, &pc, fp, stack);
+        sexp l = next_arg(code, &pc);
+        if (is_false(e)) pc = fixnum_value(l);
+        else pc++;
+      } break;
+      case RTJUMP: {
+        sexp e = next_operand(code, &pc, fp, stack);
+        sexp l = next_arg(code, &pc);
+        if (!is_false(e)) pc = fixnum_value(l);
+        else pc++;
+      } break;
+      case RPRIM0: {
+        sexp d = next_arg(code, &pc);
+        sexp op = next_operand(code, &pc, fp, stack);
+        REG(register_index(d)) = proc0(op)();
+        pc++;
+      } break;
+      case RPRIM1: {
+        sexp d = next_arg(code, &pc);
+        sexp op = next_operand(code, &pc, fp, stack);
+        sexp arg1 = next_operand(code, &pc, fp, stack);
+        sexp value = proc1(op)(arg1);
+        REG(register_index(d)) = value;
+        pc++;
+      } break;
+      case RPRIM2: {
+        sexp d = next_arg(code, &pc);
+        sexp op = next_operand(code, &pc, fp, stack);
+        sexp arg1 = next_operand(code, &pc, fp, stack);
+        sexp arg2 = next_operand(code, &pc, fp, stack);
+        sexp value = proc2(op)(arg1, arg2);
+        REG(register_index(d)) = value;
+        pc++;
+      } break;
+      case RPRIM3: {
+        sexp d = next_arg(code, &pc);
+        sexp op = next_operand(code, &pc, fp, stack);
+        sexp arg1 = next_operand(code, &pc, fp, stack);
+        sexp arg2 = next_operand(code, &pc, fp, stack);
+        sexp arg3 = next_operand(code, &pc, fp, stack);
+        sexp value = proc3(op)(arg1, arg2, arg3);
+        REG(register_index(d)) = value;
+        pc++;
+      } break;
+      case RADD: {
+        sexp d = next_arg(code, &pc);
+        sexp n1 = next_operand(code, &pc, fp, stack);
+        sexp n2 = next_operand(code, &pc, fp, stack);
+        REG(register_index(d)) = make_fixnum(fixnum_value(n1) + fixnum_value(n2));
+        pc++;
+      } break;
+      case RSUB: {
+        sexp d = next_arg(code, &pc);
+        sexp n1 = next_operand(code, &pc, fp, stack);
+        sexp n2 = next_operand(code, &pc, fp, stack);
+        REG(register_index(d)) = make_fixnum(fixnum_value(n1) - fixnum_value(n2));
+        pc++;
+      } break;
+      case RMUL: {
+        sexp d = next_arg(code, &pc);
+        sexp n1 = next_operand(code, &pc, fp, stack);
+        sexp n2 = next_operand(code, &pc, fp, stack);
+        REG(register_index(d)) = make_fixnum(fixnum_value(n1) * fixnum_value(n2));
+        pc++;
+      } break;
+      case RDIV: {
+        sexp d = next_arg(code, &pc);
+        sexp n1 = next_operand(code, &pc, fp, stack);
+        sexp n2 = next_operand(code, &pc, fp, stack);
+        REG(register_index(d)) = make_fixnum(fixnum_value(n1) / fixnum_value(n2));
+        pc++;
+      } break;
+      case RCAR: {
+        sexp d = next_arg(code, &pc);
+        sexp pair = next_operand(code, &pc, fp, stack);
+        REG(register_index(d)) = pair_car(pair);
+        pc++;
+      } break;
+      case RCDR: {
+        sexp d = next_arg(code, &pc);
+        sexp pair = next_operand(code, &pc, fp, stack);
+        REG(register_index(d)) = pair_cdr(pair);
+        pc++;
+      } break;
+      case REQ: {
+        sexp d = next_arg(code, &pc);
+        sexp o1 = next_operand(code, &pc, fp, stack);
+        sexp o2 = next_operand(code, &pc, fp, stack);
+        REG(register_index(d)) = o1 == o2 ? true_object: false_object;
+        pc++;
+      } break;
+      case RNADD: {
+        sexp d = next_arg(code, &pc);
+        sexp n1 = next_operand(code, &pc, fp, stack);
+        sexp n2 = next_operand(code, &pc, fp, stack);
+        REG(register_index(d)) = generic_add(n1, n2);
+        pc++;
+      } break;
+      case RNSUB: {
+        sexp d = next_arg(code, &pc);
+        sexp n1 = next_operand(code, &pc, fp, stack);
+        sexp n2 = next_operand(code, &pc, fp, stack);
+        REG(register_index(d)) = generic_sub(n1, n2);
+        pc++;
+      } break;
+      case RNMUL: {
+        sexp d = next_arg(code, &pc);
+        sexp n1 = next_operand(code, &pc, fp, stack);
+        sexp n2 = next_operand(code, &pc, fp, stack);
+        REG(register_index(d)) = generic_mul(n1, n2);
+        pc++;
+      } break;
+      case RNDIV: {
+        sexp d = next_arg(code, &pc);
+        sexp n1 = next_operand(code, &pc, fp, stack);
+        sexp n2 = next_operand(code, &pc, fp, stack);
+        REG(register_index(d)) = number_div(n1, n2);
+        pc++;
+      } break;
+      case RNLT: {
+        sexp d = next_arg(code, &pc);
+        sexp n1 = next_operand(code, &pc, fp, stack);
+        sexp n2 = next_operand(code, &pc, fp, stack);
+        REG(register_index(d)) = generic_compare(n1, n2, <, number_lt);
+        pc++;
+      } break;
+      case RNEQ: {
+        sexp d = next_arg(code, &pc);
+        sexp n1 = next_operand(code, &pc, fp, stack);
+        sexp n2 = next_operand(code, &pc, fp, stack);
+        REG(register_index(d)) = generic_compare(n1, n2, ==, number_eq);
+        pc++;
+      } break;
+      case RNGT: {
+        sexp d = next_arg(code, &pc);
+        sexp n1 = next_operand(code, &pc, fp, stack);
+        sexp n2 = next_operand(code, &pc, fp, stack);
+        REG(register_index(d)) = generic_compare(n1, n2, >, number_gt);
+        pc++;
+      } break;
+        /* Unboxed flonum instructions */
+      case FLOAD: {
+        pop_to(stack, n);
+        fstack[fsp++] = real_value(n, "flonum");
+        pc++;
+      } break;
+      case FADD: fsp--; fstack[fsp - 1] += fstack[fsp]; pc++; break;
+      case FSUB: fsp--; fstack[fsp - 1] -= fstack[fsp]; pc++; break;
+      case FMUL: fsp--; fstack[fsp - 1] *= fstack[fsp]; pc++; break;
+      case FDIV: fsp--; fstack[fsp - 1] /= fstack[fsp]; pc++; break;
+      case FBOX: {
+        vector_push(make_flonum(fstack[--fsp]), stack);
+        pc++;
+      } break;
+      case RFLOAD: {
+        sexp n = next_operand(code, &pc, fp, stack);
+        fstack[fsp++] = real_value(n, "flonum");
+        pc++;
+      } break;
+      case RFBOX: {
+        sexp d = next_arg(code, &pc);
+        REG(register_index(d)) = make_flonum(fstack[--fsp]);
+        pc++;
+      } break;
+        /* Bulk operations on uniform vectors */
+      case VADD: {
+        pop_to(stack, v1);
+        pop_to(stack, v2);
+        vector_push(uvector_add(v1, v2), stack);
+        pc++;
+      } break;
+      case VMUL: {
+        pop_to(stack, v1);
+        pop_to(stack, v2);
+        vector_push(uvector_mul(v1, v2), stack);
+        pc++;
+      } break;
+      case VDOT: {
+        pop_to(stack, v1);
+        pop_to(stack, v2);
+        vector_push(uvector_dot(v1, v2), stack);
+        pc++;
+      } break;
+      case VSUM: {
+        pop_to(stack, v);
+        vector_push(uvector_sum(v), stack);
+        pc++;
+      } break;
+      case VMIN: {
+        pop_to(stack, v);
+        vector_push(uvector_min(v), stack);
+        pc++;
+      } break;
+      case VMAX: {
+        pop_to(stack, v);
+        vector_push(uvector_max(v), stack);
+        pc++;
+      } break;
+      case VSCALE: {
+        pop_to(stack, v1);
+        pop_to(stack, v2);
+        vector_push(uvector_scale(v1, v2), stack);
+        pc++;
+      } break;
+      case VFILL: {
+        pop_to(stack, v1);
+        pop_to(stack, v2);
+        vector_push(uvector_fill(v1, v2), stack);
+        pc++;
+      } break;
+      case VCOPY: {
+        pop_to(stack, v);
+        vector_push(uvector_copy(v), stack);
+        pc++;
+      } break;
+      case RVADD: {
+        sexp d = next_arg(code, &pc);
+        sexp v1 = next_operand(code, &pc, fp, stack);
+        sexp v2 = next_operand(code, &pc, fp, stack);
+        REG(register_index(d)) = uvector_add(v1, v2);
+        pc++;
+      } break;
+      case RVMUL: {
+        sexp d = next_arg(code, &pc);
+        sexp v1 = next_operand(code, &pc, fp, stack);
+        sexp v2 = next_operand(code, &pc, fp, stack);
+        REG(register_index(d)) = uvector_mul(v1, v2);
+        pc++;
+      } break;
+      case RVDOT: {
+        sexp d = next_arg(code, &pc);
+        sexp v1 = next_operand(code, &pc, fp, stack);
+        sexp v2 = next_operand(code, &pc, fp, stack);
+        REG(register_index(d)) = uvector_dot(v1, v2);
+        pc++;
+      } break;
+      case RVSUM: {
+        sexp d = next_arg(code, &pc);
+        sexp v = next_operand(code, &pc, fp, stack);
+        REG(register_index(d)) = uvector_sum(v);
+        pc++;
+      } break;
+      case RVMIN: {
+        sexp d = next_arg(code, &pc);
+        sexp v = next_operand(code, &pc, fp, stack);
+        REG(register_index(d)) = uvector_min(v);
+        pc++;
+      } break;
+      case RVMAX: {
+        sexp d = next_arg(code, &pc);
+        sexp v = next_operand(code, &pc, fp, stack);
+        REG(register_index(d)) = uvector_max(v);
+        pc++;
+      } break;
+      case RVSCALE: {
+        sexp d = next_arg(code, &pc);
+        sexp v1 = next_operand(code, &pc, fp, stack);
+        sexp v2 = next_operand(code, &pc, fp, stack);
+        REG(register_index(d)) = uvector_scale(v1, v2);
+        pc++;
+      } break;
+      case RVFILL: {
+        sexp d = next_arg(code, &pc);
+        sexp v1 = next_operand(code, &pc, fp, stack);
+        sexp v2 = next_operand(code, &pc, fp, stack);
+        REG(register_index(d)) = uvector_fill(v1, v2);
+        pc++;
+      } break;
+      case RVCOPY: {
+        sexp d = next_arg(code, &pc);
+        sexp v = next_operand(code, &pc, fp, stack);
+        REG(register_index(d)) = uvector_copy(v);
+        pc++;
+      } break;
+        /* Generic functions */
+      case GMETHOD: {
+        /* The first argument is on the top */
+        sexp generic = next_arg(code, &pc);
+        sexp cache = next_arg(code, &pc);
+        vector_push(cached_method(generic, cache, vector_top(stack)), stack);
+        pc++;
+      } break;
+      case RGMETHOD: {
+        sexp d = next_arg(code, &pc);
+        sexp x = next_operand(code, &pc, fp, stack);
+        sexp generic = next_arg(code, &pc);
+        sexp cache = next_arg(code, &pc);
+        REG(register_index(d)) = cached_method(generic, cache, x);
+        pc++;
+      } break;
+        /* Records */
+      case RECMAKE: {
+        sexp type = next_arg(code, &pc);
+        sexp record = make_record(type);
+        for (int i = 0; i < record_type_size(type); i++)
+          record_slot(record, i) = vector_pop(stack);
+        vector_push(record, stack);
+        pc++;
+      } break;
+      case RECP: {
+        pop_to(stack, x);
+        sexp type = next_arg(code, &pc);
+        vector_push(is_record_of(x, type) ? true_object: false_object, stack);
+        pc++;
+      } break;
+      case RECREF: {
+        pop_to(stack, record);
+        sexp type = next_arg(code, &pc);
+        int i = fixnum_value(next_arg(code, &pc));
+        if (!is_record_of(record, type)) signal_record_type(record, type);
+        vector_push(record_slot(record, i), stack);
+        pc++;
+      } break;
+      case RECSET: {
+        pop_to(stack, record);
+        pop_to(stack, value);
+        sexp type = next_arg(code, &pc);
+        int i = fixnum_value(next_arg(code, &pc));
+        if (!is_record_of(record, type)) signal_record_type(record, type);
+        record_slot(record, i) = value;
+        vector_push(value, stack);
+        pc++;
+      } break;
+      case RRECNEW: {
+        sexp d = next_arg(code, &pc);
+        REG(register_index(d)) = make_record(next_arg(code, &pc));
+        pc++;
+      } break;
+      case RRECINIT: {
+        sexp r = next_operand(code, &pc, fp, stack);
+        sexp x = next_operand(code, &pc, fp, stack);
+        record_slot(r, fixnum_value(next_arg(code, &pc))) = x;
+        pc++;
+      } break;
+      case RRECP: {
+        sexp d = next_arg(code, &pc);
+        sexp x = next_operand(code, &pc, fp, stack);
+        sexp type = next_arg(code, &pc);
+        REG(register_index(d)) = is_record_of(x, type) ? true_object: false_object;
+        pc++;
+      } break;
+      case RRECREF: {
+        sexp d = next_arg(code, &pc);
+        sexp record = next_operand(code, &pc, fp, stack);
+        sexp type = next_arg(code, &pc);
+        int i = fixnum_value(next_arg(code, &pc));
+        if (!is_record_of(record, type)) signal_record_type(record, type);
+        REG(register_index(d)) = record_slot(record, i);
+        pc++;
+      } break;
+      case RRECSET: {
+        sexp d = next_arg(code, &pc);
+        sexp record = next_operand(code, &pc, fp, stack);
+        sexp value = next_operand(code, &pc, fp, stack);
+        sexp type = next_arg(code, &pc);
+        int i = fixnum_value(next_arg(code, &pc));
+        if (!is_record_of(record, type)) signal_record_type(record, type);
+        record_slot(record, i) = value;
+        REG(register_index(d)) = value;
+        pc++;
+      } break;
 
       default :
         fprintf(stderr, "run_compiled_code - Unknown code ");
@@ -359,3 +1132,239 @@ halt:
   /* return vector_top(stack); */
   return vector_pop(stack);
 }
+
+/* Runs `code' in a machine of its own whose part of `stack' starts at `base',
+   the first RETURN without a call frame ends it. A throw to a catch frame
+   below `base' continues in the enclosing machine. */
+sexp run_machine(sexp code, sexp env, int nargs, int base, sexp stack) {
+  jmp_buf buf;
+  jmp_buf *outer = vm_jmp_buf;
+  int pc = 0;
+  int fp = base;
+  int bp = -1;
+  /* Nested machines recurse on the C stack, whose depth is bounded as well */
+  if ((char *)__libc_stack_end - (char *)&buf > C_STACK_LIMIT)
+    signal_nesting_overflow();
+  if (setjmp(buf) != 0) {
+    int i = thrown_catcher;
+    if (i < base) {
+      /* The catch frame belongs to an outer machine */
+      vm_jmp_buf = outer;
+      longjmp(*outer, 1);
+    }
+    vm_catcher = fixnum_value(vector_data_at(stack, i + 1));
+    restore_frame(i + 2);
+    vector_pos(stack) = i;
+    vector_push(thrown_value, stack);
+    nargs = 0;
+  }
+  vm_jmp_buf = &buf;
+  sexp value = execute_code(code, pc, env, fp, bp, nargs, stack);
+  vm_jmp_buf = outer;
+  /* Discards the frame left by the outermost procedure */
+  vector_pos(stack) = base;
+  return value;
+}
+
+/* Run the code generated from compiling an S-exp by function `assemble_code'. */
+sexp run_compiled_code(sexp obj, sexp env, sexp stack) {
+  assert(is_vector(stack));
+  assert(is_compiled_proc(obj));
+  return run_machine(proc_bytecode(obj), env, 0, vector_pos(stack), stack);
+}
+
+/* Calls `proc' with the `argc' arguments in `argv' from C. A compiled
+   procedure runs in a nested machine above the top of `vm_stack', where its
+   arguments stay reachable by the collector. */
+sexp vm_apply(sexp proc, int argc, sexp *argv) {
+  if (is_generic(proc) && argc > 0)
+    proc = generic_method(proc, argv[0]);
+  if (is_primitive(proc))
+    return call_primitive(proc, argc, argv);
+  if (is_compound(proc)) {
+    sexp operands = EOL;
+    for (int i = argc - 1; i >= 0; i--)
+      operands = make_pair(argv[i], operands);
+    return eval_application(proc, operands);
+  }
+  if (!is_compiled_proc(proc)) {
+    port_format(scm_out_port, "Not applicable: %*\n", proc);
+    exit(1);
+  }
+  int base = vector_pos(vm_stack);
+  for (int i = argc - 1; i >= 0; i--)
+    vector_push(argv[i], vm_stack);
+  return run_machine(proc_bytecode(proc), compiled_proc_env(proc), argc, base, vm_stack);
+}
+
+/* Higher-order procedures */
+/* The instructions run in place of a call by `map', `for-each', `fold' and
+   `filter' when their procedure is the primitive of one of them */
+static const enum code_type inline_codes[] = {
+  CAR, CDR, IADD, ISUB, IMUL, NADD, NSUB, NMUL, NLT, NEQ, NGT, EQ,
+};
+
+/* Returns the instruction which applies `proc' to `argc' arguments, or -1 */
+int inline_instruction(sexp proc, int argc) {
+  if (!is_primitive(proc) || !is_code_exist(proc) || !is_arity_exist(proc) ||
+      fixnum_value(primitive_arity(proc)) != argc)
+    return -1;
+  for (int i = 0; i < sizeof(inline_codes) / sizeof(enum code_type); i++)
+    if (strcmp(primitive_opcode(proc), opcodes[inline_codes[i]].name) == 0)
+      return inline_codes[i];
+  return -1;
+}
+
+/* Applies `proc' as its instruction `code' does, without a call frame */
+static inline sexp apply_inline(int code, sexp proc, int argc, sexp *argv) {
+  sexp n1 = argv[0], n2 = argv[argc - 1];
+  switch (code) {
+    case CAR: return pair_car(n1);
+    case CDR: return pair_cdr(n1);
+    case IADD: return make_fixnum(fixnum_value(n1) + fixnum_value(n2));
+    case ISUB: return make_fixnum(fixnum_value(n1) - fixnum_value(n2));
+    case IMUL: return make_fixnum(fixnum_value(n1) * fixnum_value(n2));
+    case NADD: return generic_add(n1, n2);
+    case NSUB: return generic_sub(n1, n2);
+    case NMUL: return generic_mul(n1, n2);
+    case NLT: return generic_compare(n1, n2, <, number_lt);
+    case NEQ: return generic_compare(n1, n2, ==, number_eq);
+    case NGT: return generic_compare(n1, n2, >, number_gt);
+    case EQ: return n1 == n2 ? true_object: false_object;
+    default : return vm_apply(proc, argc, argv);
+  }
+}
+
+void check_procedure(sexp proc, char *op) {
+  if (is_primitive(proc) || is_compound(proc) || is_compiled_proc(proc) ||
+      is_generic(proc))
+    return;
+  port_format(scm_err_port, "%s: Wrong type argument %*\n", make_string(op), proc);
+  exit(1);
+}
+
+/* The sequences are all lists or all vectors */
+void check_sequences(int n, sexp *seqs, char *op) {
+  for (int i = 0; i < n; i++)
+    if (is_vector(seqs[i]) != is_vector(seqs[0]) ||
+        !(is_vector(seqs[i]) || is_pair(seqs[i]) || is_null(seqs[i]))) {
+      port_format(scm_err_port, "%s: Wrong type argument %*\n", make_string(op), seqs[i]);
+      exit(1);
+    }
+}
+
+/* A list must end with the empty list, checked once the shortest one ends */
+void check_list_ends(int n, sexp *seqs, char *op) {
+  for (int i = 0; i < n; i++)
+    if (!is_pair(seqs[i]) && !is_null(seqs[i]) && !is_vector(seqs[i])) {
+      port_format(scm_err_port, "%s: Wrong type argument %*\n", make_string(op), seqs[i]);
+      exit(1);
+    }
+}
+
+/* Takes the `i'th elements of the `n' sequences into `args', the lists in
+   `seqs' move to their next pairs. Returns 0 once one of them is exhausted,
+   a vector may be shortened by the procedure. */
+static inline int next_arguments(int n, sexp *seqs, int i, sexp *args) {
+  for (int j = 0; j < n; j++)
+    if (is_pair(seqs[j])) {
+      args[j] = pair_car(seqs[j]);
+      seqs[j] = pair_cdr(seqs[j]);
+    } else if (is_vector(seqs[j]) && i < vector_pos(seqs[j]))
+      args[j] = vector_data_at(seqs[j], i);
+    else
+      return 0;
+  return 1;
+}
+
+void check_argument_number(int argc, int least, char *op) {
+  if (argc >= least) return;
+  port_format(scm_err_port, "%s: Wrong argument number: %d\n", make_string(op), make_fixnum(argc));
+  exit(1);
+}
+
+/* (map f seq ...): A list is built forwards through the pointer to the cdr
+   of its last pair, a vector is filled as the elements come */
+sexp map_proc(int argc, sexp *argv) {
+  check_argument_number(argc, 2, "map");
+  check_procedure(argv[0], "map");
+  int n = argc - 1;
+  sexp seqs[n], args[n];
+  for (int i = 0; i < n; i++)
+    seqs[i] = argv[i + 1];
+  check_sequences(n, seqs, "map");
+  int code = inline_instruction(argv[0], n);
+  if (is_vector(seqs[0])) {
+    int length = vector_pos(seqs[0]);
+    for (int i = 1; i < n; i++)
+      if (vector_pos(seqs[i]) < length) length = vector_pos(seqs[i]);
+    sexp result = make_vector(length);
+    for (int i = 0; i < length && next_arguments(n, seqs, i, args); i++) {
+      sexp value = apply_inline(code, argv[0], n, args);
+      vector_data_at(result, i) = value;
+      vector_pos(result) = i + 1;
+    }
+    return result;
+  }
+  sexp head = EOL;
+  sexp *tail = &head;
+  while (next_arguments(n, seqs, 0, args)) {
+    *tail = make_pair(apply_inline(code, argv[0], n, args), EOL);
+    tail = &pair_cdr(*tail);
+  }
+  check_list_ends(n, seqs, "map");
+  return head;
+}
+
+sexp for_each_proc(int argc, sexp *argv) {
+  check_argument_number(argc, 2, "for-each");
+  check_procedure(argv[0], "for-each");
+  int n = argc - 1;
+  sexp seqs[n], args[n];
+  for (int i = 0; i < n; i++)
+    seqs[i] = argv[i + 1];
+  check_sequences(n, seqs, "for-each");
+  int code = inline_instruction(argv[0], n);
+  for (int i = 0; next_arguments(n, seqs, i, args); i++)
+    apply_inline(code, argv[0], n, args);
+  check_list_ends(n, seqs, "for-each");
+  return argv[1];
+}
+
+/* (fold kons knil seq) calls `kons' on each element and the value so far */
+sexp fold_proc(sexp kons, sexp knil, sexp seq) {
+  check_procedure(kons, "fold");
+  check_sequences(1, &seq, "fold");
+  int code = inline_instruction(kons, 2);
+  sexp args[2];
+  for (int i = 0; next_arguments(1, &seq, i, args); i++) {
+    args[1] = knil;
+    knil = apply_inline(code, kons, 2, args);
+  }
+  check_list_ends(1, &seq, "fold");
+  return knil;
+}
+
+/* (filter pred seq) keeps the elements for which `pred' is true, in order */
+sexp filter_proc(sexp pred, sexp seq) {
+  check_procedure(pred, "filter");
+  check_sequences(1, &seq, "filter");
+  int code = inline_instruction(pred, 1);
+  sexp x;
+  if (is_vector(seq)) {
+    sexp result = make_vector(vector_pos(seq));
+    for (int i = 0; next_arguments(1, &seq, i, &x); i++)
+      if (apply_inline(code, pred, 1, &x) != false_object)
+        vector_push(x, result);
+    return result;
+  }
+  sexp head = EOL;
+  sexp *tail = &head;
+  while (next_arguments(1, &seq, 0, &x))
+    if (apply_inline(code, pred, 1, &x) != false_object) {
+      *tail = make_pair(x, EOL);
+      tail = &pair_cdr(*tail);
+    }
+  check_list_ends(1, &seq, "filter");
+  return head;
+}
@@ -6,11 +6,14 @@
  * Copyright (C) 2013-03-13 liutos <mat.liutos@gmail.com>
  */
 #include <assert.h>
+#include <inttypes.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "object.h"
+#include "number.h"
 #include "types.h"
 
 /* extern int is_label(sexp); */
@@ -21,16 +24,31 @@ void write_char(char c, lisp_object_t port) {
   fputc(c, out_port_stream(port));
 }
 
+/* Writes the UTF-8 encoding of a character */
+void write_code_point(int code, sexp port) {
+  char bytes[UTF8_LENGTH];
+  fwrite(bytes, 1, utf8_encode(code, bytes), out_port_stream(port));
+}
+
 void write_string(char *str, lisp_object_t port) {
   fprintf(out_port_stream(port), "%s", str);
 }
 
-void write_fixnum(int n, sexp port) {
-  fprintf(out_port_stream(port), "%d", n);
+void write_fixnum(intptr_t n, sexp port) {
+  fprintf(out_port_stream(port), "%" PRIdPTR, n);
 }
 
-void write_flonum(float f, sexp port) {
-  fprintf(out_port_stream(port), "%f", f);
+/* Writes the shortest digits which read back as the same double */
+void write_flonum(double f, sexp port) {
+  char buffer[32];
+  for (int precision = 15; precision <= 17; precision++) {
+    sprintf(buffer, "%.*g", precision, f);
+    if (strtod(buffer, NULL) == f) break;
+  }
+  /* Keeps a flonum distinguishable from an integer */
+  if (strspn(buffer, "-0123456789") == strlen(buffer))
+    strcat(buffer, ".0");
+  fputs(buffer, out_port_stream(port));
 }
 
 void write_addr(void *ptr, sexp port) {
@@ -43,7 +61,7 @@ void write_object(sexp object, sexp port) {
   if (is_fixnum(object))
     write_fixnum(fixnum_value(object), port);
   else if (is_char(object)) {
-    char c = char_value(object);
+    int c = char_value(object);
     switch (c) {
       case '\n': write_string("#\\\\n", port); break;
       case '\r': write_string("#\\\\r", port); break;
@@ -55,6 +73,10 @@ void write_object(sexp object, sexp port) {
       default :
         if (33 <= c && c <= 127)
           fprintf(stream, "#\\%c", c);
+        else if (c >= 0x80) {
+          write_string("#\\", port);
+          write_code_point(c, port);
+        }
         else
           fprintf(stream, "#\\\\x%02d", c);
     }
@@ -66,6 +88,10 @@ void write_object(sexp object, sexp port) {
     write_string("#<eof>", port);
   else if (is_undefined(object))
     write_string("#<undefined>", port);
+  else if (is_register(object)) {
+    write_char('r', port);
+    write_fixnum(register_index(object), port);
+  }
   if (!is_pointer(object)) return;
 pointer:
   /* objects on heap process starts */
@@ -123,7 +149,7 @@ pointer:
       while (!is_null(code)) {
         sexp ins = pair_car(code);
         if (is_label(ins))
-          port_format(port, "%s:", symbol_name(ins));
+          port_format(port, "%*:", ins);
         else
           port_format(port, "\t%*\n", ins);
         code = pair_cdr(code);
@@ -134,18 +160,66 @@ pointer:
       write_string("#(", port);
       for (int i = 0; i < vector_pos(object); i++) {
         write_object(vector_data_at(object, i), port);
-        if (i != vector_length(object) - 1)
+        if (i != vector_pos(object) - 1)
           write_char(' ', port);
       }
       write_char(')', port);
       break;
+    case UVECTOR: {
+      static char *tags[] = {"f64", "s32", "u8"};
+      port_format(port, "#%s(", make_string(tags[uvector_kind(object)]));
+      for (int i = 0; i < uvector_length(object); i++) {
+        if (i > 0) write_char(' ', port);
+        if (uvector_kind(object) == UVECTOR_F64)
+          write_flonum(uvector_f64(object)[i], port);
+        else if (uvector_kind(object) == UVECTOR_S32)
+          write_fixnum(uvector_s32(object)[i], port);
+        else
+          write_fixnum(uvector_u8(object)[i], port);
+      }
+      write_char(')', port);
+      break;
+    }
+    case HASH_TABLE:
+      port_format(port, "#<hash-table :count %* %p>",
+                  make_fixnum(table_count(object)), object);
+      break;
+    case HAMT:
+      port_format(port, hamt_is_transient(object) ?
+                  "#<transient-hamt :count %* %p>": "#<hamt :count %* %p>",
+                  make_fixnum(hamt_count(object)), object);
+      break;
+    case RECORD_TYPE:
+      port_format(port, "#<record-type %* %p>", record_type_name(object), object);
+      break;
+    case RECORD: {
+      sexp fields = record_type_fields(record_type(object));
+      port_format(port, "#<%*", record_type_name(record_type(object)));
+      for (int i = 0; is_pair(fields); fields = pair_cdr(fields), i++)
+        port_format(port, " :%* %*", pair_car(fields), record_slot(object, i));
+      write_char('>', port);
+      break;
+    }
+    case GENERIC:
+      port_format(port, "#<generic %* %p>", generic_name(object), object);
+      break;
+    case REGEXP:
+      port_format(port, "#<regex %*>", regexp_source(object));
+      break;
     case RETURN_INFO:
-      fprintf(stream, "#<return-info :code %p :pc %d :env %p>",
+      fprintf(stream, "#<return-info :code %p :pc %d :env %p :fp %d>",
               return_code(object),
               return_pc(object),
-              return_env(object));
+              return_env(object),
+              return_fp(object));
       break;
     case FLONUM: write_flonum(float_value(object), port); break;
+    case BIGNUM: {
+      char *digits = integer_to_string(object);
+      fputs(digits, stream);
+      free(digits);
+    }
+      break;
     case ENVIRONMENT:
       /* port_format(scm_out_port, "#<environment :bindings %* :outer_env %p>", */
       /*             environment_bindings(object), */
@@ -156,21 +230,17 @@ pointer:
         port_format(port, " %*", environment_bindings(env));
       port_format(port, " %p>", object);
       break;
+    case FRAME:
+      write_string("#<frame", port);
+      for (int i = 0; i < frame_size(object); i++)
+        port_format(port, " %*", frame_slot(object, i));
+      port_format(port, " %p>", object);
+      break;
+    case BOX:
+      port_format(port, "#<box %*>", box_value(object));
+      break;
     /* case STRING_IN_PORT: */
     /*   port_format(port, "#<string-port :in %p>", object); break; */
-    case WCHAR:
-      /* write_string(wchar_value(object), port); break; */
-      port_format(port, "#\\%s", make_string(wchar_value(object))); break;
-    case WSTRING:
-      write_char('"', port);
-      for (int i = 0; i < wstring_length(object); i++) {
-        /* write_object(wstring_value(object)[i], port); */
-        sexp c = wstring_value(object)[i];
-        if (is_char(c)) write_char(char_value(c), port);
-        if (is_wchar(c)) write_string(wchar_value(c), port);
-      }
-      write_char('"', port);
-      break;
     default :
       fprintf(stderr, "cannot write unknown type %d\n", object->type);
       exit(1);
@@ -188,7 +258,7 @@ void port_format(sexp port, const char *fmt, ...) {
       c = *fmt++;
       sexp obj = va_arg(ap, sexp);
       switch (c) {
-        case 'c': write_char(char_value(obj), port); break;
+        case 'c': write_code_point(char_value(obj), port); break;
         case 'd': write_fixnum(fixnum_value(obj), port); break;
         case 'f': write_flonum(float_value(obj), port); break;
         case 'p': write_addr(obj, port); break;